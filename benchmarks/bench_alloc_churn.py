@@ -0,0 +1,44 @@
+"""
+Create and drop churn of MenuItem and TrayIcon objects: time per
+object and the free list hit rate from get_free_list_stats().
+"""
+
+import pywintray
+
+from bench_utils import best_time, report
+
+COUNT = 10000
+
+def churn_menu_items():
+    for i in range(COUNT):
+        pywintray.MenuItem.string("item")
+
+def churn_menu_item_batches():
+    # a whole menu's worth at once, then all dropped
+    items = [pywintray.MenuItem.string("item") for i in range(COUNT)]
+    del items
+
+def churn_tray_icons():
+    for i in range(COUNT):
+        pywintray.TrayIcon()
+
+def main():
+    for name, key, fn in (
+        ("MenuItem, one at a time", "menu_item", churn_menu_items),
+        ("MenuItem, 10000 then dropped", "menu_item", churn_menu_item_batches),
+        ("TrayIcon, one at a time", "tray_icon", churn_tray_icons),
+    ):
+        before = pywintray.get_free_list_stats()[key]
+        seconds = best_time(fn)
+        after = pywintray.get_free_list_stats()[key]
+        hits = after["hits"]-before["hits"]
+        misses = after["misses"]-before["misses"]
+        report(
+            name, seconds/COUNT,
+            hit_rate=f"{hits/max(hits+misses, 1):.1%}",
+            retained=after["retained"],
+            retained_bytes=after["retained_bytes"],
+        )
+
+if __name__=="__main__":
+    main()
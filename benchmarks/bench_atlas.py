@@ -0,0 +1,35 @@
+"""
+Creating the icons of a 64-frame strip with IconHandle.from_atlas()
+against slicing the tiles in Python and calling from_buffer() for each.
+"""
+
+import random
+
+import pywintray
+
+from bench_utils import best_time, report
+
+FRAMES = 64
+TILE = 32
+
+def per_tile(buffer):
+    stride = FRAMES*TILE*4
+    icons = []
+    for frame in range(FRAMES):
+        tile = b"".join(
+            buffer[y*stride+frame*TILE*4:y*stride+(frame+1)*TILE*4]
+            for y in range(TILE)
+        )
+        icons.append(pywintray.IconHandle.from_buffer(tile, TILE, TILE, sizes=[16]))
+    return icons
+
+def main():
+    buffer = random.randbytes(FRAMES*TILE*TILE*4)
+
+    seconds = best_time(lambda: pywintray.IconHandle.from_atlas(buffer, TILE, TILE, FRAMES, sizes=[16]))
+    report(f"from_atlas {FRAMES} frames", seconds)
+    seconds = best_time(lambda: per_tile(buffer))
+    report(f"from_buffer per tile {FRAMES} frames", seconds)
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,43 @@
+"""
+Filling a menu item by item against Menu.extend(), Menu.batch()
+and Menu.replace_items().
+"""
+
+import pywintray
+
+from bench_utils import best_time, make_menu, report
+
+COUNT = 2000
+
+def new_items():
+    return [pywintray.MenuItem.string(f"item{i}") for i in range(COUNT)]
+
+def new_menu():
+    return make_menu([])
+
+def per_call(menu, items):
+    for item in items:
+        menu.append_item(item)
+
+def batched(menu, items):
+    with menu.batch() as batch:
+        for item in items:
+            batch.append_item(item)
+
+def main():
+    forms = {
+        "append_item per call": per_call,
+        "batch() append_item": batched,
+        "extend()": lambda menu, items: menu.extend(items),
+        "replace_items()": lambda menu, items: menu.replace_items(items),
+    }
+    for name, fill in forms.items():
+        def run():
+            fill(new_menu(), new_items())
+        # creating the items and the menu is the same for every form
+        overhead = best_time(lambda: (new_menu(), new_items()))
+        seconds = best_time(run)-overhead
+        report(f"{name}, {COUNT} items", seconds/COUNT)
+
+if __name__=="__main__":
+    main()
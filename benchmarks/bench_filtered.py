@@ -0,0 +1,57 @@
+"""
+Per-keystroke latency of Menu.filtered() over 50,000 labels, against
+filtering in Python and rebuilding a menu with replace_items().
+"""
+
+import random
+import time
+
+import pywintray
+
+from bench_utils import best_time, report
+
+COUNT = 50000
+WORDS = [
+    "network", "settings", "profile", "launch", "terminal", "editor",
+    "browser", "monitor", "backup", "restore", "printer", "display",
+]
+
+def main():
+    rng = random.Random(0)
+    labels = [f"{rng.choice(WORDS)} {rng.choice(WORDS)} {i}" for i in range(COUNT)]
+    menu = pywintray.Menu.from_spec(labels)
+    items = menu.as_tuple()
+
+    start = time.perf_counter()
+    menu.filtered("xyz")
+    report("first query (builds the index)", time.perf_counter()-start)
+
+    rebuilt = pywintray.Menu.from_spec([])
+    query = "network set"
+    for length in range(1, len(query)+1):
+        typed = query[:length]
+        # each query alternates with the previous one,
+        # as a keystroke and a backspace would
+        previous = query[:length-1]
+        def keystroke():
+            menu.filtered(previous)
+            menu.filtered(typed)
+        seconds = best_time(keystroke)/2
+        matches = len(menu.filtered(typed).as_tuple())
+        report(f"filtered({typed!r})", seconds, matches=matches)
+
+        def python_rebuild():
+            for text in (previous, typed):
+                text = text.lower()
+                rebuilt.replace_items([item for item in items if text in item.label.lower()])
+        report(f"Python filter, {typed!r}", best_time(python_rebuild)/2)
+
+    # a label change is applied to the index incrementally
+    item = items[COUNT//2]
+    def relabel_and_query():
+        item.label = "network settings renamed" if not item.label.endswith("renamed") else "launch"
+        menu.filtered("renamed")
+    report("label change, then filtered()", best_time(relabel_and_query, number=10))
+
+if __name__=="__main__":
+    main()
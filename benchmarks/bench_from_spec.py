@@ -0,0 +1,36 @@
+"""
+Construction throughput of Menu.from_spec() against a class
+definition with the same items.
+"""
+
+import pywintray
+
+from bench_utils import best_time, report
+
+def spec_of(count):
+    return [
+        (f"sub{s}", [f"item{s}-{i}" for i in range(10)])
+        for s in range(count//10)
+    ]
+
+def from_class(spec):
+    # what `class MyMenu(pywintray.Menu): ...` does
+    namespace = {}
+    for label, entries in spec:
+        sub_namespace = {
+            f"item{i}": pywintray.MenuItem.string(entry) for i, entry in enumerate(entries)
+        }
+        sub = type(pywintray.Menu)(label, (pywintray.Menu,), sub_namespace)
+        namespace[label] = pywintray.MenuItem.submenu(label)(sub)
+    return type(pywintray.Menu)("MyMenu", (pywintray.Menu,), namespace)
+
+def main():
+    for count in (100, 1000, 10000):
+        spec = spec_of(count)
+        seconds = best_time(lambda: pywintray.Menu.from_spec(spec))
+        report(f"from_spec, {count} items", seconds, items_per_s=f"{count/seconds:.0f}")
+        seconds = best_time(lambda: from_class(spec))
+        report(f"class definitions, {count} items", seconds, items_per_s=f"{count/seconds:.0f}")
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,40 @@
+"""
+Cost of the IconHandle budget: touching more icons than the budget
+evicts and re-creates them, the counters show how many.
+"""
+
+import pywintray
+from pywintray import _test_api
+
+from bench_utils import best_time, report
+
+ICON_COUNT = 64
+
+def touch_all(icons):
+    for icon in icons:
+        # the handle is re-created if the icon is evicted
+        _test_api.get_internal_id(icon)
+
+def main():
+    icons = [
+        pywintray.IconHandle.from_buffer(bytes((i, 0, 255-i, 255))*32*32, 32, 32)
+        for i in range(ICON_COUNT)
+    ]
+
+    try:
+        for budget in (0, ICON_COUNT, ICON_COUNT//4, 4):
+            pywintray.set_icon_handle_budget(budget)
+            base = pywintray.get_icon_handle_stats()
+            seconds = best_time(lambda: touch_all(icons))
+            stats = pywintray.get_icon_handle_stats()
+            report(
+                f"touch {ICON_COUNT} icons, budget {budget}", seconds/ICON_COUNT,
+                live=stats["live"],
+                evictions=stats["evictions"]-base["evictions"],
+                rematerializations=stats["rematerializations"]-base["rematerializations"],
+            )
+    finally:
+        pywintray.set_icon_handle_budget(0)
+
+if __name__=="__main__":
+    main()
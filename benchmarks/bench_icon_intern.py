@@ -0,0 +1,36 @@
+"""
+Hash throughput of the icon interning, and the hit rate
+when many icons are created from a few distinct images.
+"""
+
+import random
+
+import pywintray
+from pywintray import _test_api
+
+from bench_utils import best_time, report
+
+DISTINCT = 20
+CREATED = 1000
+
+def main():
+    for side in (16, 32, 256):
+        buffer = random.randbytes(side*side*4)
+        seconds = best_time(lambda: _test_api.xxh64(buffer), number=100)
+        report(f"xxh64 {side}x{side}", seconds, MB_per_s=f"{len(buffer)/seconds/1e6:.1f}")
+
+    images = [random.randbytes(32*32*4) for _ in range(DISTINCT)]
+    workload = [random.choice(images) for _ in range(CREATED)]
+    for intern in (False, True):
+        base = pywintray.get_icon_handle_stats()
+        def create():
+            return [pywintray.IconHandle.from_buffer(b, 32, 32, intern=intern) for b in workload]
+        seconds = best_time(create, repeat=1)
+        hits = pywintray.get_icon_handle_stats()["intern_hits"]-base["intern_hits"]
+        report(
+            f"{CREATED} icons of {DISTINCT} images, intern={intern}", seconds/CREATED,
+            hit_rate=f"{hits/CREATED:.2f}",
+        )
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,49 @@
+"""
+Inserting submenu items into deep and wide hierarchies,
+every insertion is checked for a cycle.
+"""
+
+import time
+
+import pywintray
+
+from bench_utils import make_menu, report
+
+INSERTS = 200
+
+def new_submenu_items(count):
+    return [
+        pywintray.MenuItem.submenu(f"new{i}")(make_menu([]))
+        for i in range(count)
+    ]
+
+def time_inserts(target):
+    items = new_submenu_items(INSERTS)
+    start = time.perf_counter()
+    for item in items:
+        target.append_item(item)
+    return (time.perf_counter()-start)/INSERTS
+
+def deep(depth):
+    menus = [make_menu([]) for _ in range(depth)]
+    for parent, child in zip(menus, menus[1:]):
+        parent.append_item(pywintray.MenuItem.submenu("child")(child))
+    # the deepest menu has `depth` ancestors
+    return menus[-1]
+
+def wide(width):
+    shared = make_menu([])
+    parents = [make_menu([]) for _ in range(width)]
+    for parent in parents:
+        parent.append_item(pywintray.MenuItem.submenu("shared")(shared))
+    return shared, parents
+
+def main():
+    for depth in (10, 100, 1000):
+        report(f"insert at depth {depth}", time_inserts(deep(depth)))
+    for width in (10, 100, 1000):
+        shared, parents = wide(width)
+        report(f"insert into a menu with {width} parents", time_inserts(shared))
+
+if __name__=="__main__":
+    main()
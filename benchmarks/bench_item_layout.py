@@ -0,0 +1,39 @@
+"""
+MenuItem memory per item, and the time to change the flags of every
+item of a menu and show the menu with the new flags.
+"""
+
+import sys
+import tracemalloc
+
+import pywintray
+
+from bench_utils import best_popup_time, popup_time, report
+
+def main():
+    item = pywintray.MenuItem.string("item")
+    print(f"MenuItem.__basicsize__: {type(item).__basicsize__} bytes")
+    print(f"sys.getsizeof(MenuItem): {sys.getsizeof(item)} bytes")
+
+    for count in (1000, 10000, 100000):
+        tracemalloc.start()
+        before = tracemalloc.get_traced_memory()[0]
+        items = [pywintray.MenuItem.check(f"item{i}") for i in range(count)]
+        after = tracemalloc.get_traced_memory()[0]
+        tracemalloc.stop()
+        menu = pywintray.Menu.from_spec(items)
+        popup_time(menu)
+
+        def toggle_all():
+            for item in items:
+                item.enabled = not item.enabled
+                item.checked = not item.checked
+        seconds = best_popup_time(menu, toggle_all)
+        report(
+            f"toggle flags of {count} items", seconds,
+            items_per_s=f"{count/seconds:.0f}",
+            bytes_per_item=f"{(after-before)/count:.0f}",
+        )
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,28 @@
+"""
+Latency of an update of one item against the size of the tree,
+from the change to the popup showing it. The item is found by its
+link instead of a search.
+"""
+
+from bench_utils import best_popup_time, make_menu, popup_time, report
+
+def main():
+    for count in (10, 100, 1000, 10000):
+        # `count` items spread over submenus of 100 items
+        menu = make_menu([
+            (f"sub{s}", [f"item{s}-{i}" for i in range(min(100, count-s*100))])
+            for s in range((count+99)//100)
+        ])
+        popup_time(menu)
+        last_sub = menu.as_tuple()[-1].sub
+        item = last_sub.as_tuple()[-1]
+
+        labels = ("a", "b")
+        state = [0]
+        def update():
+            state[0] ^= 1
+            item.label = labels[state[0]]
+        report(f"update 1 of {count} items", best_popup_time(menu, update))
+
+if __name__=="__main__":
+    main()
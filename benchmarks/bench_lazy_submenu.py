@@ -0,0 +1,48 @@
+"""
+Building a menu whose submenus are filled by providers when opened,
+against building every submenu up front: time to the first popup and
+memory allocated.
+"""
+
+import tracemalloc
+
+import pywintray
+
+from bench_utils import best_time, make_menu, popup_time, report
+
+SUBMENUS = 50
+ITEMS = 200
+
+def provider(menu):
+    return [pywintray.MenuItem.string(f"item{i}") for i in range(ITEMS)]
+
+def build_eager():
+    menu = make_menu([
+        (f"sub{s}", [f"item{i}" for i in range(ITEMS)]) for s in range(SUBMENUS)
+    ])
+    popup_time(menu)
+    return menu
+
+def build_lazy():
+    menu = make_menu([(f"sub{s}", []) for s in range(SUBMENUS)])
+    for item in menu.as_tuple():
+        item.sub.register_provider(provider)
+    # the providers are called when a submenu is opened, not here
+    popup_time(menu)
+    return menu
+
+def main():
+    for name, build in (("eager", build_eager), ("lazy", build_lazy)):
+        seconds = best_time(build)
+        tracemalloc.start()
+        menu = build()
+        allocated, _ = tracemalloc.get_traced_memory()
+        tracemalloc.stop()
+        del menu
+        report(
+            f"{name}, {SUBMENUS} submenus of {ITEMS} items", seconds,
+            allocated_KiB=allocated//1024,
+        )
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,40 @@
+"""
+Full menu build time and live allocations, for unique labels and for
+labels repeated across items (which share one UTF-16 buffer), and the
+time to rewrite every item when the labels are already converted.
+"""
+
+import tracemalloc
+
+from bench_utils import best_popup_time, best_time, make_menu, popup_time, report
+
+COUNT = 5000
+
+def main():
+    for name, labels in (
+        ("unique labels", [f"item{i}" for i in range(COUNT)]),
+        ("10 distinct labels", [f"item{i%10}" for i in range(COUNT)]),
+    ):
+        def build():
+            menu = make_menu(labels)
+            popup_time(menu)
+            return menu
+        seconds = best_time(build)
+
+        tracemalloc.start()
+        menu = build()
+        blocks = len(tracemalloc.take_snapshot().traces)
+        tracemalloc.stop()
+        report(f"build {COUNT} items, {name}", seconds, live_blocks=blocks)
+
+        # every item is written again, the labels come from the cache
+        items = menu.as_tuple()
+        state = [False]
+        def toggle():
+            state[0] = not state[0]
+            for item in items:
+                item.enabled = state[0]
+        report(f"rewrite {COUNT} items, {name}", best_popup_time(menu, toggle))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,23 @@
+"""
+Popup preparation time, from Menu.popup() to the menu being shown,
+for menus of 10, 1,000 and 10,000 items, when nothing changed and
+when one item changed.
+"""
+
+from bench_utils import best_popup_time, make_menu, popup_time, report
+
+def main():
+    for count in (10, 1000, 10000):
+        menu = make_menu([f"item{i}" for i in range(count)])
+        item = menu.as_tuple()[count//2]
+        # the first popup writes every item
+        popup_time(menu)
+
+        report(f"{count} items, unchanged", best_popup_time(menu))
+
+        def change_one():
+            item.label = "changed" if item.label!="changed" else "item"
+        report(f"{count} items, one changed", best_popup_time(menu, change_one))
+
+if __name__=="__main__":
+    main()
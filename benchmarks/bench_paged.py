@@ -0,0 +1,41 @@
+"""
+A 100k-entry list shown as a paged menu: time to the first popup and
+memory allocated, against putting every entry in the menu.
+"""
+
+import tracemalloc
+
+from bench_utils import best_popup_time, best_time, make_menu, popup_time, report
+
+COUNT = 100000
+
+def build_paged():
+    menu = make_menu([])
+    menu.set_page_source(range(COUNT), page_size=50)
+    popup_time(menu)
+    return menu
+
+def build_full():
+    menu = make_menu([str(i) for i in range(COUNT)])
+    popup_time(menu)
+    return menu
+
+def measure(name, build, repeat):
+    seconds = best_time(build, repeat=repeat)
+    tracemalloc.start()
+    menu = build()
+    allocated, _ = tracemalloc.get_traced_memory()
+    tracemalloc.stop()
+    report(name, seconds, allocated_KiB=allocated//1024)
+    return menu
+
+def main():
+    menu = measure(f"paged, {COUNT} entries", build_paged, 5)
+
+    # a page change rebuilds the labels of the recycled page items
+    report("rebuild a page", best_popup_time(menu, menu.invalidate))
+
+    measure(f"every entry in the menu, {COUNT} entries", build_full, 1)
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,53 @@
+"""
+Latency from the future of Menu.popup_async() being resolved
+to the callback of the selected item starting.
+The item is selected with the keyboard.
+"""
+
+import ctypes
+import statistics
+import threading
+import time
+
+import pywintray
+
+from bench_utils import make_menu, report
+
+VK_RETURN = 0x0D
+VK_DOWN = 0x28
+KEYEVENTF_KEYUP = 0x0002
+
+ROUNDS = 20
+
+def press(vk):
+    ctypes.windll.user32.keybd_event(vk, 0, 0, 0)
+    ctypes.windll.user32.keybd_event(vk, 0, KEYEVENTF_KEYUP, 0)
+
+def main():
+    callback_started = threading.Event()
+    times = {}
+
+    def callback(_):
+        times["callback"] = time.perf_counter()
+        callback_started.set()
+
+    menu = make_menu([pywintray.MenuItem.string("item1", callback=callback)])
+
+    latencies = []
+    for _ in range(ROUNDS):
+        callback_started.clear()
+        future = menu.popup_async()
+        future.add_done_callback(lambda _: times.__setitem__("resolved", time.perf_counter()))
+        menu.wait_for_popup(2)
+        press(VK_DOWN)
+        press(VK_RETURN)
+        if not callback_started.wait(2):
+            raise RuntimeError("the item was not selected")
+        future.result(2)
+        latencies.append(times["callback"]-times["resolved"])
+
+    report("future resolved to callback start, median", statistics.median(latencies))
+    report("future resolved to callback start, max", max(latencies))
+
+if __name__=="__main__":
+    main()
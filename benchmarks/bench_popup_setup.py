@@ -0,0 +1,46 @@
+"""
+Popup setup latency, from the call to the menu being shown.
+Popups run one after another on one long-lived thread, which reuses
+its host window after the first one, against a new thread per popup.
+"""
+
+import queue
+import statistics
+import threading
+import time
+
+from bench_utils import make_menu, popup_time, report
+
+POPUPS = 30
+
+def popup_worker(menu, requests, done):
+    while requests.get():
+        menu.popup()
+        done.put(None)
+
+def main():
+    menu = make_menu([f"item{i}" for i in range(10)])
+
+    requests = queue.Queue()
+    done = queue.Queue()
+    thread = threading.Thread(target=popup_worker, args=(menu, requests, done), daemon=True)
+    thread.start()
+    latencies = []
+    for _ in range(POPUPS):
+        start = time.perf_counter()
+        requests.put(True)
+        menu.wait_for_popup(2)
+        latencies.append(time.perf_counter()-start)
+        menu.close()
+        done.get(timeout=2)
+    requests.put(False)
+    thread.join(2)
+
+    report("first popup (host window created)", latencies[0])
+    report("later popups on one thread, median", statistics.median(latencies[1:]))
+
+    latencies = [popup_time(menu) for _ in range(POPUPS)]
+    report("popup on a new thread, median", statistics.median(latencies))
+
+if __name__=="__main__":
+    main()
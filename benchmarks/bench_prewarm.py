@@ -0,0 +1,62 @@
+"""
+Click-to-menu latency, from the popup call to the menu being shown,
+for a menu with 5,000 changed items: cold, after Menu.prewarm(), and
+with presync on the running tray loop.
+"""
+
+import statistics
+import threading
+import time
+
+import pywintray
+from pywintray import _test_api
+
+from bench_utils import report
+
+COUNT = 5000
+POPUPS = 10
+
+def popup_latency(menu, items, prepare):
+    latencies = []
+    for n in range(POPUPS):
+        for i, item in enumerate(items):
+            item.label = f"item{i}-{n}"
+        prepare()
+        start = time.perf_counter()
+        future = menu.popup_async()
+        menu.wait_for_popup(10)
+        latencies.append(time.perf_counter()-start)
+        menu.close()
+        future.result(10)
+    return statistics.median(latencies)
+
+def wait_for_presync(menu):
+    while _test_api.get_menu_dirty_items(menu):
+        time.sleep(0.001)
+
+def main():
+    menu = pywintray.Menu.from_spec([f"item{i}" for i in range(COUNT)])
+    items = menu.as_tuple()
+    # start the popup thread before timing
+    future = menu.popup_async()
+    menu.wait_for_popup(10)
+    menu.close()
+    future.result(10)
+
+    report(f"cold, {COUNT} changed items", popup_latency(menu, items, lambda: None))
+    report(f"after prewarm(), {COUNT} changed items", popup_latency(menu, items, menu.prewarm))
+
+    loop_thread = threading.Thread(target=pywintray.start_tray_loop, daemon=True)
+    loop_thread.start()
+    pywintray.wait_for_tray_loop_ready()
+    menu.set_presync()
+    try:
+        seconds = popup_latency(menu, items, lambda: wait_for_presync(menu))
+        report(f"presync, {COUNT} changed items", seconds)
+    finally:
+        menu.set_presync(False)
+        pywintray.stop_tray_loop()
+        loop_thread.join(2)
+
+if __name__=="__main__":
+    main()
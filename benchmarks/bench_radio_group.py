@@ -0,0 +1,42 @@
+"""
+Selection change cost against radio group size: RadioGroup.selected
+against the Python loop over siblings that plain radio items need,
+each followed by a popup showing the change.
+"""
+
+import pywintray
+from pywintray import _test_api
+
+from bench_utils import best_popup_time, popup_time, report
+
+def main():
+    for size in (2, 50, 500, 5000):
+        group = pywintray.RadioGroup()
+        grouped = [pywintray.MenuItem.check(f"profile{i}", group=group) for i in range(size)]
+        grouped_menu = pywintray.Menu.from_spec(grouped)
+        plain = [pywintray.MenuItem.check(f"profile{i}", radio=True) for i in range(size)]
+        plain_menu = pywintray.Menu.from_spec(plain)
+        popup_time(grouped_menu)
+        popup_time(plain_menu)
+
+        target = 0
+        dirty = 0
+        def select_grouped():
+            nonlocal target, dirty
+            target = (target+1)%size
+            group.selected = grouped[target]
+            dirty = len(_test_api.get_menu_dirty_items(grouped_menu))
+        seconds = best_popup_time(grouped_menu, select_grouped)
+        report(f"RadioGroup.selected, {size} items", seconds, dirty_items=dirty)
+
+        def select_plain():
+            nonlocal target, dirty
+            target = (target+1)%size
+            for i, item in enumerate(plain):
+                item.checked = i==target
+            dirty = len(_test_api.get_menu_dirty_items(plain_menu))
+        seconds = best_popup_time(plain_menu, select_plain)
+        report(f"sibling loop, {size} items", seconds, dirty_items=dirty)
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,22 @@
+"""
+Throughput of pywintray.resample() for the common icon sizes.
+"""
+
+import pywintray
+
+from bench_utils import best_time, report
+
+SIZES = [16, 20, 24, 32, 48, 64]
+
+def main():
+    for side in (64, 256, 1024):
+        # a gradient, so the filter has some work to do
+        row = bytes(v for x in range(side) for v in (x%256, 255-x%256, 128, 255))
+        buffer = row*side
+        for filter in ("box", "lanczos"):
+            seconds = best_time(lambda: pywintray.resample(buffer, side, side, SIZES, filter))
+            megabytes = len(buffer)/seconds/1e6
+            report(f"{side}x{side} {filter}", seconds, MB_per_s=f"{megabytes:.1f}")
+
+if __name__=="__main__":
+    main()
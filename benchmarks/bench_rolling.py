@@ -0,0 +1,34 @@
+"""
+Rolling log-viewer workload: append_item() plus remove_item(0) per
+entry, and as_tuple() after each step, for menus of 1,000 to 100,000
+entries.
+"""
+
+import pywintray
+
+from bench_utils import best_time, report
+
+STEPS = 1000
+
+def main():
+    for size in (1000, 10000, 100000):
+        menu = pywintray.Menu.from_spec([f"line{i}" for i in range(size)])
+        new_items = [pywintray.MenuItem.string(f"new{i}") for i in range(STEPS)]
+
+        def roll():
+            for item in new_items:
+                menu.append_item(item)
+                menu.remove_item(0)
+        report(f"append + remove front, {size} entries", best_time(roll)/STEPS)
+
+        def roll_snapshot():
+            for item in new_items:
+                menu.append_item(item)
+                menu.remove_item(0)
+                menu.as_tuple()
+        report(f"  with as_tuple(), {size} entries", best_time(roll_snapshot)/STEPS)
+
+        report(f"as_tuple() unchanged, {size} entries", best_time(menu.as_tuple, number=1000))
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,41 @@
+"""
+A "Tools" submenu shared under many parent menus: time from popup() of
+the root to the menu being shown after one Tools label changed, and
+how many times Tools was synced for it.
+"""
+
+import pywintray
+from pywintray import _test_api
+
+from bench_utils import best_popup_time, popup_time, report
+
+def build(parent_count):
+    tools = pywintray.Menu.from_spec([f"tool{i}" for i in range(50)], name="Tools")
+    root = pywintray.Menu.from_spec([], name="Root")
+    for i in range(parent_count):
+        parent = pywintray.Menu.from_spec([f"entry{j}" for j in range(5)], name=f"Parent{i}")
+        parent.append_item(pywintray.MenuItem.submenu("tools")(tools))
+        root.append_item(pywintray.MenuItem.submenu(f"parent{i}")(parent))
+    return root, tools
+
+def main():
+    for parent_count in (1, 10, 100, 1000):
+        root, tools = build(parent_count)
+        popup_time(root)
+        item = tools.as_tuple()[0]
+
+        base = _test_api.get_menu_sync_count(tools)
+        passes = 0
+        def change_one():
+            nonlocal passes
+            passes += 1
+            item.label = "changed" if item.label!="changed" else "tool0"
+        seconds = best_popup_time(root, change_one)
+        syncs = _test_api.get_menu_sync_count(tools)-base
+        report(
+            f"Tools shared by {parent_count} parents", seconds,
+            tools_syncs_per_pass=f"{syncs/passes:.2f}",
+        )
+
+if __name__=="__main__":
+    main()
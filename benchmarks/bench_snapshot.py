@@ -0,0 +1,54 @@
+"""
+Cold start of a menu from a Menu.dump() snapshot in a memory-mapped
+file against running the Python class definitions of the same menu.
+"""
+
+import mmap
+import os
+import tempfile
+
+import pywintray
+
+from bench_utils import best_time, report
+
+SUBMENUS = 100
+ITEMS = 20
+
+def callback(_):
+    pass
+
+def class_source():
+    lines = ["class MyMenu(pywintray.Menu):"]
+    for s in range(SUBMENUS):
+        lines.append(f"    @pywintray.MenuItem.submenu('sub{s}')")
+        lines.append(f"    class Sub{s}(pywintray.Menu):")
+        for i in range(ITEMS):
+            lines.append(f"        item{i} = pywintray.MenuItem.string('item{s}-{i}', callback=callback)")
+    return "\n".join(lines)
+
+def main():
+    source = class_source()
+    def run_source():
+        # compiled every time, like a cold import without a .pyc
+        namespace = {"pywintray": pywintray, "callback": callback}
+        exec(compile(source, "<menu>", "exec"), namespace)
+        return namespace["MyMenu"]
+
+    blob = run_source().dump()
+    callbacks = {callback.__qualname__: callback}
+    fd, path = tempfile.mkstemp(suffix=".bin")
+    try:
+        with os.fdopen(fd, "wb") as f:
+            f.write(blob)
+        def run_load():
+            with open(path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+                return pywintray.Menu.load(mm, callbacks=callbacks)
+
+        count = SUBMENUS*(ITEMS+1)
+        report(f"class definitions, {count} items", best_time(run_source))
+        report(f"Menu.load() from mmap, {count} items", best_time(run_load), blob_bytes=len(blob))
+    finally:
+        os.remove(path)
+
+if __name__=="__main__":
+    main()
@@ -0,0 +1,48 @@
+"""
+Applying small changes to a long menu with Menu.sync_to()
+against Menu.replace_items(): wall time and menu edits.
+The edits are the inserts and removes of the edit script,
+each is one InsertMenuItem or RemoveMenu call.
+"""
+
+import pywintray
+
+from bench_utils import best_time, report
+
+COUNT = 10000
+
+def edit_count(old, new):
+    # the length of the minimal edit script, computed in Python
+    import difflib
+    matcher = difflib.SequenceMatcher(None, [id(i) for i in old], [id(i) for i in new], autojunk=False)
+    kept = sum(block.size for block in matcher.get_matching_blocks())
+    return (len(old)-kept)+(len(new)-kept)
+
+def main():
+    items = [pywintray.MenuItem.string(f"item{i}") for i in range(COUNT)]
+    extra = [pywintray.MenuItem.string(f"extra{i}") for i in range(5)]
+
+    changes = {
+        "insert 1": items[:COUNT//2]+extra[:1]+items[COUNT//2:],
+        "remove 1": items[:COUNT//2]+items[COUNT//2+1:],
+        "replace 5 scattered": [
+            extra[i//(COUNT//5)] if i%(COUNT//5)==0 else item for i, item in enumerate(items)
+        ],
+        "move 1": items[1:COUNT//2]+items[:1]+items[COUNT//2:],
+    }
+    menu = pywintray.Menu.from_spec([])
+    menu.replace_items(items)
+
+    for name, changed in changes.items():
+        def sync_back_and_forth():
+            menu.sync_to(changed)
+            menu.sync_to(items)
+        def replace_back_and_forth():
+            menu.replace_items(changed)
+            menu.replace_items(items)
+        edits = edit_count(items, changed)
+        report(f"sync_to, {name} of {COUNT}", best_time(sync_back_and_forth)/2, edits=edits)
+        report(f"replace_items, {name} of {COUNT}", best_time(replace_back_and_forth)/2, edits=COUNT*2)
+
+if __name__=="__main__":
+    main()
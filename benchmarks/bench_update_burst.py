@@ -0,0 +1,43 @@
+"""
+Bursts of item changes while a popup is open: the count of update
+messages handled (one GIL acquisition each) per burst.
+"""
+
+import threading
+import time
+
+from pywintray import _test_api
+
+from bench_utils import make_menu, report
+
+BURSTS = 20
+
+def main():
+    menu = make_menu([f"item{i}" for i in range(100)])
+    items = menu.as_tuple()
+
+    thread = threading.Thread(target=menu.popup, daemon=True)
+    thread.start()
+    menu.wait_for_popup(2)
+    try:
+        for burst_size in (1, 10, 100, 1000):
+            base = _test_api.get_menu_update_message_count(menu)
+            elapsed = 0.0
+            for burst in range(BURSTS):
+                start = time.perf_counter()
+                for i in range(burst_size):
+                    items[i%len(items)].label = f"{burst}-{i}"
+                elapsed += time.perf_counter()-start
+                # let the popup drain the burst
+                time.sleep(0.05)
+            messages = _test_api.get_menu_update_message_count(menu)-base
+            report(
+                f"burst of {burst_size} changes", elapsed/BURSTS,
+                messages_per_burst=f"{messages/BURSTS:.2f}",
+            )
+    finally:
+        menu.close()
+        thread.join(2)
+
+if __name__=="__main__":
+    main()
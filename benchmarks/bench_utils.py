@@ -0,0 +1,73 @@
+"""
+Timing helpers shared by the benchmark scripts.
+
+The scripts use the installed pywintray and run on Windows,
+each one is run on its own:
+
+    python benchmarks/bench_resample.py
+"""
+
+import threading
+import time
+
+import pywintray
+
+def best_time(fn, repeat=5, number=1):
+    """The best time of `repeat` runs, per call of `fn`, in seconds"""
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        for _ in range(number):
+            fn()
+        best = min(best, (time.perf_counter()-start)/number)
+    return best
+
+def report(name, seconds, **extra):
+    extra_text = "".join(f"  {key}={value}" for key, value in extra.items())
+    print(f"{name:<44}{seconds*1e6:12.1f} us{extra_text}")
+
+def make_menu(entries):
+    """
+    A new Menu class holding `entries`, each entry is a label,
+    a MenuItem, or a (label, entries) tuple for a submenu.
+    """
+    class BenchMenu(pywintray.Menu):
+        pass
+    for entry in entries:
+        if isinstance(entry, tuple):
+            label, sub_entries = entry
+            entry = pywintray.MenuItem.submenu(label)(make_menu(sub_entries))
+        elif isinstance(entry, str):
+            entry = pywintray.MenuItem.string(entry)
+        BenchMenu.append_item(entry)
+    return BenchMenu
+
+def popup_time(menu):
+    """
+    Seconds from calling `menu.popup()` to the menu being shown,
+    which includes writing the pending changes to the HMENU.
+    The popup runs on a new thread and is closed afterwards.
+    """
+    start = time.perf_counter()
+    thread = threading.Thread(target=menu.popup, daemon=True)
+    thread.start()
+    if not menu.wait_for_popup(2):
+        raise RuntimeError("the menu was not shown")
+    seconds = time.perf_counter()-start
+    menu.close()
+    thread.join(2)
+    return seconds
+
+def best_popup_time(menu, before=None, repeat=5):
+    """
+    The best time of `repeat` runs of `before` (if given)
+    followed by popup_time(), in seconds
+    """
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        if before is not None:
+            before()
+        seconds = time.perf_counter()-start
+        best = min(best, seconds+popup_time(menu))
+    return best
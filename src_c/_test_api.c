@@ -41,7 +41,10 @@ test_api_get_internal_id(PyObject* self, PyObject* arg) {
         return NULL;
     }
     if (result) {
-        return PyLong_FromVoidPtr((void *)(((IconHandleObject *)arg)->icon_handle));
+        PWT_ENTER_ICON_HANDLE_CS();
+        HICON icon_handle = icon_handle_get_sized((IconHandleObject *)arg, 0);
+        PWT_LEAVE_ICON_HANDLE_CS();
+        return PyLong_FromVoidPtr((void *)icon_handle);
     }
 
     if(menu_subtype_check((PyObject *)arg)) {
@@ -52,10 +55,158 @@ test_api_get_internal_id(PyObject* self, PyObject* arg) {
     return NULL;
 }
 
+static PyObject*
+test_api_get_icon_size_cache(PyObject* self, PyObject* arg) {
+    if (!PyObject_TypeCheck(arg, pwt_globals.IconHandleType)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be an IconHandle");
+        return NULL;
+    }
+    IconHandleObject *icon = (IconHandleObject *)arg;
+
+    PyObject *result = PyList_New(0);
+    if (!result) {
+        return NULL;
+    }
+
+    PWT_ENTER_ICON_HANDLE_CS();
+    for (int i=0;i<PWT_ICON_SIZE_CACHE_LENGTH;i++) {
+        if (!icon->size_cache[i].icon_handle) {
+            continue;
+        }
+        PyObject *size = PyLong_FromLong(icon->size_cache[i].size);
+        if (!size || PyList_Append(result, size)<0) {
+            Py_XDECREF(size);
+            Py_CLEAR(result);
+            break;
+        }
+        Py_DECREF(size);
+    }
+    PWT_LEAVE_ICON_HANDLE_CS();
+
+    return result;
+}
+
+static PyObject*
+test_api_get_menu_dirty_items(PyObject* self, PyObject* arg) {
+    if (!menu_subtype_check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a subtype of Menu");
+        return NULL;
+    }
+    MenuTypeObject *menu = (MenuTypeObject *)arg;
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    PyObject *result = PyList_New(menu->dirty_count);
+    if (result) {
+        for (Py_ssize_t i=0;i<menu->dirty_count;i++) {
+            Py_INCREF(menu->dirty_items[i]);
+            PyList_SET_ITEM(result, i, (PyObject *)(menu->dirty_items[i]));
+        }
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    return result;
+}
+
+static PyObject*
+test_api_get_menu_item_links(PyObject* self, PyObject* arg) {
+    if (!PyObject_TypeCheck(arg, pwt_globals.MenuItemType)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a MenuItem");
+        return NULL;
+    }
+    MenuItemObject *item = (MenuItemObject *)arg;
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    PyObject *result = PyList_New(item->links_count);
+    for (Py_ssize_t i=0;result && i<item->links_count;i++) {
+        PyObject *link = Py_BuildValue(
+            "(On)", item->links[i].menu, MENU_ITEM_LINK_INDEX(&(item->links[i]))
+        );
+        if (!link) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, link);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    return result;
+}
+
+static PyObject*
+test_api_get_menu_update_message_count(PyObject* self, PyObject* arg) {
+    if (!menu_subtype_check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a subtype of Menu");
+        return NULL;
+    }
+    return PyLong_FromSsize_t(((MenuTypeObject *)arg)->update_message_count);
+}
+
+static PyObject*
+test_api_get_menu_sync_count(PyObject* self, PyObject* arg) {
+    if (!menu_subtype_check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a subtype of Menu");
+        return NULL;
+    }
+    return PyLong_FromSsize_t(((MenuTypeObject *)arg)->sync_count);
+}
+
+static PyObject*
+test_api_get_menu_presync_count(PyObject* self, PyObject* arg) {
+    if (!menu_subtype_check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a subtype of Menu");
+        return NULL;
+    }
+    return PyLong_FromSsize_t(((MenuTypeObject *)arg)->presync_count);
+}
+
+static PyObject*
+test_api_get_wide_label(PyObject* self, PyObject* arg) {
+    if (!PyObject_TypeCheck(arg, pwt_globals.MenuItemType)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a MenuItem");
+        return NULL;
+    }
+    MenuItemObject *item = (MenuItemObject *)arg;
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    PyObject *result;
+    if (item->wide_label) {
+        result = Py_BuildValue("(Kn)",
+            (unsigned long long)(ULONG_PTR)(item->wide_label),
+            item->wide_label->refcount
+        );
+    }
+    else {
+        result = Py_NewRef(Py_None);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    return result;
+}
+
+static PyObject*
+test_api_xxh64(PyObject* self, PyObject* args) {
+    Py_buffer buffer;
+    unsigned long long seed = 0;
+    if (!PyArg_ParseTuple(args, "y*|K", &buffer, &seed)) {
+        return NULL;
+    }
+    UINT64 result = xxh64(buffer.buf, buffer.len, seed);
+    PyBuffer_Release(&buffer);
+    return PyLong_FromUnsignedLongLong(result);
+}
+
 static PyMethodDef test_api_methods[] = {
     {"get_internal_tray_icon_dict", (PyCFunction)test_api_get_internal_tray_icon_dict, METH_NOARGS, NULL},
     {"get_internal_menu_item_dict", (PyCFunction)test_api_get_internal_menu_item_dict, METH_NOARGS, NULL},
     {"get_internal_id", (PyCFunction)test_api_get_internal_id, METH_O, NULL},
+    {"get_icon_size_cache", (PyCFunction)test_api_get_icon_size_cache, METH_O, NULL},
+    {"xxh64", (PyCFunction)test_api_xxh64, METH_VARARGS, NULL},
+    {"get_menu_dirty_items", (PyCFunction)test_api_get_menu_dirty_items, METH_O, NULL},
+    {"get_menu_item_links", (PyCFunction)test_api_get_menu_item_links, METH_O, NULL},
+    {"get_menu_update_message_count", (PyCFunction)test_api_get_menu_update_message_count, METH_O, NULL},
+    {"get_menu_sync_count", (PyCFunction)test_api_get_menu_sync_count, METH_O, NULL},
+    {"get_menu_presync_count", (PyCFunction)test_api_get_menu_presync_count, METH_O, NULL},
+    {"get_wide_label", (PyCFunction)test_api_get_wide_label, METH_O, NULL},
     {NULL, NULL, 0, NULL}
 };
 
@@ -0,0 +1,197 @@
+/*
+This file implements the free lists of MenuItem and TrayIcon
+*/
+
+#include "pywintray.h"
+
+static void
+reset_free_list_stats(PWTFreeListStats *stats) {
+    stats->retained = 0;
+    stats->retained_bytes = 0;
+    stats->hits = 0;
+    stats->misses = 0;
+}
+
+static void
+free_list_clear(PWTFreeList *list) {
+    while (list->stats.retained) {
+        // the types are not GC types, tp_free is PyObject_Free
+        PyObject_Free(list->objects[--(list->stats.retained)]);
+    }
+    list->stats.retained_bytes = 0;
+}
+
+static void
+add_free_list_stats(PWTFreeListStats *sum, PWTFreeListStats *stats) {
+    sum->retained += stats->retained;
+    sum->retained_bytes += stats->retained_bytes;
+    sum->hits += stats->hits;
+    sum->misses += stats->misses;
+}
+
+#ifdef Py_GIL_DISABLED
+
+// FLS callback, frees the lists of a thread when it exits.
+// FlsFree() in the module cleanup calls this for the lists of
+// all the threads on the current thread.
+static void WINAPI
+free_thread_free_lists(void *data) {
+    PWTFreeLists *lists = data;
+    if (!lists) {
+        return;
+    }
+
+    EnterCriticalSection(&(pwt_globals.free_lists_cs));
+    if (lists->prev) {
+        lists->prev->next = lists->next;
+    }
+    else {
+        pwt_globals.free_lists_head = lists->next;
+    }
+    if (lists->next) {
+        lists->next->prev = lists->prev;
+    }
+    for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+        // the objects are freed, the counts stay in the stats
+        pwt_globals.free_lists_exited[i].hits += lists->lists[i].stats.hits;
+        pwt_globals.free_lists_exited[i].misses += lists->lists[i].stats.misses;
+    }
+    LeaveCriticalSection(&(pwt_globals.free_lists_cs));
+
+    for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+        free_list_clear(&(lists->lists[i]));
+    }
+    PyMem_RawFree(lists);
+}
+
+// Get the lists of the current thread, created on the first use.
+// NULL if they can't be created, the objects are not recycled then.
+static PWTFreeList *
+get_free_list(PWTFreeListKind kind) {
+    PWTFreeLists *lists = FlsGetValue(pwt_globals.free_lists_fls_index);
+    if (!lists) {
+        lists = PyMem_RawMalloc(sizeof(PWTFreeLists));
+        if (!lists) {
+            return NULL;
+        }
+        for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+            reset_free_list_stats(&(lists->lists[i].stats));
+        }
+        lists->prev = NULL;
+
+        EnterCriticalSection(&(pwt_globals.free_lists_cs));
+        lists->next = pwt_globals.free_lists_head;
+        if (lists->next) {
+            lists->next->prev = lists;
+        }
+        pwt_globals.free_lists_head = lists;
+        LeaveCriticalSection(&(pwt_globals.free_lists_cs));
+
+        if (!FlsSetValue(pwt_globals.free_lists_fls_index, lists)) {
+            free_thread_free_lists(lists);
+            return NULL;
+        }
+    }
+    return &(lists->lists[kind]);
+}
+
+#else
+
+static PWTFreeList *
+get_free_list(PWTFreeListKind kind) {
+    return &(pwt_globals.free_lists.lists[kind]);
+}
+
+#endif // Py_GIL_DISABLED
+
+BOOL
+pwt_free_lists_init() {
+#ifdef Py_GIL_DISABLED
+    InitializeCriticalSection(&(pwt_globals.free_lists_cs));
+    pwt_globals.free_lists_head = NULL;
+    for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+        reset_free_list_stats(&(pwt_globals.free_lists_exited[i]));
+    }
+    pwt_globals.free_lists_fls_index = FlsAlloc(free_thread_free_lists);
+    if (pwt_globals.free_lists_fls_index==FLS_OUT_OF_INDEXES) {
+        PyErr_SetFromWindowsErr(0);
+        return FALSE;
+    }
+#else
+    for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+        reset_free_list_stats(&(pwt_globals.free_lists.lists[i].stats));
+    }
+#endif // Py_GIL_DISABLED
+    return TRUE;
+}
+
+PyObject *
+pwt_free_list_alloc(PWTFreeListKind kind, PyTypeObject *type) {
+    PWTFreeList *list = get_free_list(kind);
+    if (!list) {
+        return type->tp_alloc(type, 0);
+    }
+    if (list->stats.retained) {
+        PyObject *obj = list->objects[--(list->stats.retained)];
+        list->stats.retained_bytes -= type->tp_basicsize;
+        list->stats.hits++;
+
+        // zeroed like a new object of tp_alloc
+        BYTE *body = (BYTE *)obj;
+        for (Py_ssize_t i=sizeof(PyObject);i<type->tp_basicsize;i++) {
+            body[i] = 0;
+        }
+        // takes a reference to the heap type
+        return PyObject_Init(obj, type);
+    }
+    list->stats.misses++;
+    return type->tp_alloc(type, 0);
+}
+
+void
+pwt_free_list_free(PWTFreeListKind kind, PyObject *obj) {
+    PyTypeObject *type = Py_TYPE(obj);
+    PWTFreeList *list = get_free_list(kind);
+    if (list && list->stats.retained<PWT_FREE_LIST_CAPACITY) {
+        list->objects[list->stats.retained++] = obj;
+        list->stats.retained_bytes += type->tp_basicsize;
+    }
+    else {
+        type->tp_free(obj);
+    }
+    Py_DECREF(type);
+}
+
+void
+pwt_free_list_stats(PWTFreeListKind kind, PWTFreeListStats *stats) {
+#ifdef Py_GIL_DISABLED
+    reset_free_list_stats(stats);
+    EnterCriticalSection(&(pwt_globals.free_lists_cs));
+    add_free_list_stats(stats, &(pwt_globals.free_lists_exited[kind]));
+    // the owning threads update their counts without the lock,
+    // each count is a single aligned word, read as it is at this moment
+    for (PWTFreeLists *lists=pwt_globals.free_lists_head;lists;lists=lists->next) {
+        add_free_list_stats(stats, &(lists->lists[kind].stats));
+    }
+    LeaveCriticalSection(&(pwt_globals.free_lists_cs));
+#else
+    reset_free_list_stats(stats);
+    add_free_list_stats(stats, &(pwt_globals.free_lists.lists[kind].stats));
+#endif // Py_GIL_DISABLED
+}
+
+void
+pwt_free_lists_clear() {
+#ifdef Py_GIL_DISABLED
+    if (pwt_globals.free_lists_fls_index!=FLS_OUT_OF_INDEXES) {
+        // calls free_thread_free_lists() for the lists of every thread
+        FlsFree(pwt_globals.free_lists_fls_index);
+        pwt_globals.free_lists_fls_index = FLS_OUT_OF_INDEXES;
+    }
+    DeleteCriticalSection(&(pwt_globals.free_lists_cs));
+#else
+    for (int i=0;i<PWT_FREE_LIST_KINDS;i++) {
+        free_list_clear(&(pwt_globals.free_lists.lists[i]));
+    }
+#endif // Py_GIL_DISABLED
+}
@@ -0,0 +1,97 @@
+/*
+This file implements XXH64, used to find icons with the same pixels
+*/
+
+#include "pywintray.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL64(x, r) (((x)<<(r))|((x)>>(64-(r))))
+
+// little endian reads, the compiler turns them into a single load
+static inline UINT64
+xxh_read64(const BYTE *p) {
+    return ((UINT64)p[0])|((UINT64)p[1]<<8)|((UINT64)p[2]<<16)|((UINT64)p[3]<<24)|
+        ((UINT64)p[4]<<32)|((UINT64)p[5]<<40)|((UINT64)p[6]<<48)|((UINT64)p[7]<<56);
+}
+
+static inline UINT64
+xxh_read32(const BYTE *p) {
+    return ((UINT64)p[0])|((UINT64)p[1]<<8)|((UINT64)p[2]<<16)|((UINT64)p[3]<<24);
+}
+
+static inline UINT64
+xxh_round(UINT64 acc, UINT64 input) {
+    acc += input*XXH_PRIME64_2;
+    acc = XXH_ROTL64(acc, 31);
+    return acc*XXH_PRIME64_1;
+}
+
+static inline UINT64
+xxh_merge_round(UINT64 acc, UINT64 val) {
+    acc ^= xxh_round(0, val);
+    return acc*XXH_PRIME64_1+XXH_PRIME64_4;
+}
+
+UINT64
+xxh64(const void *data, Py_ssize_t len, UINT64 seed) {
+    const BYTE *p = (const BYTE *)data;
+    const BYTE *end = p+len;
+    UINT64 h;
+
+    if (len>=32) {
+        // 4 independent lanes, the loop is bound by multiply latency
+        // rather than by the dependency chain of a single accumulator
+        const BYTE *limit = end-32;
+        UINT64 v1 = seed+XXH_PRIME64_1+XXH_PRIME64_2;
+        UINT64 v2 = seed+XXH_PRIME64_2;
+        UINT64 v3 = seed;
+        UINT64 v4 = seed-XXH_PRIME64_1;
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p+8));
+            v3 = xxh_round(v3, xxh_read64(p+16));
+            v4 = xxh_round(v4, xxh_read64(p+24));
+            p += 32;
+        } while (p<=limit);
+
+        h = XXH_ROTL64(v1, 1)+XXH_ROTL64(v2, 7)+XXH_ROTL64(v3, 12)+XXH_ROTL64(v4, 18);
+        h = xxh_merge_round(h, v1);
+        h = xxh_merge_round(h, v2);
+        h = xxh_merge_round(h, v3);
+        h = xxh_merge_round(h, v4);
+    }
+    else {
+        h = seed+XXH_PRIME64_5;
+    }
+
+    h += (UINT64)len;
+
+    while (p+8<=end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = XXH_ROTL64(h, 27)*XXH_PRIME64_1+XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p+4<=end) {
+        h ^= xxh_read32(p)*XXH_PRIME64_1;
+        h = XXH_ROTL64(h, 23)*XXH_PRIME64_2+XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p<end) {
+        h ^= (*p)*XXH_PRIME64_5;
+        h = XXH_ROTL64(h, 11)*XXH_PRIME64_1;
+        p++;
+    }
+
+    // avalanche
+    h ^= h>>33;
+    h *= XXH_PRIME64_2;
+    h ^= h>>29;
+    h *= XXH_PRIME64_3;
+    h ^= h>>32;
+    return h;
+}
@@ -4,7 +4,14 @@ This file implements the pywintray.IconHandle class
 
 #include "pywintray.h"
 
+static PyObject *
+icon_handle_from_buffer(PyTypeObject *cls, PyObject *args, PyObject *kwargs);
+static PyObject *
+icon_handle_from_atlas(PyTypeObject *cls, PyObject *args, PyObject *kwargs);
+
 static PyMethodDef icon_handle_methods[] = {
+    {"from_buffer", (PyCFunction)icon_handle_from_buffer, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"from_atlas", (PyCFunction)icon_handle_from_atlas, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
     {NULL, NULL, 0, NULL}
 };
 
@@ -36,23 +43,806 @@ icon_handle_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
     return (PyObject *)new_icon_handle(icon_handle, FALSE);
 }
 
+// Caller must hold `icon_handle_cs` critical section
+static void
+registry_unlink(IconHandleObject *icon) {
+    IconHandleRegistry *registry = &(pwt_globals.icon_registry);
+    if (icon->lru_prev) {
+        icon->lru_prev->lru_next = icon->lru_next;
+    }
+    else {
+        registry->lru_head = icon->lru_next;
+    }
+    if (icon->lru_next) {
+        icon->lru_next->lru_prev = icon->lru_prev;
+    }
+    else {
+        registry->lru_tail = icon->lru_prev;
+    }
+    icon->lru_prev = NULL;
+    icon->lru_next = NULL;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static void
+registry_push_head(IconHandleObject *icon) {
+    IconHandleRegistry *registry = &(pwt_globals.icon_registry);
+    icon->lru_prev = NULL;
+    icon->lru_next = registry->lru_head;
+    if (registry->lru_head) {
+        registry->lru_head->lru_prev = icon;
+    }
+    else {
+        registry->lru_tail = icon;
+    }
+    registry->lru_head = icon;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static void
+registry_touch(IconHandleObject *icon) {
+    if (pwt_globals.icon_registry.lru_head==icon) {
+        return;
+    }
+    registry_unlink(icon);
+    registry_push_head(icon);
+}
+
+// the key of icon_intern_idm
+#define INTERN_KEY(hash) ((UINT)((hash)^((hash)>>32)))
+
+// Find an interned icon with exactly the same pixels.
+// Caller must hold `icon_handle_cs` critical section
+// Returns a borrowed reference,
+// NULL if not found or failed (check PyErr_Occurred())
+static IconHandleObject *
+intern_lookup(UINT64 hash, const BYTE *pixels, int width, int height, ResampleFilter filter) {
+    IconHandleObject *icon = idm_get_data_by_id(pwt_globals.icon_intern_idm, INTERN_KEY(hash));
+    for (;icon;icon=icon->intern_next) {
+        if (icon->content_hash!=hash || icon->pixels_width!=width ||
+            icon->pixels_height!=height || icon->filter!=filter) {
+            continue;
+        }
+        // the hash only selects the candidate, the pixels decide
+        Py_ssize_t len = (Py_ssize_t)width*height*4;
+        Py_ssize_t i = 0;
+        while (i<len && icon->pixels[i]==pixels[i]) {
+            i++;
+        }
+        if (i==len) {
+            return icon;
+        }
+    }
+    return NULL;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static BOOL
+intern_insert(IconHandleObject *icon) {
+    UINT key = INTERN_KEY(icon->content_hash);
+    IconHandleObject *head = idm_get_data_by_id(pwt_globals.icon_intern_idm, key);
+    if (!head && PyErr_Occurred()) {
+        return FALSE;
+    }
+    icon->intern_next = head;
+    if (!idm_put_id(pwt_globals.icon_intern_idm, key, icon)) {
+        icon->intern_next = NULL;
+        return FALSE;
+    }
+    icon->interned = TRUE;
+    return TRUE;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static void
+intern_remove(IconHandleObject *icon) {
+    UINT key = INTERN_KEY(icon->content_hash);
+    IconHandleObject *head = idm_get_data_by_id(pwt_globals.icon_intern_idm, key);
+    if (head==icon) {
+        BOOL result;
+        if (icon->intern_next) {
+            result = idm_put_id(pwt_globals.icon_intern_idm, key, icon->intern_next);
+        }
+        else {
+            result = idm_delete_id(pwt_globals.icon_intern_idm, key);
+        }
+        if (!result) {
+            PyErr_Print();
+        }
+    }
+    else {
+        IconHandleObject *prev = head;
+        while (prev && prev->intern_next!=icon) {
+            prev = prev->intern_next;
+        }
+        if (prev) {
+            prev->intern_next = icon->intern_next;
+        }
+    }
+    icon->intern_next = NULL;
+    icon->interned = FALSE;
+}
+
 static void
 icon_handle_dealloc(IconHandleObject *self) {
+    PWT_ENTER_ICON_HANDLE_CS();
+    if (self->interned) {
+        // Without the GIL, from_buffer() on another thread may have found
+        // the icon and taken a reference before this lock was entered.
+        // It stays interned and is freed when that reference is released.
+        if (Py_REFCNT(self)>0) {
+            PWT_LEAVE_ICON_HANDLE_CS();
+            return;
+        }
+        intern_remove(self);
+    }
+    registry_unlink(self);
+    // the scaled copies are always created by us
+    for (int i=0;i<PWT_ICON_SIZE_CACHE_LENGTH;i++) {
+        if (self->size_cache[i].icon_handle) {
+            DestroyIcon(self->size_cache[i].icon_handle);
+            pwt_globals.icon_registry.live--;
+        }
+    }
     if(self->need_free) {
-        DestroyIcon(self->icon_handle);
+        if (self->icon_handle) {
+            DestroyIcon(self->icon_handle);
+            pwt_globals.icon_registry.live--;
+        }
+        else {
+            pwt_globals.icon_registry.evicted--;
+        }
     }
-    Py_TYPE(self)->tp_free((PyObject *)self);
+    PWT_LEAVE_ICON_HANDLE_CS();
+
+    PyMem_RawFree(self->pixels);
+    PyTypeObject *tp = Py_TYPE(self);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
 }
 
 IconHandleObject *
 new_icon_handle(HICON icon_handle, BOOL need_free) {
     PyTypeObject *cls = pwt_globals.IconHandleType;
     IconHandleObject *self = (IconHandleObject *)(cls->tp_alloc(cls, 0));
+    if (!self) {
+        if (need_free) {
+            DestroyIcon(icon_handle);
+        }
+        return NULL;
+    }
     self->icon_handle = icon_handle;
     self->need_free = need_free;
+    self->width = 0;
+    for (int i=0;i<PWT_ICON_SIZE_CACHE_LENGTH;i++) {
+        self->size_cache[i].size = 0;
+        self->size_cache[i].icon_handle = NULL;
+    }
+    self->size_cache_next = 0;
+    self->pixels = NULL;
+    self->pixels_width = 0;
+    self->pixels_height = 0;
+    self->filter = RESAMPLE_FILTER_LANCZOS3;
+    self->attached = 0;
+    self->interned = FALSE;
+    self->content_hash = 0;
+    self->intern_next = NULL;
+
+    PWT_ENTER_ICON_HANDLE_CS();
+    registry_push_head(self);
+    if (need_free) {
+        pwt_globals.icon_registry.live++;
+    }
+    icon_handle_enforce_budget(self);
+    PWT_LEAVE_ICON_HANDLE_CS();
+
     return self;
 }
 
+void
+icon_handle_attach(IconHandleObject *icon) {
+    PWT_ENTER_ICON_HANDLE_CS();
+    icon->attached++;
+    PWT_LEAVE_ICON_HANDLE_CS();
+}
+
+void
+icon_handle_detach(IconHandleObject *icon) {
+    PWT_ENTER_ICON_HANDLE_CS();
+    icon->attached--;
+    PWT_LEAVE_ICON_HANDLE_CS();
+}
+
+HICON
+create_icon_from_bgra(const BYTE *pixels, int width, int height, Py_ssize_t stride) {
+    HICON result = NULL;
+    HBITMAP color = NULL;
+    HBITMAP mask = NULL;
+    BYTE *mask_bits = NULL;
+    BYTE *color_bits = NULL;
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    color = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **)&color_bits, NULL, 0);
+    if (!color) {
+        goto clean_up;
+    }
+    for (int y=0;y<height;y++) {
+        const BYTE *src_row = pixels + y*stride;
+        BYTE *dst_row = color_bits + (Py_ssize_t)y*width*4;
+        for (int x=0;x<width*4;x++) {
+            dst_row[x] = src_row[x];
+        }
+    }
+
+    // the mask is ignored for 32-bit icons with alpha,
+    // but it must exist. Rows of a monochrome bitmap are WORD aligned
+    mask_bits = PyMem_RawCalloc((Py_ssize_t)((width+15)/16)*2*height, 1);
+    if (!mask_bits) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        goto clean_up;
+    }
+    mask = CreateBitmap(width, height, 1, 1, mask_bits);
+    if (!mask) {
+        goto clean_up;
+    }
+
+    ICONINFO icon_info;
+    icon_info.fIcon = TRUE;
+    icon_info.xHotspot = 0;
+    icon_info.yHotspot = 0;
+    icon_info.hbmMask = mask;
+    icon_info.hbmColor = color;
+    result = CreateIconIndirect(&icon_info);
+
+clean_up:
+    // CreateIconIndirect copies the bitmaps
+    if (color) {
+        DeleteObject(color);
+    }
+    if (mask) {
+        DeleteObject(mask);
+    }
+    PyMem_RawFree(mask_bits);
+    return result;
+}
+
+static HICON
+create_sized_icon(IconHandleObject *icon, int size) {
+    if (!icon->pixels) {
+        // LR_COPYFROMRESOURCE picks the closest image from the resource
+        // (if the icon is loaded from a resource), so the scaled result
+        // is much better than letting the shell stretch a single bitmap
+        return CopyImage(icon->icon_handle, IMAGE_ICON, size, size, LR_COPYFROMRESOURCE);
+    }
+
+    BYTE *dst = PyMem_RawMalloc((Py_ssize_t)size*size*4);
+    if (!dst) {
+        return NULL;
+    }
+    HICON result = NULL;
+    if (resample_bgra(
+        icon->pixels, icon->pixels_width, icon->pixels_height,
+        (Py_ssize_t)icon->pixels_width*4,
+        icon->filter, 1, &size, &dst
+    )) {
+        result = create_icon_from_bgra(dst, size, size, (Py_ssize_t)size*4);
+    }
+    PyMem_RawFree(dst);
+    return result;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static void
+size_cache_put(IconHandleObject *icon, int size, HICON icon_handle) {
+    // the slot is reused in round-robin order.
+    // The shell keeps its own copy of the icon,
+    // so it is safe to destroy a copy that has been displayed.
+    IconSizeCacheEntry *entry = &(icon->size_cache[icon->size_cache_next]);
+    icon->size_cache_next = (icon->size_cache_next+1)%PWT_ICON_SIZE_CACHE_LENGTH;
+    if (entry->icon_handle) {
+        DestroyIcon(entry->icon_handle);
+        pwt_globals.icon_registry.live--;
+    }
+    entry->size = size;
+    entry->icon_handle = icon_handle;
+    pwt_globals.icon_registry.live++;
+}
+
+static int
+get_icon_width(HICON icon_handle) {
+    ICONINFO icon_info;
+    BITMAP bm;
+    if (!GetIconInfo(icon_handle, &icon_info)) {
+        return -1;
+    }
+    int result = -1;
+    HBITMAP bitmap = icon_info.hbmColor?icon_info.hbmColor:icon_info.hbmMask;
+    if (GetObject(bitmap, sizeof(BITMAP), &bm)) {
+        result = bm.bmWidth;
+    }
+    if (icon_info.hbmColor) {
+        DeleteObject(icon_info.hbmColor);
+    }
+    if (icon_info.hbmMask) {
+        DeleteObject(icon_info.hbmMask);
+    }
+    return result;
+}
+
+// Caller must hold `icon_handle_cs` critical section
+static void
+evict_icon(IconHandleObject *icon) {
+    IconHandleRegistry *registry = &(pwt_globals.icon_registry);
+
+    for (int i=0;i<PWT_ICON_SIZE_CACHE_LENGTH;i++) {
+        if (icon->size_cache[i].icon_handle) {
+            DestroyIcon(icon->size_cache[i].icon_handle);
+            icon->size_cache[i].icon_handle = NULL;
+            registry->live--;
+        }
+    }
+
+    // the original icon can only be evicted if we own it
+    // and can re-create it from the pixels.
+    // An icon loaded from a resource keeps its handle,
+    // LR_COPYFROMRESOURCE needs it to pick the other image sizes.
+    if (!icon->need_free || !icon->icon_handle || !icon->pixels) {
+        return;
+    }
+    DestroyIcon(icon->icon_handle);
+    icon->icon_handle = NULL;
+    registry->live--;
+    registry->evicted++;
+    registry->total_evictions++;
+}
+
+void
+icon_handle_enforce_budget(IconHandleObject *keep) {
+    IconHandleRegistry *registry = &(pwt_globals.icon_registry);
+    if (registry->budget<=0) {
+        return;
+    }
+    IconHandleObject *icon = registry->lru_tail;
+    while (icon && registry->live>registry->budget) {
+        if (icon!=keep && !icon->attached) {
+            evict_icon(icon);
+        }
+        icon = icon->lru_prev;
+    }
+}
+
+HICON
+icon_handle_get_sized(IconHandleObject *icon, int size) {
+    IconHandleRegistry *registry = &(pwt_globals.icon_registry);
+
+    registry_touch(icon);
+
+    if (!icon->icon_handle) {
+        // re-create the evicted icon
+        icon->icon_handle = create_icon_from_bgra(
+            icon->pixels, icon->pixels_width, icon->pixels_height,
+            (Py_ssize_t)icon->pixels_width*4
+        );
+        if (!icon->icon_handle) {
+            return NULL;
+        }
+        registry->live++;
+        registry->evicted--;
+        registry->total_rematerializations++;
+        icon_handle_enforce_budget(icon);
+    }
+
+    if (icon->width==0) {
+        icon->width = get_icon_width(icon->icon_handle);
+    }
+    if (size<=0 || icon->width==size) {
+        return icon->icon_handle;
+    }
+
+    for (int i=0;i<PWT_ICON_SIZE_CACHE_LENGTH;i++) {
+        if (icon->size_cache[i].icon_handle && icon->size_cache[i].size==size) {
+            return icon->size_cache[i].icon_handle;
+        }
+    }
+
+    HICON sized = create_sized_icon(icon, size);
+    if (!sized) {
+        // fallback to the original icon
+        return icon->icon_handle;
+    }
+    size_cache_put(icon, size, sized);
+    icon_handle_enforce_budget(icon);
+
+    return sized;
+}
+
+typedef enum {
+    CONVERT_OK,
+    CONVERT_NO_MEMORY,
+    CONVERT_WIN_ERROR,
+} ConvertResult;
+
+// Copy the master image from `src` and create the icon and its scaled copies.
+// `pixels` must have room for width*height*4 bytes,
+// `sized_pixels[i]` for sizes[i]*sizes[i]*4 bytes.
+// Does not touch python objects, can be called without GIL
+static ConvertResult
+convert_image(
+    const BYTE *src, int width, int height, Py_ssize_t stride,
+    ResampleFilter filter, int sizes_count, const int *sizes, BYTE **sized_pixels,
+    BYTE *pixels, HICON *picon, HICON *sized_icons
+) {
+    Py_ssize_t row_size = (Py_ssize_t)width*4;
+    for (int y=0;y<height;y++) {
+        const BYTE *src_row = src+y*stride;
+        BYTE *dst_row = pixels+y*row_size;
+        for (Py_ssize_t i=0;i<row_size;i++) {
+            dst_row[i] = src_row[i];
+        }
+    }
+
+    *picon = create_icon_from_bgra(pixels, width, height, row_size);
+    if (!*picon) {
+        return CONVERT_WIN_ERROR;
+    }
+    if (!sizes_count) {
+        return CONVERT_OK;
+    }
+
+    // all the sizes are generated in one call,
+    // the source is converted only once
+    if (!resample_bgra(pixels, width, height, row_size, filter, sizes_count, sizes, sized_pixels)) {
+        return CONVERT_NO_MEMORY;
+    }
+    for (int i=0;i<sizes_count;i++) {
+        sized_icons[i] = create_icon_from_bgra(
+            sized_pixels[i], sizes[i], sizes[i], (Py_ssize_t)sizes[i]*4
+        );
+        if (!sized_icons[i]) {
+            return CONVERT_WIN_ERROR;
+        }
+    }
+    return CONVERT_OK;
+}
+
+static void
+raise_convert_error(ConvertResult result) {
+    if (result==CONVERT_NO_MEMORY) {
+        PyErr_NoMemory();
+    }
+    else {
+        RAISE_LAST_ERROR();
+    }
+}
+
+// Create an IconHandle from the result of convert_image().
+// Takes the ownership of `icon_handle`, `pixels` and `sized_icons`, even on failure
+static IconHandleObject *
+wrap_converted_image(
+    HICON icon_handle, BYTE *pixels, int width, int height, ResampleFilter filter,
+    int sizes_count, const int *sizes, HICON *sized_icons
+) {
+    IconHandleObject *result = new_icon_handle(icon_handle, TRUE);
+    if (!result) {
+        for (int i=0;i<sizes_count;i++) {
+            DestroyIcon(sized_icons[i]);
+            sized_icons[i] = NULL;
+        }
+        PyMem_RawFree(pixels);
+        return NULL;
+    }
+    // keep the master image for the sizes requested later
+    result->width = width==height?width:-1;
+    result->pixels = pixels;
+    result->pixels_width = width;
+    result->pixels_height = height;
+    result->filter = filter;
+
+    PWT_ENTER_ICON_HANDLE_CS();
+    for (int i=0;i<sizes_count;i++) {
+        size_cache_put(result, sizes[i], sized_icons[i]);
+        sized_icons[i] = NULL;
+    }
+    icon_handle_enforce_budget(result);
+    PWT_LEAVE_ICON_HANDLE_CS();
+
+    return result;
+}
+
+static PyObject *
+icon_handle_from_buffer(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"buffer", "width", "height", "sizes", "filter", "intern", NULL};
+
+    Py_buffer buffer;
+    int width, height;
+    PyObject *sizes_obj = NULL;
+    PyObject *filter_obj = NULL;
+    ResampleFilter filter;
+    int *sizes = NULL;
+    int sizes_count = 0;
+    BYTE *sized_pixels[PWT_ICON_SIZE_CACHE_LENGTH] = {NULL};
+    HICON sized_icons[PWT_ICON_SIZE_CACHE_LENGTH] = {NULL};
+    BYTE *pixels = NULL;
+    HICON icon_handle = NULL;
+    IconHandleObject *result = NULL;
+    ConvertResult convert_result;
+    int intern = FALSE;
+    UINT64 hash = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*ii|OUp", kwlist,
+        &buffer, &width, &height, &sizes_obj, &filter_obj, &intern
+    )) {
+        return NULL;
+    }
+
+    if (width<=0 || height<=0 || width>PWT_IMAGE_MAX_SIZE || height>PWT_IMAGE_MAX_SIZE) {
+        PyErr_Format(PyExc_ValueError, "'width' and 'height' must in range [1, %d]", PWT_IMAGE_MAX_SIZE);
+        goto clean_up;
+    }
+    if (buffer.len!=(Py_ssize_t)width*height*4) {
+        PyErr_SetString(PyExc_ValueError, "Size of 'buffer' must be width*height*4 (BGRA)");
+        goto clean_up;
+    }
+    if (!parse_resample_filter(filter_obj, &filter)) {
+        goto clean_up;
+    }
+    if (sizes_obj && !Py_IsNone(sizes_obj)) {
+        sizes = parse_resample_sizes(sizes_obj, &sizes_count);
+        if (!sizes) {
+            goto clean_up;
+        }
+    }
+
+    if (intern) {
+        Py_BEGIN_ALLOW_THREADS
+        hash = xxh64(buffer.buf, buffer.len, ((UINT64)width<<32)|(UINT)height);
+        Py_END_ALLOW_THREADS
+
+        // the reference is taken under the lock,
+        // so the icon can't be freed in between
+        PWT_ENTER_ICON_HANDLE_CS();
+        result = intern_lookup(hash, buffer.buf, width, height, filter);
+        if (result) {
+            Py_INCREF(result);
+            pwt_globals.icon_registry.total_intern_hits++;
+            for (int i=0;i<sizes_count;i++) {
+                icon_handle_get_sized(result, sizes[i]);
+            }
+        }
+        PWT_LEAVE_ICON_HANDLE_CS();
+        if (result || PyErr_Occurred()) {
+            goto clean_up;
+        }
+    }
+
+    pixels = PyMem_RawMalloc(buffer.len);
+    if (!pixels) {
+        PyErr_NoMemory();
+        goto clean_up;
+    }
+    for (int i=0;i<sizes_count;i++) {
+        sized_pixels[i] = PyMem_RawMalloc((Py_ssize_t)sizes[i]*sizes[i]*4);
+        if (!sized_pixels[i]) {
+            PyErr_NoMemory();
+            goto clean_up;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    convert_result = convert_image(
+        buffer.buf, width, height, (Py_ssize_t)width*4,
+        filter, sizes_count, sizes, sized_pixels,
+        pixels, &icon_handle, sized_icons
+    );
+    Py_END_ALLOW_THREADS
+
+    if (convert_result!=CONVERT_OK) {
+        raise_convert_error(convert_result);
+        goto clean_up;
+    }
+
+    result = wrap_converted_image(
+        icon_handle, pixels, width, height, filter,
+        sizes_count, sizes, sized_icons
+    );
+    icon_handle = NULL;
+    pixels = NULL;
+    if (!result) {
+        goto clean_up;
+    }
+
+    if (intern) {
+        result->content_hash = hash;
+        PWT_ENTER_ICON_HANDLE_CS();
+        BOOL insert_result = intern_insert(result);
+        PWT_LEAVE_ICON_HANDLE_CS();
+        if (!insert_result) {
+            Py_CLEAR(result);
+        }
+    }
+
+clean_up:
+    if (icon_handle) {
+        DestroyIcon(icon_handle);
+    }
+    for (int i=0;i<sizes_count;i++) {
+        if (sized_icons[i]) {
+            DestroyIcon(sized_icons[i]);
+        }
+        PyMem_RawFree(sized_pixels[i]);
+    }
+    PyMem_RawFree(pixels);
+    PyMem_Free(sizes);
+    PyBuffer_Release(&buffer);
+    return (PyObject *)result;
+}
+
+static PyObject *
+icon_handle_from_atlas(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {
+        "buffer", "tile_width", "tile_height", "count", "columns", "sizes", "filter", NULL
+    };
+
+    Py_buffer buffer;
+    int tile_width, tile_height, count;
+    int columns = 0;
+    PyObject *sizes_obj = NULL;
+    PyObject *filter_obj = NULL;
+    ResampleFilter filter;
+    int *sizes = NULL;
+    int sizes_count = 0;
+    BYTE *sized_pixels[PWT_ICON_SIZE_CACHE_LENGTH] = {NULL};
+    BYTE **tile_pixels = NULL;
+    HICON *tile_icons = NULL;
+    // count*sizes_count scaled copies, grouped by tile
+    HICON *tile_sized_icons = NULL;
+    PyObject *result = NULL;
+    ConvertResult convert_result = CONVERT_OK;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*iii|iOU", kwlist,
+        &buffer, &tile_width, &tile_height, &count, &columns, &sizes_obj, &filter_obj
+    )) {
+        return NULL;
+    }
+
+    if (tile_width<=0 || tile_height<=0 || tile_width>PWT_IMAGE_MAX_SIZE || tile_height>PWT_IMAGE_MAX_SIZE) {
+        PyErr_Format(PyExc_ValueError, "'tile_width' and 'tile_height' must in range [1, %d]", PWT_IMAGE_MAX_SIZE);
+        goto clean_up;
+    }
+    if (count<=0) {
+        PyErr_SetString(PyExc_ValueError, "'count' must be > 0");
+        goto clean_up;
+    }
+    // a horizontal strip by default
+    if (columns==0) {
+        columns = count;
+    }
+    if (columns<0 || columns>count) {
+        PyErr_SetString(PyExc_ValueError, "'columns' must in range [1, count]");
+        goto clean_up;
+    }
+    int rows = (count+columns-1)/columns;
+    Py_ssize_t stride = (Py_ssize_t)tile_width*columns*4;
+    if (buffer.len!=stride*tile_height*rows) {
+        PyErr_SetString(PyExc_ValueError,
+            "Size of 'buffer' must be tile_width*columns*tile_height*rows*4 (BGRA)");
+        goto clean_up;
+    }
+    if (!parse_resample_filter(filter_obj, &filter)) {
+        goto clean_up;
+    }
+    if (sizes_obj && !Py_IsNone(sizes_obj)) {
+        sizes = parse_resample_sizes(sizes_obj, &sizes_count);
+        if (!sizes) {
+            goto clean_up;
+        }
+    }
+
+    tile_pixels = PyMem_RawMalloc(sizeof(BYTE *)*count);
+    tile_icons = PyMem_RawMalloc(sizeof(HICON)*count);
+    tile_sized_icons = PyMem_RawMalloc(sizeof(HICON)*count*sizes_count);
+    if (!tile_pixels || !tile_icons || !tile_sized_icons) {
+        PyErr_NoMemory();
+        goto clean_up;
+    }
+    for (int i=0;i<count;i++) {
+        tile_pixels[i] = NULL;
+        tile_icons[i] = NULL;
+    }
+    for (int i=0;i<count*sizes_count;i++) {
+        tile_sized_icons[i] = NULL;
+    }
+    for (int i=0;i<count;i++) {
+        tile_pixels[i] = PyMem_RawMalloc((Py_ssize_t)tile_width*tile_height*4);
+        if (!tile_pixels[i]) {
+            PyErr_NoMemory();
+            goto clean_up;
+        }
+    }
+    // the buffers of scaled pixels are reused by every tile
+    for (int i=0;i<sizes_count;i++) {
+        sized_pixels[i] = PyMem_RawMalloc((Py_ssize_t)sizes[i]*sizes[i]*4);
+        if (!sized_pixels[i]) {
+            PyErr_NoMemory();
+            goto clean_up;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (int i=0;i<count && convert_result==CONVERT_OK;i++) {
+        // tiles are read in place from the atlas
+        const BYTE *src = (const BYTE *)buffer.buf+
+            (i/columns)*tile_height*stride+
+            (Py_ssize_t)(i%columns)*tile_width*4;
+        convert_result = convert_image(
+            src, tile_width, tile_height, stride,
+            filter, sizes_count, sizes, sized_pixels,
+            tile_pixels[i], &(tile_icons[i]), tile_sized_icons+i*sizes_count
+        );
+    }
+    Py_END_ALLOW_THREADS
+
+    if (convert_result!=CONVERT_OK) {
+        raise_convert_error(convert_result);
+        goto clean_up;
+    }
+
+    result = PyList_New(count);
+    if (!result) {
+        goto clean_up;
+    }
+    for (int i=0;i<count;i++) {
+        IconHandleObject *icon = wrap_converted_image(
+            tile_icons[i], tile_pixels[i], tile_width, tile_height, filter,
+            sizes_count, sizes, tile_sized_icons+i*sizes_count
+        );
+        tile_icons[i] = NULL;
+        tile_pixels[i] = NULL;
+        if (!icon) {
+            Py_CLEAR(result);
+            goto clean_up;
+        }
+        PyList_SET_ITEM(result, i, (PyObject *)icon);
+    }
+
+clean_up:
+    if (tile_icons) {
+        for (int i=0;i<count;i++) {
+            if (tile_icons[i]) {
+                DestroyIcon(tile_icons[i]);
+            }
+        }
+    }
+    if (tile_sized_icons) {
+        for (int i=0;i<count*sizes_count;i++) {
+            if (tile_sized_icons[i]) {
+                DestroyIcon(tile_sized_icons[i]);
+            }
+        }
+    }
+    if (tile_pixels) {
+        for (int i=0;i<count;i++) {
+            PyMem_RawFree(tile_pixels[i]);
+        }
+    }
+    for (int i=0;i<sizes_count;i++) {
+        PyMem_RawFree(sized_pixels[i]);
+    }
+    PyMem_RawFree(tile_pixels);
+    PyMem_RawFree(tile_icons);
+    PyMem_RawFree(tile_sized_icons);
+    PyMem_Free(sizes);
+    PyBuffer_Release(&buffer);
+    return result;
+}
+
 PyTypeObject *
 create_icon_handle_type(PyObject *module) {
     static PyType_Spec spec;
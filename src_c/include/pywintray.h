@@ -12,6 +12,7 @@
 #pragma comment(lib, "kernel32.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "shell32.lib")
+#pragma comment(lib, "gdi32.lib")
 
 #define PWT_VERSION_DEV 1
 #define PWT_VERSION_MAJOR 0
@@ -26,10 +27,15 @@
 #define PYWINTRAY_TRAY_MESSAGE (WM_USER+20)
 #define PYWINTRAY_MENU_UPDATE_MESSAGE (WM_USER+21)
 #define PYWINTRAY_TRAY_END_LOOP (WM_USER+22)
+#define PYWINTRAY_POPUP_ASYNC_MESSAGE (WM_USER+23)
+#define PYWINTRAY_MENU_PRESYNC_MESSAGE (WM_USER+24)
 
 #define PWT_WINDOW_CLASS_NAME TEXT("PyWinTrayWindowClass")
 
-#define PYWINTRAY_MENU_OBJ_WINDOW_PROP_NAME TEXT("PyWinTrayMenuObject")
+// count of the idle popup host windows kept by each thread
+#define PWT_POPUP_HOST_POOL_SIZE 2
+// the idle popup host windows older than this (ms) are destroyed
+#define PWT_POPUP_HOST_IDLE_TIMEOUT 60000
 
 #define RAISE_WIN32_ERROR(err_code) PyErr_SetFromWindowsErr(err_code)
 #define RAISE_LAST_ERROR() RAISE_WIN32_ERROR(GetLastError())
@@ -87,16 +93,139 @@ int idm_next(IDManager *idm, Py_ssize_t *ppos, UINT *pid, void **pdata);
 
 // idm end
 
+// resample start
+
+typedef enum {
+    RESAMPLE_FILTER_BOX,
+    RESAMPLE_FILTER_LANCZOS3,
+} ResampleFilter;
+
+// Resample a straight alpha BGRA image (top-down) to every size in `sizes`.
+// `dst[i]` must have room for sizes[i]*sizes[i]*4 bytes.
+// Does not touch python objects, can be called without GIL
+BOOL resample_bgra(
+    const BYTE *src, int src_w, int src_h, Py_ssize_t src_stride,
+    ResampleFilter filter,
+    int count, const int *sizes, BYTE **dst
+);
+
+// Parse 'lanczos' or 'box', NULL means the default filter
+BOOL parse_resample_filter(PyObject *filter_obj, ResampleFilter *filter);
+// Parse a sequence of icon sizes, the result must be freed with PyMem_Free
+int *parse_resample_sizes(PyObject *sizes_obj, int *count);
+
+// resample end
+
+// hash start
+
+// XXH64 of `len` bytes.
+// Does not touch python objects, can be called without GIL
+UINT64 xxh64(const void *data, Py_ssize_t len, UINT64 seed);
+
+// hash end
+
 // IconHandle start
 
+// Max count of scaled copies kept by one IconHandle
+#define PWT_ICON_SIZE_CACHE_LENGTH 8
+
+// Max width/height of an icon
+#define PWT_ICON_MAX_SIZE 256
+// Max width/height of a source image
+#define PWT_IMAGE_MAX_SIZE 16384
+
 typedef struct {
+    int size;
+    HICON icon_handle;
+} IconSizeCacheEntry;
+
+typedef struct IconHandleObject IconHandleObject;
+
+struct IconHandleObject {
     PyObject_HEAD
+    // NULL if the icon is evicted,
+    // use icon_handle_get_sized() to get the handle.
+    // Must ONLY be accessed while holding `icon_handle_cs`
     HICON icon_handle;
     BOOL need_free;
-} IconHandleObject;
+
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    // width of icon_handle, 0 if not queried yet, -1 if unknown
+    int width;
+    // Scaled copies of icon_handle, created on first request.
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    IconSizeCacheEntry size_cache[PWT_ICON_SIZE_CACHE_LENGTH];
+    UINT size_cache_next;
+
+    // The master image (straight alpha BGRA, top-down),
+    // NULL if the icon is not created from pixels.
+    // Scaled copies are resampled from it instead of CopyImage
+    BYTE *pixels;
+    int pixels_width;
+    int pixels_height;
+    ResampleFilter filter;
+
+    // count of TrayIcons using this icon, attached icons are never evicted
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    Py_ssize_t attached;
+    // links of the LRU list in IconHandleRegistry
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    IconHandleObject *lru_prev;
+    IconHandleObject *lru_next;
+
+    // TRUE if the icon is in the intern table (see icon_intern_idm),
+    // the icons with the same folded hash are chained by intern_next
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    BOOL interned;
+    UINT64 content_hash;
+    IconHandleObject *intern_next;
+};
+
+// Windows limits the count of GDI/USER objects per process,
+// the registry keeps the count of HICONs owned by pywintray under a budget
+// by evicting the least recently used idle icons to pixels.
+// Only the icons created from pixels and the scaled copies can be evicted,
+// the icons loaded from files or resources keep their handles
+// (they are reported as unevictable by get_icon_handle_stats()).
+typedef struct {
+    // count of the HICONs owned by pywintray (including scaled copies)
+    Py_ssize_t live;
+    // 0 means no limit
+    Py_ssize_t budget;
+    // count of the IconHandles whose HICON is evicted
+    Py_ssize_t evicted;
+    Py_ssize_t total_evictions;
+    Py_ssize_t total_rematerializations;
+    Py_ssize_t total_intern_hits;
+    // most recently used
+    IconHandleObject *lru_head;
+    // least recently used
+    IconHandleObject *lru_tail;
+} IconHandleRegistry;
 
 IconHandleObject *new_icon_handle(HICON icon_handle, BOOL need_free);
 
+// Mark the icon as used by a TrayIcon
+void icon_handle_attach(IconHandleObject *icon);
+void icon_handle_detach(IconHandleObject *icon);
+
+// Evict idle icons until the budget is met.
+// Caller must hold `icon_handle_cs` critical section
+void icon_handle_enforce_budget(IconHandleObject *keep);
+
+// Create an icon from straight alpha BGRA pixels (top-down).
+// Does not touch python objects, can be called without GIL
+HICON create_icon_from_bgra(const BYTE *pixels, int width, int height, Py_ssize_t stride);
+
+// Get a copy of the icon scaled to size*size,
+// size<=0 means the original icon.
+// The returned handle is owned by the IconHandle
+// and is valid until `icon_handle_cs` is released.
+// Returns NULL (without python exception) if an evicted icon
+// can't be re-created, call GetLastError() for the reason.
+// Caller must hold `icon_handle_cs` critical section
+HICON icon_handle_get_sized(IconHandleObject *icon, int size);
+
 // IconHandle end
 
 // TrayIcon start
@@ -140,21 +269,139 @@ BOOL update_tray_icon(TrayIconObject* tray_icon, DWORD message, UINT flags, void
 
 // Menu start
 
-typedef struct {
+typedef struct MenuItemObject MenuItemObject;
+
+typedef struct MenuTypeObject {
     // header
     PyHeapTypeObject heap_type;
 
     PyObject *items_list;
+    // The tuple returned by Menu.as_tuple(), NULL after the items change.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    PyObject *items_tuple;
+    // Added to the index in items_list to get MenuItemLink.position.
+    // Moving it renumbers every link at once, so only the shorter side
+    // of an insert or remove is renumbered.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    Py_ssize_t position_base;
     HMENU handle;
     HWND parent_window;
     HANDLE popup_event;
 
     // Must ONLY be accessed via PWT_MENU_SET/RESET_ATOMIC() macros
     volatile LONG atomic_popup_running;
+    // The list of the menus being popped up (see pwt_globals.active_menus)
+    // Must ONLY be accessed while holding `active_menus_cs`
+    struct MenuTypeObject *active_prev;
+    struct MenuTypeObject *active_next;
+    // TRUE if a PYWINTRAY_MENU_UPDATE_MESSAGE is posted and not handled yet,
+    // so one message wakes the popup for any count of changes.
+    // Must ONLY be accessed via PWT_MENU_SET/RESET_ATOMIC() macros
+    volatile LONG atomic_update_posted;
+    // count of the handled PYWINTRAY_MENU_UPDATE_MESSAGE (for tests)
+    Py_ssize_t update_message_count;
+
+    // The items whose HMENU entries may be out of date (borrowed references).
+    // An item may appear more than once.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    MenuItemObject **dirty_items;
+    Py_ssize_t dirty_count;
+    Py_ssize_t dirty_capacity;
+    // TRUE if a change could not be recorded in dirty_items,
+    // every item will be written on the next sync.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    BOOL needs_full_sync;
+
+    // The submenu items whose `sub` is this menu (borrowed references).
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    MenuItemObject **parent_items;
+    Py_ssize_t parent_count;
+    Py_ssize_t parent_capacity;
+    // equal to pwt_globals.menu_visit_epoch if visited by the current walk
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    ULONG_PTR visit_epoch;
+    // equal to pwt_globals.menu_sync_generation if synced by the current pass,
+    // so a submenu shared by several parents is synced once per pass
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    ULONG_PTR synced_generation;
+    // count of the sync passes that reached this menu (for tests)
+    Py_ssize_t sync_count;
+
+    // Called with the menu to produce its items when it's opened,
+    // NULL for the menus with fixed items.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    PyObject *provider;
+    // TRUE if the items of the provider are cached in items_list
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    BOOL populated;
+
+    // The sequence shown page by page, NULL for the menus that aren't paged.
+    // Only one page of items is in the menu at a time.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    PyObject *page_source;
+    PyObject *page_callback;
+    Py_ssize_t page_size;
+    Py_ssize_t page_start;
+    // The string items of the page, created when first needed
+    // and reused on page change.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    PyObject *page_pool;
+    PyObject *page_prev_item;
+    PyObject *page_next_item;
+
+    // The trigram index over the labels of the items,
+    // built by the first Menu.filtered() and kept up to date with the items,
+    // NULL if not built.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    struct SearchIndex *search_index;
+    // The menu returned by Menu.filtered(), reused by every query
+    struct MenuTypeObject *filtered_view;
+
+    // The list of the menus written by the tray thread when changed
+    // (see pwt_globals.presync_menus), NULL if not linked.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    BOOL presync;
+    struct MenuTypeObject *presync_prev;
+    struct MenuTypeObject *presync_next;
+    // count of the presync passes of the tray thread (for tests)
+    Py_ssize_t presync_count;
 } MenuTypeObject;
 
 BOOL menu_subtype_check(PyObject *arg);
 
+// Record that the item has changed,
+// the menus containing it (and their parent menus) are marked dirty.
+// Returns FALSE if all of them are already dirty.
+// Caller must hold `menu_insert_delete_cs` critical section
+BOOL menu_item_mark_dirty(MenuItemObject *item);
+
+// Update the search indexes of the menus containing the item
+// after its label is changed from `old_label`
+// Caller must hold `menu_insert_delete_cs` critical section
+void menu_update_search_index(MenuItemObject *item, PyObject *old_label);
+
+// Register/unregister a submenu item of `sub`
+// Caller must hold `menu_insert_delete_cs` critical section
+BOOL menu_add_parent_item(MenuTypeObject *sub, MenuItemObject *item);
+void menu_remove_parent_item(MenuTypeObject *sub, MenuItemObject *item);
+
+// Ask the tray thread to write the changes of the presync menus,
+// does nothing if no menu has presync enabled or the tray loop isn't running
+void post_presync_message();
+// Write the changes of the presync menus, called by the tray window proc
+void handle_presync_message();
+
+// The object returned by Menu.batch()
+typedef struct {
+    PyObject_HEAD
+    MenuTypeObject *menu;
+    // recorded operations, applied on __exit__
+    PyObject *ops;
+} MenuBatchObject;
+
+// Make sure `*parray` has room for `count` elements
+BOOL pwt_array_reserve(void **parray, Py_ssize_t *pcapacity, Py_ssize_t count, size_t item_size);
+
 // Menu end
 
 // MenuItem start
@@ -167,21 +414,127 @@ typedef enum {
     MENU_ITEM_TYPE_SUBMENU,
 } MenuItemTypeEnum;
 
+// One placement of a MenuItem in a menu,
+// an item placed twice in a menu has two links
 typedef struct {
+    MenuTypeObject *menu;
+    // index of the placement in menu->items_list plus menu->position_base,
+    // use MENU_ITEM_LINK_INDEX() to get the index
+    Py_ssize_t position;
+    // update_counter of the item when its HMENU entry was last written
+    ULONG_PTR synced_counter;
+    // TRUE if the item is in menu->dirty_items for this placement
+    BOOL dirty;
+} MenuItemLink;
+
+// Caller must hold `menu_insert_delete_cs` critical section
+#define MENU_ITEM_LINK_INDEX(link) ((link)->position-(link)->menu->position_base)
+
+// The UTF-16 copy of a label written to the HMENU,
+// shared by all the items with the same label.
+// The labels with the same folded hash are chained by intern_next.
+// Must ONLY be accessed while holding `menu_insert_delete_cs`
+typedef struct WideLabel {
+    struct WideLabel *intern_next;
+    Py_ssize_t refcount;
+    UINT64 hash;
+    // count of WCHAR, excluding the null terminator
+    Py_ssize_t length;
+    WCHAR text[1];
+} WideLabel;
+
+struct MenuItemObject {
     PyObject_HEAD
+    // The fields read by the sync loops come first and are packed,
+    // the type and the flags share the word after the id.
     UINT id;
-    MenuItemTypeEnum type;
+    // a MenuItemTypeEnum
+    unsigned int type : 3;
+    unsigned int enabled : 1;
+    unsigned int checked : 1;
+    unsigned int radio : 1;
     ULONG_PTR update_counter;
+    MenuTypeObject*sub;
+
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    MenuItemLink *links;
+    Py_ssize_t links_count;
+    Py_ssize_t links_capacity;
+
+    // NULL until the label is written to an HMENU,
+    // released when the label is changed.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    WideLabel *wide_label;
+
     PyObject *string;
-    BOOL enabled;
     PyObject *callback;
-    BOOL checked;
-    BOOL radio;
-    MenuTypeObject*sub;
-} MenuItemObject;
+    // the radio group of a check item, NULL if not grouped
+    struct RadioGroupObject *group;
+};
+
+// Create a MenuItem from C, `label` and `callback` can be NULL
+MenuItemObject *menu_item_create(
+    MenuItemTypeEnum type, PyObject *label, BOOL enabled,
+    PyObject *callback, BOOL checked, BOOL radio
+);
+
+// Set the submenu of a submenu item, like the submenu decorator
+BOOL menu_item_attach_submenu(MenuItemObject *item, MenuTypeObject *sub);
+
+// Get the UTF-16 label of the item, converted on the first use.
+// Returns NULL if failed
+// Caller must hold `menu_insert_delete_cs` critical section
+const WCHAR *menu_item_get_wide_label(MenuItemObject *item);
+
+// Wake the active popups and the tray thread to write the dirty items
+void post_update_message();
 
 // MenuItem end
 
+// RadioGroup start
+
+typedef struct RadioGroupObject {
+    PyObject_HEAD
+    // The checked item (borrowed reference), NULL if none is checked.
+    // The items reference the group, an item clears this when deallocated.
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    MenuItemObject *selected;
+} RadioGroupObject;
+
+// Check `item` and uncheck the previously selected item of the group,
+// `item` is NULL to uncheck all. Only the two items are updated.
+void radio_group_select(RadioGroupObject *group, MenuItemObject *item);
+
+// RadioGroup end
+
+// SearchIndex start
+
+// The items containing each trigram of the case-folded labels,
+// an item is added once per placement and per occurrence of the trigram.
+// Must ONLY be accessed while holding `menu_insert_delete_cs`
+typedef struct SearchIndex SearchIndex;
+
+SearchIndex *search_index_new();
+void search_index_free(SearchIndex *index);
+
+BOOL search_index_add(SearchIndex *index, MenuItemObject *item, PyObject *label);
+// Returns FALSE if the index can't be updated, it must be dropped then
+BOOL search_index_remove(SearchIndex *index, MenuItemObject *item, PyObject *label);
+
+// Get the items that may contain `query` (borrowed array) in *pitems.
+// Sets *pcount to -1 if the query is too short to use the index,
+// then every item has to be checked.
+// Returns FALSE with an exception set on failure
+BOOL search_index_candidates(
+    SearchIndex *index, PyObject *query,
+    MenuItemObject ***pitems, Py_ssize_t *pcount
+);
+
+// Check if `label` contains `query`, ignoring case
+BOOL search_label_matches(PyObject *label, PyObject *query);
+
+// SearchIndex end
+
 // _test_api start
 
 PyObject *create_test_api();
@@ -189,15 +542,72 @@ PyObject *_idm_get_internal_dict(IDManager *idm);
 
 // _test_api end
 
+// free list start
+
+#define PWT_FREE_LIST_CAPACITY 256
+
+typedef enum {
+    PWT_FREE_LIST_MENU_ITEM,
+    PWT_FREE_LIST_TRAY_ICON,
+    PWT_FREE_LIST_KINDS
+} PWTFreeListKind;
+
+typedef struct {
+    // objects kept in the list, and the sum of their tp_basicsize
+    Py_ssize_t retained;
+    Py_ssize_t retained_bytes;
+    // allocations served by the list, and by tp_alloc
+    Py_ssize_t hits;
+    Py_ssize_t misses;
+} PWTFreeListStats;
+
+// The released objects of a type kept for reuse
+typedef struct {
+    PyObject *objects[PWT_FREE_LIST_CAPACITY];
+    PWTFreeListStats stats;
+} PWTFreeList;
+
+// One free list of each kind.
+// With the GIL there is a single set in pwt_globals, protected by the GIL.
+// In free-threaded builds every thread has its own set in an FLS slot,
+// only touched by that thread.
+typedef struct PWTFreeLists {
+    PWTFreeList lists[PWT_FREE_LIST_KINDS];
+#ifdef Py_GIL_DISABLED
+    // links of the sets of all the threads,
+    // Must ONLY be accessed while holding `free_lists_cs`
+    struct PWTFreeLists *prev;
+    struct PWTFreeLists *next;
+#endif // Py_GIL_DISABLED
+} PWTFreeLists;
+
+// Set up the free lists, raises and returns FALSE on failure
+BOOL pwt_free_lists_init();
+// Take a zeroed object of `type` from the free list or allocate one
+PyObject *pwt_free_list_alloc(PWTFreeListKind kind, PyTypeObject *type);
+// Keep the object in the free list or free it,
+// releases the reference to its type like tp_dealloc must
+void pwt_free_list_free(PWTFreeListKind kind, PyObject *obj);
+// Sum of the stats of the lists of `kind` of all the threads
+void pwt_free_list_stats(PWTFreeListKind kind, PWTFreeListStats *stats);
+// Free the lists and the objects kept in them
+void pwt_free_lists_clear();
+
+// free list end
+
 // globals start
 
 typedef struct {
     IDManager *tray_icon_idm;
     IDManager *menu_item_idm;
-    IDManager *active_menus_idm; // id:hwnd value:menu
+    IDManager *icon_intern_idm; // id:folded pixel hash value:IconHandle chain
+    IDManager *label_intern_idm; // id:folded label hash value:WideLabel chain
     
     CRITICAL_SECTION tray_window_cs;
     HWND tray_window;
+    // SM_CXSMICON when the icons were last sent to the shell
+    // Must ONLY be accessed while holding `tray_window_cs`
+    int tray_icon_size;
     HANDLE tray_loop_ready_event;
     // Must ONLY be accessed via PWT_MENU_SET/RESET_ATOMIC() macros
     volatile LONG atomic_tray_loop_started;
@@ -205,11 +615,67 @@ typedef struct {
     // any operation that uses the index of menu item
     // must hold this critical section
     CRITICAL_SECTION menu_insert_delete_cs;
+    // increased by each walk over the menu hierarchy
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    ULONG_PTR menu_visit_epoch;
+    // increased by each sync pass over the menu hierarchy
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    ULONG_PTR menu_sync_generation;
+
+    // any operation that accesses the list of active menus
+    // must hold this critical section
+    CRITICAL_SECTION active_menus_cs;
+    // The first menu being popped up, chained by active_next
+    // Must ONLY be accessed while holding `active_menus_cs`
+    MenuTypeObject *active_menus;
+
+    // The first menu with presync enabled, chained by presync_next
+    // Must ONLY be accessed while holding `menu_insert_delete_cs`
+    MenuTypeObject *presync_menus;
+    // TRUE if a PYWINTRAY_MENU_PRESYNC_MESSAGE is posted and not handled yet
+    // Must ONLY be accessed via PWT_MENU_SET/RESET_ATOMIC() macros
+    volatile LONG atomic_presync_posted;
+
+    // FLS index of the idle popup host windows of each thread
+    DWORD popup_host_fls_index;
+
+    // The thread running the popups of Menu.popup_async(),
+    // started by the first call.
+    // Starting the thread must hold this critical section,
+    // taken without holding the GIL.
+    CRITICAL_SECTION popup_thread_cs;
+    // Must ONLY be accessed while holding `popup_thread_cs`
+    BOOL popup_thread_started;
+    // set when popup_thread_id is valid
+    HANDLE popup_thread_ready_event;
+    DWORD popup_thread_id;
+
+    // any operation that accesses the size cache of IconHandle
+    // or the intern table (icon_intern_idm) must hold this critical section
+    CRITICAL_SECTION icon_handle_cs;
+    // Must ONLY be accessed while holding `icon_handle_cs`
+    IconHandleRegistry icon_registry;
 
     PyTypeObject *IconHandleType;
     PyTypeObject *TrayIconType;
     PyTypeObject *MenuItemType;
     MenuTypeObject *MenuType;
+    PyTypeObject *MenuBatchType;
+    PyTypeObject *RadioGroupType;
+
+#ifdef Py_GIL_DISABLED
+    // FLS index of the free lists of each thread
+    DWORD free_lists_fls_index;
+    // any operation that accesses `free_lists_head` or `free_lists_exited`
+    // must hold this critical section
+    CRITICAL_SECTION free_lists_cs;
+    // the free lists of all the threads
+    PWTFreeLists *free_lists_head;
+    // hits and misses of the threads that exited
+    PWTFreeListStats free_lists_exited[PWT_FREE_LIST_KINDS];
+#else
+    PWTFreeLists free_lists;
+#endif // Py_GIL_DISABLED
 
 } PWTGlobals;
 
@@ -221,6 +687,12 @@ extern PWTGlobals pwt_globals;
 #define PWT_ENTER_MENU_INSERT_DELETE_CS() (EnterCriticalSection(&(pwt_globals.menu_insert_delete_cs)))
 #define PWT_LEAVE_MENU_INSERT_DELETE_CS() (LeaveCriticalSection(&(pwt_globals.menu_insert_delete_cs)))
 
+#define PWT_ENTER_ACTIVE_MENUS_CS() (EnterCriticalSection(&(pwt_globals.active_menus_cs)))
+#define PWT_LEAVE_ACTIVE_MENUS_CS() (LeaveCriticalSection(&(pwt_globals.active_menus_cs)))
+
+#define PWT_ENTER_ICON_HANDLE_CS() (EnterCriticalSection(&(pwt_globals.icon_handle_cs)))
+#define PWT_LEAVE_ICON_HANDLE_CS() (LeaveCriticalSection(&(pwt_globals.icon_handle_cs)))
+
 // Caller must hold `tray_window_cs` critical section
 #define PWT_TRAY_WINDOW_AVAILABLE() (!(!(pwt_globals.tray_window)))
 
@@ -234,6 +706,10 @@ PyTypeObject *create_icon_handle_type(PyObject *module);
 PyTypeObject *create_tray_icon_type(PyObject *module);
 PyTypeObject *create_menu_item_type(PyObject *module);
 MenuTypeObject *create_menu_type(PyObject *module);
+// Destroys the idle popup host windows of a thread (FLS callback)
+void WINAPI free_popup_host_pool(void *pool);
+PyTypeObject *create_menu_batch_type(PyObject *module);
+PyTypeObject *create_radio_group_type(PyObject *module);
 
 // globals end
 
@@ -9,44 +9,48 @@ static BOOL
 update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert);
 // Caller must hold `menu_insert_delete_cs` critical section
 static BOOL
-update_all_items_in_menu(MenuTypeObject *menu, BOOL insert);
+insert_item_to_menu(MenuTypeObject *menu, UINT pos, MenuItemObject *menu_item);
 // Caller must hold `menu_insert_delete_cs` critical section
 static BOOL
-update_target_item_in_menu(MenuTypeObject *menu, MenuItemObject *target_item);
+remove_item_from_menu(MenuTypeObject *menu, UINT pos);
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+sync_dirty_items(MenuTypeObject *menu);
+
+static BOOL
+sync_menu_tree(MenuTypeObject *menu);
+// Caller must NOT hold `menu_insert_delete_cs` critical section
+static BOOL
+populate_menu(MenuTypeObject *menu);
+static BOOL
+is_page_navigation_id(UINT menu_item_id);
 
+BOOL
+pwt_array_reserve(void **parray, Py_ssize_t *pcapacity, Py_ssize_t count, size_t item_size) {
+    if (count<=*pcapacity) {
+        return TRUE;
+    }
+    Py_ssize_t new_capacity = *pcapacity?*pcapacity*2:4;
+    while (new_capacity<count) {
+        new_capacity *= 2;
+    }
+    void *new_array = PyMem_RawRealloc(*parray, new_capacity*item_size);
+    if (!new_array) {
+        return FALSE;
+    }
+    *parray = new_array;
+    *pcapacity = new_capacity;
+    return TRUE;
+}
 
 static BOOL
 update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert) {
-    WCHAR *string = NULL;
+    const WCHAR *string = NULL;
     BOOL result;
     MENUITEMINFO info;
 
-    // if in update mode, check the update counter
-    // to ensure if the menu item needs update
-    // (except the submenu, which always need update)
-    if (!insert && menu_item->type!=MENU_ITEM_TYPE_SUBMENU) {
-        info.cbSize = sizeof(MENUITEMINFO);
-        info.fMask = MIIM_DATA|MIIM_ID;
-        if (!GetMenuItemInfo(menu, pos, TRUE, &info)) {
-            RAISE_LAST_ERROR();
-            return FALSE;
-        }
-        if (info.wID!=menu_item->id) {
-            PyErr_SetString(PyExc_SystemError, "Menu item id doesn't match");
-            return FALSE;
-        }
-        if (info.dwItemData==menu_item->update_counter) {
-            // the item is already up to date, return
-            return TRUE;
-        }
-    }
-
     HMENU submenu_handle = NULL;
     if (menu_item->type==MENU_ITEM_TYPE_SUBMENU) {
-        // update submenu items
-        if (!update_all_items_in_menu(menu_item->sub, FALSE)) {
-            return FALSE;
-        }
         submenu_handle = menu_item->sub->handle;
         if(!submenu_handle) {
             PyErr_SetString(PyExc_SystemError, "Invalid submenu handle");
@@ -55,14 +59,15 @@ update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert) {
     }
 
     if (menu_item->type!=MENU_ITEM_TYPE_SEPARATOR) {
-        string = PyUnicode_AsWideCharString(menu_item->string, NULL);
+        // the label is converted once and kept until it's changed
+        string = menu_item_get_wide_label(menu_item);
         if(!string) {
             return FALSE;
         }
     }
 
     info.cbSize = sizeof(MENUITEMINFO);
-    info.fMask = MIIM_FTYPE|MIIM_ID|MIIM_STATE|MIIM_DATA;
+    info.fMask = MIIM_FTYPE|MIIM_ID|MIIM_STATE;
     info.fType = MFT_STRING;
     info.fState = 0;
     info.dwTypeData = NULL;
@@ -97,12 +102,10 @@ update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert) {
 
     if (string) {
         info.fMask|=MIIM_STRING;
-        info.dwTypeData = string;
+        // not modified by InsertMenuItem or SetMenuItemInfo
+        info.dwTypeData = (LPWSTR)string;
     }
 
-    // Use dwItemData to store the update counter
-    info.dwItemData = (ULONG_PTR)menu_item->update_counter;
-
     if (insert) {
         result = InsertMenuItem(menu, pos, TRUE, &info);
     }
@@ -110,11 +113,6 @@ update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert) {
         result = SetMenuItemInfo(menu, pos, TRUE, &info);
     }
 
-    if (string) {
-        PyMem_Free(string);
-        string=NULL;
-    }
-
     if(!result) {
         RAISE_LAST_ERROR();
         return FALSE;
@@ -123,49 +121,391 @@ update_menu_item(HMENU menu, UINT pos, MenuItemObject *menu_item, BOOL insert) {
     return TRUE;
 }
 
+// Caller must hold `menu_insert_delete_cs` critical section
 static BOOL
-update_all_items_in_menu(MenuTypeObject *menu, BOOL insert) {
-    if (insert) {
-        if (GetMenuItemCount(menu->handle)) {
-            PyErr_SetString(PyExc_SystemError, "menu has non-zero items");
+push_dirty_item(MenuTypeObject *menu, MenuItemObject *item) {
+    // propagate to the parent menus when the menu becomes dirty
+    BOOL propagate = (!menu->dirty_count) && (!menu->needs_full_sync);
+
+    if (pwt_array_reserve(
+        (void **)&(menu->dirty_items), &(menu->dirty_capacity),
+        menu->dirty_count+1, sizeof(MenuItemObject *)
+    )) {
+        menu->dirty_items[menu->dirty_count++] = item;
+    }
+    else {
+        // out of memory, fall back to writing every item
+        menu->needs_full_sync = TRUE;
+    }
+
+    return propagate;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+mark_menu_dirty(MenuTypeObject *menu) {
+    for (Py_ssize_t i=0;i<menu->parent_count;i++) {
+        menu_item_mark_dirty(menu->parent_items[i]);
+    }
+}
+
+BOOL
+menu_item_mark_dirty(MenuItemObject *item) {
+    BOOL marked = FALSE;
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        MenuItemLink *link = &(item->links[i]);
+        if (link->dirty) {
+            continue;
+        }
+        link->dirty = TRUE;
+        marked = TRUE;
+        if (push_dirty_item(link->menu, item)) {
+            mark_menu_dirty(link->menu);
+        }
+    }
+    return marked;
+}
+
+BOOL
+menu_add_parent_item(MenuTypeObject *sub, MenuItemObject *item) {
+    if (!pwt_array_reserve(
+        (void **)&(sub->parent_items), &(sub->parent_capacity),
+        sub->parent_count+1, sizeof(MenuItemObject *)
+    )) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+    sub->parent_items[sub->parent_count++] = item;
+    return TRUE;
+}
+
+void
+menu_remove_parent_item(MenuTypeObject *sub, MenuItemObject *item) {
+    for (Py_ssize_t i=0;i<sub->parent_count;i++) {
+        if (sub->parent_items[i]==item) {
+            sub->parent_items[i] = sub->parent_items[--(sub->parent_count)];
+            return;
+        }
+    }
+}
+
+// Find the link of the placement at index `pos` of items_list
+// Caller must hold `menu_insert_delete_cs` critical section
+static MenuItemLink *
+find_link(MenuItemObject *item, MenuTypeObject *menu, Py_ssize_t pos) {
+    Py_ssize_t position = pos+menu->position_base;
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        if (item->links[i].menu==menu && item->links[i].position==position) {
+            return &(item->links[i]);
+        }
+    }
+    return NULL;
+}
+
+// Add `delta` to the positions of the items in [start, end) of items_list,
+// in the given order so an item placed twice is not renumbered twice
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+shift_links(MenuTypeObject *menu, Py_ssize_t start, Py_ssize_t end, Py_ssize_t delta, BOOL from_end) {
+    for (Py_ssize_t n=0;n<end-start;n++) {
+        Py_ssize_t i = from_end?end-1-n:start+n;
+        MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+        MenuItemLink *link = find_link(item, menu, i);
+        if (link) {
+            link->position += delta;
+        }
+    }
+}
+
+// Renumber the links after an item is inserted to items_list at `pos`
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+renumber_after_insert(MenuTypeObject *menu, Py_ssize_t pos) {
+    Py_ssize_t size = PyList_GET_SIZE(menu->items_list);
+    if (pos<size-1-pos) {
+        // the items after `pos` are still numbered from their old index,
+        // moving the base renumbers them, then the items before are moved back
+        shift_links(menu, 0, pos, -1, FALSE);
+        menu->position_base--;
+        return;
+    }
+    // the items after `pos` are found by their old index
+    menu->position_base--;
+    shift_links(menu, pos+1, size, 1, TRUE);
+    menu->position_base++;
+}
+
+// Renumber the links before the item at `pos` is deleted from items_list
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+renumber_before_delete(MenuTypeObject *menu, Py_ssize_t pos) {
+    Py_ssize_t size = PyList_GET_SIZE(menu->items_list);
+    if (pos<size-1-pos) {
+        // removing near the front, as in a rolling menu
+        shift_links(menu, 0, pos, 1, TRUE);
+        menu->position_base++;
+        return;
+    }
+    shift_links(menu, pos+1, size, -1, FALSE);
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+link_menu_item(MenuItemObject *item, MenuTypeObject *menu, Py_ssize_t pos) {
+    if (!pwt_array_reserve(
+        (void **)&(item->links), &(item->links_capacity),
+        item->links_count+1, sizeof(MenuItemLink)
+    )) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+    MenuItemLink *link = &(item->links[item->links_count++]);
+    link->menu = menu;
+    link->position = pos+menu->position_base;
+    link->synced_counter = item->update_counter;
+    link->dirty = FALSE;
+    return TRUE;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+has_dirty_link(MenuItemObject *item, MenuTypeObject *menu) {
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        if (item->links[i].menu==menu && item->links[i].dirty) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+unlink_menu_item(MenuItemObject *item, MenuTypeObject *menu, Py_ssize_t pos) {
+    MenuItemLink *link = find_link(item, menu, pos);
+    if (link) {
+        *link = item->links[--(item->links_count)];
+    }
+
+    if (has_dirty_link(item, menu)) {
+        return;
+    }
+    // the item may be released after removed,
+    // remove it from the dirty list
+    Py_ssize_t j = 0;
+    for (Py_ssize_t i=0;i<menu->dirty_count;i++) {
+        if (menu->dirty_items[i]!=item) {
+            menu->dirty_items[j++] = menu->dirty_items[i];
+        }
+    }
+    menu->dirty_count = j;
+}
+
+static BOOL
+insert_item_to_menu(MenuTypeObject *menu, UINT pos, MenuItemObject *menu_item) {
+    if (menu_item->type==MENU_ITEM_TYPE_SUBMENU) {
+        // the submenu must be up to date before attached
+        if (!sync_menu_tree(menu_item->sub)) {
             return FALSE;
         }
     }
-    else {
-        if (GetMenuItemCount(menu->handle) != PyList_GET_SIZE(menu->items_list)) {
-            PyErr_SetString(PyExc_SystemError, "menu size mismatch");
+    if (!update_menu_item(menu->handle, pos, menu_item, TRUE)) {
+        return FALSE;
+    }
+    if (!link_menu_item(menu_item, menu, pos)) {
+        RemoveMenu(menu->handle, pos, MF_BYPOSITION);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL
+remove_item_from_menu(MenuTypeObject *menu, UINT pos) {
+    if (!RemoveMenu(menu->handle, pos, MF_BYPOSITION)) {
+        RAISE_LAST_ERROR();
+        return FALSE;
+    }
+    unlink_menu_item((MenuItemObject *)PyList_GET_ITEM(menu->items_list, pos), menu, pos);
+    renumber_before_delete(menu, pos);
+    return TRUE;
+}
+
+// Write the HMENU entries of `item` in `menu`.
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+sync_item_in_menu(MenuTypeObject *menu, MenuItemObject *item) {
+    if (item->type==MENU_ITEM_TYPE_SUBMENU) {
+        if (!sync_dirty_items(item->sub)) {
             return FALSE;
         }
     }
-    for(Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
-        MenuItemObject *menu_item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
-        if(!update_menu_item(menu->handle, (UINT)i, menu_item, insert)) {
+
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        MenuItemLink *link = &(item->links[i]);
+        if (link->menu!=menu) {
+            continue;
+        }
+        if (link->synced_counter==item->update_counter) {
+            continue;
+        }
+        if (!update_menu_item(menu->handle, (UINT)MENU_ITEM_LINK_INDEX(link), item, FALSE)) {
             return FALSE;
         }
+        link->synced_counter = item->update_counter;
     }
     return TRUE;
 }
 
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+clear_dirty_links(MenuItemObject *item, MenuTypeObject *menu) {
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        if (item->links[i].menu==menu) {
+            item->links[i].dirty = FALSE;
+        }
+    }
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
 static BOOL
-update_target_item_in_menu(MenuTypeObject *menu, MenuItemObject *target_item) {
-    for(Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
-        MenuItemObject *menu_item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
-        if (menu_item==target_item) {
-            if (!update_menu_item(menu->handle, (UINT)i, menu_item, FALSE)) {
-                return FALSE;
-            }            
-            continue;
+sync_dirty_items(MenuTypeObject *menu) {
+    // a shared submenu is reached once per parent,
+    // nothing can change it again during the pass
+    if (menu->synced_generation==pwt_globals.menu_sync_generation) {
+        return TRUE;
+    }
+    menu->sync_count++;
+
+    if (menu->needs_full_sync) {
+        if (GetMenuItemCount(menu->handle) != PyList_GET_SIZE(menu->items_list)) {
+            PyErr_SetString(PyExc_SystemError, "menu size mismatch");
+            return FALSE;
         }
-        if (menu_item->type==MENU_ITEM_TYPE_SUBMENU) {
-            // recursive search and update in submenu
-            if (!update_target_item_in_menu(menu_item->sub, target_item)) {
+        menu->needs_full_sync = FALSE;
+        menu->dirty_count = 0;
+        for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
+            MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+            clear_dirty_links(item, menu);
+        }
+        for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
+            MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+            if (item->type==MENU_ITEM_TYPE_SUBMENU && !sync_dirty_items(item->sub)) {
+                menu->needs_full_sync = TRUE;
+                return FALSE;
+            }
+            if (!update_menu_item(menu->handle, (UINT)i, item, FALSE)) {
+                menu->needs_full_sync = TRUE;
                 return FALSE;
             }
+            MenuItemLink *link = find_link(item, menu, i);
+            if (link) {
+                link->synced_counter = item->update_counter;
+            }
+        }
+        menu->synced_generation = pwt_globals.menu_sync_generation;
+        return TRUE;
+    }
+
+    while (menu->dirty_count) {
+        MenuItemObject *item = menu->dirty_items[--(menu->dirty_count)];
+        if (!has_dirty_link(item, menu)) {
+            // duplicated entry, already synced
+            continue;
+        }
+        clear_dirty_links(item, menu);
+        if (!sync_item_in_menu(menu, item)) {
+            // the entry is lost, sync everything next time
+            menu->needs_full_sync = TRUE;
+            return FALSE;
         }
     }
+    menu->synced_generation = pwt_globals.menu_sync_generation;
     return TRUE;
 }
 
+// Write the pending changes of `menu` and its submenus in a new pass
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+sync_menu_tree(MenuTypeObject *menu) {
+    pwt_globals.menu_sync_generation++;
+    return sync_dirty_items(menu);
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+add_presync_menu(MenuTypeObject *menu) {
+    menu->presync = TRUE;
+    menu->presync_prev = NULL;
+    menu->presync_next = pwt_globals.presync_menus;
+    if (menu->presync_next) {
+        menu->presync_next->presync_prev = menu;
+    }
+    pwt_globals.presync_menus = menu;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+remove_presync_menu(MenuTypeObject *menu) {
+    if (menu->presync_prev) {
+        menu->presync_prev->presync_next = menu->presync_next;
+    }
+    else {
+        pwt_globals.presync_menus = menu->presync_next;
+    }
+    if (menu->presync_next) {
+        menu->presync_next->presync_prev = menu->presync_prev;
+    }
+    menu->presync = FALSE;
+    menu->presync_prev = NULL;
+    menu->presync_next = NULL;
+}
+
+void
+post_presync_message() {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL has_presync = pwt_globals.presync_menus!=NULL;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    if (!has_presync) {
+        return;
+    }
+
+    // at most one message is waiting,
+    // the tray thread writes all the presync menus at once
+    LONG is_posted = PWT_SET_ATOMIC(pwt_globals.atomic_presync_posted);
+    if (is_posted) {
+        return;
+    }
+
+    BOOL posted = FALSE;
+    PWT_ENTER_TRAY_WINDOW_CS();
+    if (PWT_TRAY_WINDOW_AVAILABLE()) {
+        posted = PostMessage(pwt_globals.tray_window, PYWINTRAY_MENU_PRESYNC_MESSAGE, 0, 0);
+    }
+    PWT_LEAVE_TRAY_WINDOW_CS();
+
+    // without the tray loop the menus are written by popup()
+    if (!posted) {
+        PWT_RESET_ATOMIC(pwt_globals.atomic_presync_posted);
+    }
+}
+
+void
+handle_presync_message() {
+    // reset before draining,
+    // the changes after this point post a new message
+    PWT_RESET_ATOMIC(pwt_globals.atomic_presync_posted);
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    for (MenuTypeObject *menu=pwt_globals.presync_menus;menu;menu=menu->presync_next) {
+        menu->presync_count++;
+        if (!sync_menu_tree(menu)) {
+            PyErr_Print();
+        }
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    PyGILState_Release(gstate);
+}
+
 static int
 menu_metaclass_setattr(MenuTypeObject *self, char *attr, PyObject *value) {
     PyErr_SetString(PyExc_AttributeError, "This class doesn't support setting attribute");
@@ -195,8 +535,36 @@ menu_metaclass_dealloc(MenuTypeObject *cls) {
         // then all these above can be removed
     }
 
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    if (cls->presync) {
+        remove_presync_menu(cls);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (cls->items_list) {
+        // the items may outlive the menu, unlink them
+        PWT_ENTER_MENU_INSERT_DELETE_CS();
+        for (Py_ssize_t i=0;i<PyList_GET_SIZE(cls->items_list);i++) {
+            unlink_menu_item((MenuItemObject *)PyList_GET_ITEM(cls->items_list, i), cls, i);
+        }
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    }
+
     // free the item list
     Py_XDECREF(cls->items_list);
+    Py_XDECREF(cls->items_tuple);
+    Py_XDECREF(cls->provider);
+    Py_XDECREF(cls->page_source);
+    Py_XDECREF(cls->page_callback);
+    Py_XDECREF(cls->page_pool);
+    Py_XDECREF(cls->page_prev_item);
+    Py_XDECREF(cls->page_next_item);
+    Py_XDECREF(cls->filtered_view);
+    if (cls->search_index) {
+        search_index_free(cls->search_index);
+    }
+    PyMem_RawFree(cls->dirty_items);
+    PyMem_RawFree(cls->parent_items);
 
     // free the menu handle
     if(cls->handle) {
@@ -252,9 +620,40 @@ menu_metaclass_new(PyTypeObject *meta, PyObject *args, PyObject *kwargs) {
     }
 
     cls->items_list = NULL;
+    cls->items_tuple = NULL;
+    cls->position_base = 0;
     cls->handle = NULL;
     cls->parent_window = NULL;
     cls->popup_event = NULL;
+    cls->active_prev = NULL;
+    cls->active_next = NULL;
+    cls->dirty_items = NULL;
+    cls->dirty_count = 0;
+    cls->dirty_capacity = 0;
+    cls->needs_full_sync = FALSE;
+    cls->atomic_update_posted = FALSE;
+    cls->update_message_count = 0;
+    cls->parent_items = NULL;
+    cls->parent_count = 0;
+    cls->parent_capacity = 0;
+    cls->visit_epoch = 0;
+    cls->synced_generation = 0;
+    cls->sync_count = 0;
+    cls->search_index = NULL;
+    cls->filtered_view = NULL;
+    cls->presync = FALSE;
+    cls->presync_prev = NULL;
+    cls->presync_next = NULL;
+    cls->presync_count = 0;
+    cls->provider = NULL;
+    cls->populated = FALSE;
+    cls->page_source = NULL;
+    cls->page_callback = NULL;
+    cls->page_size = 0;
+    cls->page_start = 0;
+    cls->page_pool = NULL;
+    cls->page_prev_item = NULL;
+    cls->page_next_item = NULL;
 
     // the class should not be subtyped any more
     ((PyTypeObject *)cls)->tp_flags &= ~(Py_TPFLAGS_BASETYPE);
@@ -302,8 +701,26 @@ menu_metaclass_new(PyTypeObject *meta, PyObject *args, PyObject *kwargs) {
         goto error_clean;
     }
 
+    // find the menu by handle in WM_INITMENUPOPUP
+    MENUINFO menu_info = {0};
+    menu_info.cbSize = sizeof(MENUINFO);
+    menu_info.fMask = MIM_MENUDATA;
+    menu_info.dwMenuData = (ULONG_PTR)cls;
+    if (!SetMenuInfo(cls->handle, &menu_info)) {
+        RAISE_LAST_ERROR();
+        goto error_clean;
+    }
+
     PWT_ENTER_MENU_INSERT_DELETE_CS();
-    BOOL update_result = update_all_items_in_menu(cls, TRUE);
+    BOOL update_result = TRUE;
+    for(Py_ssize_t i=0;i<PyList_GET_SIZE(cls->items_list);i++) {
+        MenuItemObject *menu_item = (MenuItemObject *)PyList_GET_ITEM(cls->items_list, i);
+        if (!insert_item_to_menu(cls, (UINT)i, menu_item)) {
+            // the inserted items are unlinked in dealloc
+            update_result = FALSE;
+            break;
+        }
+    }
     PWT_LEAVE_MENU_INSERT_DELETE_CS();
     if(!update_result) {
         goto error_clean;
@@ -352,15 +769,26 @@ finally:
     return result;
 }
 
+// Get the menu object of a handle created by menu_metaclass_new
+static MenuTypeObject *
+menu_from_handle(HMENU handle) {
+    MENUINFO menu_info = {0};
+    menu_info.cbSize = sizeof(MENUINFO);
+    menu_info.fMask = MIM_MENUDATA;
+    if (!GetMenuInfo(handle, &menu_info)) {
+        return NULL;
+    }
+    return (MenuTypeObject *)(menu_info.dwMenuData);
+}
+
 static LRESULT CALLBACK
 popup_menu_window_proc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 
     switch (uMsg) {
         MenuTypeObject *menu;
-        MenuItemObject *item;
         case WM_ENTERMENULOOP:
         case WM_EXITMENULOOP:
-            menu = GetProp(hWnd, PYWINTRAY_MENU_OBJ_WINDOW_PROP_NAME);
+            menu = (MenuTypeObject *)GetWindowLongPtr(hWnd, GWLP_USERDATA);
             if (!menu) {
                 break;
             }
@@ -372,23 +800,42 @@ popup_menu_window_proc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
             }
             break;
         case PYWINTRAY_MENU_UPDATE_MESSAGE:
-            menu = GetProp(hWnd, PYWINTRAY_MENU_OBJ_WINDOW_PROP_NAME);
+            // an idle host window has no menu,
+            // the message may be posted before the popup ended
+            menu = (MenuTypeObject *)GetWindowLongPtr(hWnd, GWLP_USERDATA);
             if (!menu) {
                 break;
             }
-            item = (MenuItemObject *)lParam;
-            if (!item) {
-                break;
-            }
-        
+
+            // reset before draining,
+            // the changes after this point post a new message
+            PWT_RESET_ATOMIC(menu->atomic_update_posted);
+
             PyGILState_STATE gstate = PyGILState_Ensure();
+            menu->update_message_count++;
             PWT_ENTER_MENU_INSERT_DELETE_CS();
-            if (!update_target_item_in_menu(menu, item)) {
+            if (!sync_menu_tree(menu)) {
                 PyErr_Print();
             }
             PWT_LEAVE_MENU_INSERT_DELETE_CS();
             PyGILState_Release(gstate);
             break;
+        case WM_INITMENUPOPUP:
+            // the handles of the submenus are not attached to any window,
+            // so the menu is found by the data of handle
+            menu = menu_from_handle((HMENU)wParam);
+            if (!menu) {
+                break;
+            }
+
+            {
+                PyGILState_STATE gstate = PyGILState_Ensure();
+                if (!populate_menu(menu)) {
+                    PyErr_Print();
+                }
+                PyGILState_Release(gstate);
+            }
+            break;
         default:
             break;
     }
@@ -397,59 +844,182 @@ popup_menu_window_proc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
-#define CHECK_MENU_SUBTYPE(o, r) {\
-    if (!menu_subtype_check((PyObject *)(o))) { \
-        PyErr_SetString(PyExc_TypeError, "Argument 'cls' must be subtype of Menu"); \
-        return (r); \
-    } \
+// The idle popup host windows of a thread,
+// a host window is only used by the thread that created it.
+typedef struct {
+    // the thread owning the windows
+    DWORD thread_id;
+    int count;
+    HWND windows[PWT_POPUP_HOST_POOL_SIZE];
+    // GetTickCount() when the window was returned
+    DWORD returned_time[PWT_POPUP_HOST_POOL_SIZE];
+} PopupHostPool;
+
+void WINAPI
+free_popup_host_pool(void *data) {
+    PopupHostPool *pool = data;
+    if (!pool) {
+        return;
+    }
+    // FlsFree() in the module cleanup calls this for the pools of
+    // all the threads on the current thread. DestroyWindow() only works
+    // on the owning thread, the other windows are destroyed with their thread.
+    if (pool->thread_id==GetCurrentThreadId()) {
+        for (int i=0;i<pool->count;i++) {
+            DestroyWindow(pool->windows[i]);
+        }
+    }
+    PyMem_RawFree(pool);
 }
 
-static PyObject*
-menu_popup(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
-    static char *kwlist[] = {
-        "position", 
-        "allow_right_click", 
-        "horizontal_align", 
-        "vertical_align", 
-        NULL
-    };
-
-    CHECK_MENU_SUBTYPE(cls, NULL);
+// Destroy the windows that have been idle for too long,
+// the oldest windows are at the front.
+static void
+trim_popup_host_pool(PopupHostPool *pool) {
+    DWORD now = GetTickCount();
+    int trimmed = 0;
+    while (trimmed<pool->count &&
+        now-pool->returned_time[trimmed]>PWT_POPUP_HOST_IDLE_TIMEOUT) {
+        DestroyWindow(pool->windows[trimmed]);
+        trimmed++;
+    }
+    if (!trimmed) {
+        return;
+    }
+    for (int i=trimmed;i<pool->count;i++) {
+        pool->windows[i-trimmed] = pool->windows[i];
+        pool->returned_time[i-trimmed] = pool->returned_time[i];
+    }
+    pool->count -= trimmed;
+}
 
-    if (!cls->handle) {
-        PyErr_SetString(PyExc_SystemError, "Invalid menu handle");
-        return NULL;
+// Get a host window for the popup, reused if the thread has an idle one
+static HWND
+checkout_popup_host() {
+    PopupHostPool *pool = FlsGetValue(pwt_globals.popup_host_fls_index);
+    if (pool) {
+        trim_popup_host_pool(pool);
+        if (pool->count) {
+            // the latest returned one
+            return pool->windows[--(pool->count)];
+        }
     }
-    
-    PyObject *pos_obj=NULL, 
-        *h_align_obj=NULL, 
-        *v_align_obj=NULL;
-    
-    BOOL allow_right_click = FALSE;
 
-    POINT pos;
+    HWND window = CreateWindowEx(
+        0, PWT_WINDOW_CLASS_NAME, TEXT(""), WS_DISABLED, 
+        0, 0, 0, 0, NULL, NULL, pwt_dll_hinstance, NULL
+    );
+    if (!window) {
+        RAISE_LAST_ERROR();
+        return NULL;
+    }
+
+    // set window proc
+    SetLastError(0);
+    if (!SetWindowLongPtr(window, GWLP_WNDPROC, (LONG_PTR)popup_menu_window_proc)) {
+        DWORD err_code = GetLastError();
+        if (err_code) {
+            RAISE_WIN32_ERROR(err_code);
+            DestroyWindow(window);
+            return NULL;
+        }
+    }
+    return window;
+}
+
+// Keep the host window for the next popup of the thread
+static void
+return_popup_host(HWND window) {
+    SetWindowLongPtr(window, GWLP_USERDATA, 0);
+
+    PopupHostPool *pool = FlsGetValue(pwt_globals.popup_host_fls_index);
+    if (!pool) {
+        pool = PyMem_RawMalloc(sizeof(PopupHostPool));
+        if (!pool || !FlsSetValue(pwt_globals.popup_host_fls_index, pool)) {
+            PyMem_RawFree(pool);
+            DestroyWindow(window);
+            return;
+        }
+        pool->thread_id = GetCurrentThreadId();
+        pool->count = 0;
+    }
+
+    trim_popup_host_pool(pool);
+    if (pool->count>=PWT_POPUP_HOST_POOL_SIZE) {
+        DestroyWindow(window);
+        return;
+    }
+    pool->windows[pool->count] = window;
+    pool->returned_time[pool->count] = GetTickCount();
+    pool->count++;
+}
+
+// Caller must hold `active_menus_cs` critical section
+static void
+add_active_menu(MenuTypeObject *menu) {
+    menu->active_prev = NULL;
+    menu->active_next = pwt_globals.active_menus;
+    if (menu->active_next) {
+        menu->active_next->active_prev = menu;
+    }
+    pwt_globals.active_menus = menu;
+}
+
+// Caller must hold `active_menus_cs` critical section
+static void
+remove_active_menu(MenuTypeObject *menu) {
+    if (menu->active_prev) {
+        menu->active_prev->active_next = menu->active_next;
+    }
+    else {
+        pwt_globals.active_menus = menu->active_next;
+    }
+    if (menu->active_next) {
+        menu->active_next->active_prev = menu->active_prev;
+    }
+    menu->active_prev = NULL;
+    menu->active_next = NULL;
+}
+
+// Make the items of the root menu ready before it's shown
+static BOOL
+prepare_popup(MenuTypeObject *cls) {
+    if (!populate_menu(cls)) {
+        return FALSE;
+    }
+
+    // write the items changed since the last popup
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL update_result = sync_menu_tree(cls);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    return update_result;
+}
 
-    UINT flags = 0;
+#define CHECK_MENU_SUBTYPE(o, r) {\
+    if (!menu_subtype_check((PyObject *)(o))) { \
+        PyErr_SetString(PyExc_TypeError, "Argument 'cls' must be subtype of Menu"); \
+        return (r); \
+    } \
+}
 
+// Convert the arguments of Menu.popup() to the position and the flags
+static BOOL
+parse_popup_args(
+    PyObject *pos_obj, BOOL allow_right_click,
+    PyObject *h_align_obj, PyObject *v_align_obj,
+    POINT *pos, UINT *flags
+) {
     // Since there may not be message loop when Menu.popup is called,
     // and WM_COMMAND will be sent after TrackPopupMenu.
     // That means WM_COMMAND may never be received by window proc.
     // So we use TPM_RETURNCMD to receive the result.
-    flags |= TPM_RETURNCMD;
-
-    if(!PyArg_ParseTupleAndKeywords(
-        args, kwargs, "|OpUU", kwlist,
-        &pos_obj, &allow_right_click, 
-        &h_align_obj, &v_align_obj
-    )) {
-        return NULL;
-    }
+    *flags = TPM_RETURNCMD;
 
     // handle argument 'position'
     if(!pos_obj || Py_IsNone(pos_obj)) {
-        if(!GetCursorPos(&pos)) {
+        if(!GetCursorPos(pos)) {
             RAISE_LAST_ERROR();
-            return NULL;
+            return FALSE;
         }
     }
     else if (
@@ -458,288 +1028,2708 @@ menu_popup(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
         PyLong_Check(PyTuple_GET_ITEM(pos_obj, 0)) &&
         PyLong_Check(PyTuple_GET_ITEM(pos_obj, 1))
     ) {
-        pos.x = PyLong_AsLong(PyTuple_GET_ITEM(pos_obj, 0));
-        pos.y = PyLong_AsLong(PyTuple_GET_ITEM(pos_obj, 1));
+        pos->x = PyLong_AsLong(PyTuple_GET_ITEM(pos_obj, 0));
+        pos->y = PyLong_AsLong(PyTuple_GET_ITEM(pos_obj, 1));
     }
     else {
         PyErr_SetString(PyExc_TypeError, "Argument 'position' must be a tuple[int, int]");
-        return NULL;
+        return FALSE;
     }
 
     // handle argument 'allow_right_click'
     if (allow_right_click) {
-        flags |= TPM_RIGHTBUTTON;
+        *flags |= TPM_RIGHTBUTTON;
     }
 
     // handle argument 'horizontal_align'
     if (!h_align_obj || PyUnicode_EqualToUTF8(h_align_obj, "left")) {
-        flags |= TPM_LEFTALIGN;
+        *flags |= TPM_LEFTALIGN;
     }
     else if (PyUnicode_EqualToUTF8(h_align_obj, "center")) {
-        flags |= TPM_CENTERALIGN;
+        *flags |= TPM_CENTERALIGN;
     }
     else if (PyUnicode_EqualToUTF8(h_align_obj, "right")) {
-        flags |= TPM_RIGHTALIGN;
+        *flags |= TPM_RIGHTALIGN;
     }
     else {
         PyErr_SetString(PyExc_ValueError, "Value of 'horizontal_align' must in ['left', 'center', 'right']");
-        return NULL;
+        return FALSE;
     }
 
 
     // handle argument 'vertical_align'
     if (!v_align_obj || PyUnicode_EqualToUTF8(v_align_obj, "top")) {
-        flags |= TPM_TOPALIGN;
+        *flags |= TPM_TOPALIGN;
     }
     else if (PyUnicode_EqualToUTF8(v_align_obj, "center")) {
-        flags |= TPM_VCENTERALIGN;
+        *flags |= TPM_VCENTERALIGN;
     }
     else if (PyUnicode_EqualToUTF8(v_align_obj, "bottom")) {
-        flags |= TPM_BOTTOMALIGN;
+        *flags |= TPM_BOTTOMALIGN;
     }
     else {
         PyErr_SetString(PyExc_ValueError, "Value of 'vertical_align' must in ['top', 'center', 'bottom']");
-        return NULL;
+        return FALSE;
     }
 
-    // update menu item data
-    PWT_ENTER_MENU_INSERT_DELETE_CS();
-    BOOL update_result = update_all_items_in_menu(cls, FALSE);
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
-    if (!update_result) {
-        return NULL;
-    }
+    return TRUE;
+}
+
+// Show the menu and wait until it's dismissed.
+// `*selected` is set to the id of the selected item, 0 if nothing is selected.
+// The callback of the selected item is not called.
+static BOOL
+track_popup(MenuTypeObject *cls, POINT pos, UINT flags, UINT *selected) {
+    *selected = 0;
 
+    // a rejected popup must not call the provider or touch the menu
     LONG is_running = PWT_SET_ATOMIC(cls->atomic_popup_running);
     if (is_running) {
         PyErr_SetString(PyExc_RuntimeError, "popup() is already running");
-        return NULL;
+        return FALSE;
     }
 
-    HWND parent_window = CreateWindowEx(
-        0, PWT_WINDOW_CLASS_NAME, TEXT(""), WS_DISABLED, 
-        0, 0, 0, 0, NULL, NULL, pwt_dll_hinstance, NULL
-    );
-    if (!parent_window) {
-        RAISE_LAST_ERROR();
+    BOOL result = FALSE;
+    DWORD error_code = 0;
+
+    if (!prepare_popup(cls)) {
         goto clean_up_level_0;
     }
 
-    // set window proc
-    SetLastError(0);
-    if (!SetWindowLongPtr(parent_window, GWLP_WNDPROC, (LONG_PTR)popup_menu_window_proc)) {
-        DWORD err_code = GetLastError();
-        if (err_code) {
-            RAISE_WIN32_ERROR(err_code);
-            goto clean_up_level_1;
-        }
+    HWND parent_window = checkout_popup_host();
+    if (!parent_window) {
+        goto clean_up_level_0;
     }
 
-    // set window prop
-    if (!SetProp(parent_window, PYWINTRAY_MENU_OBJ_WINDOW_PROP_NAME, cls)) {
-        RAISE_LAST_ERROR();
-        goto clean_up_level_1;
-    }
-    
-    // convert hwnd to u32
-    UINT hwnd_u32 = (UINT)(intptr_t)parent_window;
-    
-    // add menu to active_menus
-    if (!idm_put_id(pwt_globals.active_menus_idm, hwnd_u32, cls)) {
-        goto clean_up_level_2;
-    }
-    
+    // the window proc finds the menu by the user data
+    SetWindowLongPtr(parent_window, GWLP_USERDATA, (LONG_PTR)cls);
+
     SetForegroundWindow(parent_window);
 
     // store parent window
     cls->parent_window = parent_window;
 
-    BOOL result;
-    // track menu
-    Py_BEGIN_ALLOW_THREADS
-    result = TrackPopupMenuEx(cls->handle, flags, pos.x, pos.y, parent_window, NULL);
-    Py_END_ALLOW_THREADS
+    // add menu to active_menus
+    PWT_ENTER_ACTIVE_MENUS_CS();
+    add_active_menu(cls);
+    PWT_LEAVE_ACTIVE_MENUS_CS();
+
+    // a message posted to the previous popup window may be lost
+    PWT_RESET_ATOMIC(cls->atomic_update_posted);
+
+    while (TRUE) {
+        // track menu
+        Py_BEGIN_ALLOW_THREADS
+        result = TrackPopupMenuEx(cls->handle, flags, pos.x, pos.y, parent_window, NULL);
+        error_code = result?0:GetLastError();
+        Py_END_ALLOW_THREADS
+
+        if (!result || !is_page_navigation_id(result)) {
+            break;
+        }
+
+        // a page of a paged menu is changed, show the menu again
+        if (!call_callback_by_id(result) || !prepare_popup(cls)) {
+            break;
+        }
+    }
+
+    PWT_ENTER_ACTIVE_MENUS_CS();
+    remove_active_menu(cls);
+    PWT_LEAVE_ACTIVE_MENUS_CS();
 
     // clear parent window
     cls->parent_window = NULL;
 
-    if (!idm_delete_id(pwt_globals.active_menus_idm, hwnd_u32)) {
-        PyErr_Print();
-    }
-    
-clean_up_level_2:
-    RemoveProp(parent_window, PYWINTRAY_MENU_OBJ_WINDOW_PROP_NAME);
-clean_up_level_1:
-    DestroyWindow(parent_window);
+    return_popup_host(parent_window);
 clean_up_level_0:
     PWT_RESET_ATOMIC(cls->atomic_popup_running);
 
     if (PyErr_Occurred()) {
-        return NULL;
+        return FALSE;
     }
 
-    if (!result) {
-        DWORD error_code = GetLastError();
-        if (error_code) {
-            RAISE_WIN32_ERROR(error_code);
-            return NULL;
-        }
-    }
-    else {
-        if(!call_callback_by_id(result)) {
-            return NULL;
-        }
+    if (!result && error_code) {
+        RAISE_WIN32_ERROR(error_code);
+        return FALSE;
     }
 
-    Py_RETURN_NONE;
+    *selected = result;
+    return TRUE;
 }
 
 static PyObject*
-menu_close(MenuTypeObject *cls, PyObject *arg) {
+menu_popup(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {
+        "position", 
+        "allow_right_click", 
+        "horizontal_align", 
+        "vertical_align", 
+        NULL
+    };
+
     CHECK_MENU_SUBTYPE(cls, NULL);
 
-    if(!cls->parent_window) {
-        Py_RETURN_NONE;
+    if (!cls->handle) {
+        PyErr_SetString(PyExc_SystemError, "Invalid menu handle");
+        return NULL;
     }
-    PostMessage(cls->parent_window, WM_CANCELMODE, 0, 0);
-    Py_RETURN_NONE;
-}
-
-static PyObject*
-menu_as_tuple(MenuTypeObject *cls, PyObject *arg) {
-    CHECK_MENU_SUBTYPE(cls, NULL);
+    
+    PyObject *pos_obj=NULL, 
+        *h_align_obj=NULL, 
+        *v_align_obj=NULL;
+    
+    BOOL allow_right_click = FALSE;
 
-    PWT_ENTER_MENU_INSERT_DELETE_CS();
-    PyObject *result = PyList_AsTuple(cls->items_list);
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    POINT pos;
 
-    return result;
-}
+    UINT flags;
 
-static BOOL
-check_submenu_circular_reference(MenuTypeObject *tail, MenuTypeObject *head) {
-    // FALSE: circular ref
-    // TRUE: no ciecular ref 
-    if (tail==head) {
-        return FALSE;
+    if(!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "|OpUU", kwlist,
+        &pos_obj, &allow_right_click, 
+        &h_align_obj, &v_align_obj
+    )) {
+        return NULL;
     }
-    for(Py_ssize_t i=0;i<PyList_GET_SIZE(head->items_list);i++) {
-        MenuItemObject *menu_item = (MenuItemObject *)PyList_GET_ITEM(head->items_list, i);
-        if (menu_item->type!=MENU_ITEM_TYPE_SUBMENU) {
-            continue;
-        }
-        if (!check_submenu_circular_reference(tail, menu_item->sub)) {
-            return FALSE;
-        }
+
+    if (!parse_popup_args(pos_obj, allow_right_click, h_align_obj, v_align_obj, &pos, &flags)) {
+        return NULL;
     }
-    return TRUE;
-}
 
-static PyObject *
-menu_insert_item(MenuTypeObject *cls, PyObject *args) {
-    CHECK_MENU_SUBTYPE(cls, NULL);
+    UINT selected;
+    if (!track_popup(cls, pos, flags, &selected)) {
+        return NULL;
+    }
 
-    PyObject *new_item;
-    Py_ssize_t index;
-    if (!PyArg_ParseTuple(args, "nO!", &index, pwt_globals.MenuItemType, &new_item)) {
+    if (selected && !call_callback_by_id(selected)) {
         return NULL;
     }
 
-    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    Py_RETURN_NONE;
+}
 
-    if (((MenuItemObject *)new_item)->type==MENU_ITEM_TYPE_SUBMENU) {
-        MenuTypeObject *head=((MenuItemObject *)new_item)->sub;
-        if (!check_submenu_circular_reference(cls, head)) {
-            PyErr_SetString(PyExc_ValueError, "Circular submenu");
-            goto error_clean;
-        }
-    }
+// A Menu.popup_async() call waiting for the popup thread
+typedef struct {
+    MenuTypeObject *menu;
+    POINT pos;
+    UINT flags;
+    PyObject *future;
+    // NULL to call the callback on the popup thread
+    PyObject *executor;
+} PopupRequest;
 
-    Py_ssize_t list_size = PyList_GET_SIZE(cls->items_list);
+static void
+free_popup_request(PopupRequest *request) {
+    Py_XDECREF(request->menu);
+    Py_XDECREF(request->future);
+    Py_XDECREF(request->executor);
+    PyMem_RawFree(request);
+}
 
-    // normalize index
-    if (index<0) {
-        index += list_size;
-    }
-    if (index<0) {
-        index=0;
+// Run on the popup thread, the future is always resolved
+static void
+run_popup_request(PopupRequest *request) {
+    PyObject *future = request->future;
+
+    // FALSE if the future is cancelled before the popup
+    PyObject *notify = PyObject_CallMethod(future, "set_running_or_notify_cancel", NULL);
+    if (!notify) {
+        PyErr_Print();
+        goto clean_up;
     }
-    if (index>=list_size) {
-        index = list_size;
+    int is_running = PyObject_IsTrue(notify);
+    Py_DECREF(notify);
+    if (is_running<=0) {
+        if (is_running<0) {
+            PyErr_Print();
+        }
+        goto clean_up;
     }
 
-    if (PyList_Insert(cls->items_list, index, new_item)<0) {
-        goto error_clean;
+    UINT selected;
+    if (!track_popup(request->menu, request->pos, request->flags, &selected)) {
+        PyObject *exc_type, *exc_value, *exc_tb;
+        PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+        PyErr_NormalizeException(&exc_type, &exc_value, &exc_tb);
+        if (exc_tb) {
+            PyException_SetTraceback(exc_value, exc_tb);
+        }
+        PyObject *set_result = PyObject_CallMethod(future, "set_exception", "O", exc_value);
+        Py_XDECREF(exc_type);
+        Py_XDECREF(exc_value);
+        Py_XDECREF(exc_tb);
+        if (!set_result) {
+            PyErr_Print();
+        }
+        Py_XDECREF(set_result);
+        goto clean_up;
+    }
+
+    MenuItemObject *item = NULL;
+    if (selected) {
+        idm_enter_critical_section(pwt_globals.menu_item_idm);
+        item = idm_get_data_by_id(pwt_globals.menu_item_idm, selected);
+        Py_XINCREF(item);
+        idm_leave_critical_section(pwt_globals.menu_item_idm);
+        if (!item && PyErr_Occurred()) {
+            PyErr_Print();
+        }
     }
 
-    if(!update_menu_item(cls->handle, (UINT)index, (MenuItemObject *)new_item, TRUE)) {
-        PySequence_DelItem(cls->items_list, index);
-        goto error_clean;
+    // the future is resolved before the callback starts
+    PyObject *set_result = PyObject_CallMethod(
+        future, "set_result", "O", item?(PyObject *)item:Py_None
+    );
+    if (!set_result) {
+        PyErr_Print();
     }
+    Py_XDECREF(set_result);
 
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
-    Py_RETURN_NONE;
+    if (item && item->callback) {
+        PyObject *callback_result;
+        if (request->executor) {
+            callback_result = PyObject_CallMethod(
+                request->executor, "submit", "OO", item->callback, item
+            );
+        }
+        else {
+            callback_result = PyObject_CallOneArg(item->callback, (PyObject *)item);
+        }
+        if (!callback_result) {
+            PyErr_Print();
+        }
+        Py_XDECREF(callback_result);
+    }
+    Py_XDECREF(item);
 
-error_clean:
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
-    return NULL;
+clean_up:
+    free_popup_request(request);
 }
 
+// The target of the popup thread,
+// runs the popups of Menu.popup_async() one by one
 static PyObject *
-menu_remove_item(MenuTypeObject *cls, PyObject *arg) {
-    CHECK_MENU_SUBTYPE(cls, NULL);
+popup_thread_main(PyObject *self, PyObject *arg) {
+    MSG msg;
 
-    if (!PyLong_Check(arg)) {
-        PyErr_SetString(PyExc_TypeError, "Argument mus be an int");
-        return NULL;
-    }
-    Py_ssize_t index = PyLong_AsSsize_t(arg);
-    if (index==-1 && PyErr_Occurred()) {
-        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    // create the message queue before PostThreadMessage is called
+    PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+    pwt_globals.popup_thread_id = GetCurrentThreadId();
+    SetEvent(pwt_globals.popup_thread_ready_event);
+    Py_END_ALLOW_THREADS
+
+    while (TRUE) {
+        BOOL get_result;
+        Py_BEGIN_ALLOW_THREADS
+        get_result = GetMessage(&msg, NULL, 0, 0);
+        Py_END_ALLOW_THREADS
+        if (get_result<=0) {
+            break;
+        }
+        if (msg.message==PYWINTRAY_POPUP_ASYNC_MESSAGE) {
+            run_popup_request((PopupRequest *)(msg.lParam));
+            continue;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+        Py_END_ALLOW_THREADS
     }
 
-    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    Py_RETURN_NONE;
+}
 
-    Py_ssize_t list_size = PyList_GET_SIZE(cls->items_list);
+static PyMethodDef popup_thread_main_method_def = {
+    .ml_name = "_popup_thread_main",
+    .ml_meth = (PyCFunction)popup_thread_main,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = NULL
+};
+
+static BOOL
+start_popup_thread() {
+    BOOL result = FALSE;
+    PyObject *target = NULL, *thread_kwargs = NULL, *thread = NULL, *start_result = NULL;
 
-    // normalize index
-    if (index<0) {
-        index += list_size;
+    PyObject *threading = PyImport_ImportModule("threading");
+    if (!threading) {
+        goto clean_up;
     }
-    if (index<0 || index>=list_size) {
-        PyErr_SetString(PyExc_IndexError, "Index out of range");
-        goto error_clean;
+    PyObject *thread_type = PyObject_GetAttrString(threading, "Thread");
+    Py_DECREF(threading);
+    if (!thread_type) {
+        goto clean_up;
     }
 
-    if (!RemoveMenu(cls->handle, (UINT)index, MF_BYPOSITION)) {
-        RAISE_LAST_ERROR();
-        goto error_clean;
+    target = PyCFunction_New(&popup_thread_main_method_def, NULL);
+    if (!target) {
+        Py_DECREF(thread_type);
+        goto clean_up;
     }
-
-    if (PySequence_DelItem(cls->items_list, index)<0) {
-        PyErr_SetString(PyExc_SystemError, "Unable to delete item from internal list");
-        goto error_clean;
+    // a daemon thread doesn't block the interpreter from exiting
+    thread_kwargs = Py_BuildValue("{s:O,s:s,s:O}",
+        "target", target, "name", "pywintray-popup", "daemon", Py_True
+    );
+    if (!thread_kwargs) {
+        Py_DECREF(thread_type);
+        goto clean_up;
     }
+    PyObject *thread_args = PyTuple_New(0);
+    if (!thread_args) {
+        Py_DECREF(thread_type);
+        goto clean_up;
+    }
+    thread = PyObject_Call(thread_type, thread_args, thread_kwargs);
+    Py_DECREF(thread_args);
+    Py_DECREF(thread_type);
+    if (!thread) {
+        goto clean_up;
+    }
+    start_result = PyObject_CallMethod(thread, "start", NULL);
+    if (!start_result) {
+        goto clean_up;
+    }
+    result = TRUE;
+
+clean_up:
+    Py_XDECREF(start_result);
+    Py_XDECREF(thread);
+    Py_XDECREF(thread_kwargs);
+    Py_XDECREF(target);
+    return result;
+}
+
+// Start the popup thread if it's not started, and wait until it's ready
+static BOOL
+ensure_popup_thread() {
+    // the other callers wait here until the thread is started or failed,
+    // the GIL is released first since starting it needs the GIL
+    Py_BEGIN_ALLOW_THREADS
+    EnterCriticalSection(&(pwt_globals.popup_thread_cs));
+    Py_END_ALLOW_THREADS
+
+    BOOL result = FALSE;
+    if (!pwt_globals.popup_thread_started) {
+        if (!start_popup_thread()) {
+            goto clean_up;
+        }
+        pwt_globals.popup_thread_started = TRUE;
+    }
+
+    DWORD wait_result;
+    Py_BEGIN_ALLOW_THREADS
+    wait_result = WaitForSingleObject(pwt_globals.popup_thread_ready_event, INFINITE);
+    Py_END_ALLOW_THREADS
+    if (wait_result==WAIT_FAILED) {
+        RAISE_LAST_ERROR();
+        goto clean_up;
+    }
+    result = TRUE;
+
+clean_up:
+    LeaveCriticalSection(&(pwt_globals.popup_thread_cs));
+    return result;
+}
+
+static PyObject*
+menu_popup_async(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {
+        "position", 
+        "allow_right_click", 
+        "horizontal_align", 
+        "vertical_align", 
+        "executor",
+        NULL
+    };
+
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    if (!cls->handle) {
+        PyErr_SetString(PyExc_SystemError, "Invalid menu handle");
+        return NULL;
+    }
+
+    PyObject *pos_obj=NULL, 
+        *h_align_obj=NULL, 
+        *v_align_obj=NULL,
+        *executor=NULL;
+    
+    BOOL allow_right_click = FALSE;
+
+    if(!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "|OpUUO", kwlist,
+        &pos_obj, &allow_right_click, 
+        &h_align_obj, &v_align_obj, &executor
+    )) {
+        return NULL;
+    }
+
+    if (executor && Py_IsNone(executor)) {
+        executor = NULL;
+    }
+
+    PopupRequest *request = PyMem_RawMalloc(sizeof(PopupRequest));
+    if (!request) {
+        return PyErr_NoMemory();
+    }
+    request->menu = NULL;
+    request->future = NULL;
+    request->executor = NULL;
+
+    if (!parse_popup_args(pos_obj, allow_right_click, h_align_obj, v_align_obj,
+        &(request->pos), &(request->flags))) {
+        goto error_clean;
+    }
+
+    request->menu = (MenuTypeObject *)Py_NewRef(cls);
+    request->executor = Py_XNewRef(executor);
+
+    PyObject *futures = PyImport_ImportModule("concurrent.futures");
+    if (!futures) {
+        goto error_clean;
+    }
+    request->future = PyObject_CallMethod(futures, "Future", NULL);
+    Py_DECREF(futures);
+    if (!request->future) {
+        goto error_clean;
+    }
+
+    if (!ensure_popup_thread()) {
+        goto error_clean;
+    }
+
+    PyObject *future = Py_NewRef(request->future);
+    if (!PostThreadMessage(pwt_globals.popup_thread_id, PYWINTRAY_POPUP_ASYNC_MESSAGE, 0, (LPARAM)request)) {
+        RAISE_LAST_ERROR();
+        Py_DECREF(future);
+        goto error_clean;
+    }
+    // the request is freed by the popup thread
 
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
-    Py_RETURN_NONE;
-
+    return future;
 error_clean:
-    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    free_popup_request(request);
     return NULL;
 }
 
+static PyObject*
+menu_close(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    if(!cls->parent_window) {
+        Py_RETURN_NONE;
+    }
+    PostMessage(cls->parent_window, WM_CANCELMODE, 0, 0);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+menu_as_tuple(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    // the snapshot is shared until the items change
+    if (!cls->items_tuple) {
+        cls->items_tuple = PyList_AsTuple(cls->items_list);
+    }
+    PyObject *result = Py_XNewRef(cls->items_tuple);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    return result;
+}
+
+// Check if `menu` is `ancestor` or placed in it at any depth.
+// Walks up through the submenu items of each menu and the menus they are in,
+// so the cost depends on the ancestors of `menu`, not the size of `ancestor`.
+// Returns -1 if failed
+// Caller must hold `menu_insert_delete_cs` critical section
+static int
+menu_has_ancestor(MenuTypeObject *menu, MenuTypeObject *ancestor) {
+    if (menu==ancestor) {
+        return 1;
+    }
+
+    // a menu reached by more than one path is visited once
+    ULONG_PTR epoch = ++(pwt_globals.menu_visit_epoch);
+
+    MenuTypeObject **stack = NULL;
+    Py_ssize_t stack_capacity = 0;
+    Py_ssize_t stack_count = 0;
+    int result = 0;
+
+    menu->visit_epoch = epoch;
+    while (menu) {
+        for (Py_ssize_t i=0;i<menu->parent_count;i++) {
+            MenuItemObject *item = menu->parent_items[i];
+            for (Py_ssize_t j=0;j<item->links_count;j++) {
+                MenuTypeObject *parent = item->links[j].menu;
+                if (parent==ancestor) {
+                    result = 1;
+                    goto clean_up;
+                }
+                if (parent->visit_epoch==epoch) {
+                    continue;
+                }
+                parent->visit_epoch = epoch;
+                if (!pwt_array_reserve(
+                    (void **)&stack, &stack_capacity,
+                    stack_count+1, sizeof(MenuTypeObject *)
+                )) {
+                    PyErr_NoMemory();
+                    result = -1;
+                    goto clean_up;
+                }
+                stack[stack_count++] = parent;
+            }
+        }
+        menu = stack_count?stack[--stack_count]:NULL;
+    }
+
+clean_up:
+    PyMem_RawFree(stack);
+    return result;
+}
+
+typedef enum {
+    MENU_OP_INSERT,
+    MENU_OP_REMOVE,
+} MenuOpType;
+
+typedef struct {
+    MenuOpType type;
+    // for insert, clamped like list.insert(),
+    // for remove, negative index counts from the end
+    Py_ssize_t index;
+    // borrowed reference, NULL for remove
+    MenuItemObject *item;
+} MenuOp;
+
+// Check if the item can be inserted to the menu
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+check_item_insertable(MenuTypeObject *cls, MenuItemObject *item) {
+    if (item->type!=MENU_ITEM_TYPE_SUBMENU) {
+        return TRUE;
+    }
+    if (!item->sub) {
+        PyErr_SetString(PyExc_ValueError, "Invalid submenu");
+        return FALSE;
+    }
+    // the submenu must not contain this menu
+    int circular = menu_has_ancestor(cls, item->sub);
+    if (circular<0) {
+        return FALSE;
+    }
+    if (circular) {
+        PyErr_SetString(PyExc_ValueError, "Circular submenu");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// The search index is dropped if it can't be updated,
+// and built again by the next query
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+drop_search_index(MenuTypeObject *menu) {
+    if (menu->search_index) {
+        search_index_free(menu->search_index);
+        menu->search_index = NULL;
+    }
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static void
+index_item_label(MenuTypeObject *menu, MenuItemObject *item) {
+    if (!menu->search_index || !item->string) {
+        return;
+    }
+    if (!search_index_add(menu->search_index, item, item->string)) {
+        PyErr_Clear();
+        drop_search_index(menu);
+    }
+}
+
+void
+menu_update_search_index(MenuItemObject *item, PyObject *old_label) {
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        MenuTypeObject *menu = item->links[i].menu;
+        if (menu->search_index) {
+            if (!search_index_remove(menu->search_index, item, old_label)) {
+                PyErr_Clear();
+                drop_search_index(menu);
+                continue;
+            }
+            index_item_label(menu, item);
+        }
+    }
+}
+
+// Insert at a normalized index
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+insert_item_locked(MenuTypeObject *cls, Py_ssize_t index, MenuItemObject *item) {
+    if (PyList_Insert(cls->items_list, index, (PyObject *)item)<0) {
+        return FALSE;
+    }
+    Py_CLEAR(cls->items_tuple);
+    renumber_after_insert(cls, index);
+
+    if(!insert_item_to_menu(cls, (UINT)index, item)) {
+        renumber_before_delete(cls, index);
+        PySequence_DelItem(cls->items_list, index);
+        return FALSE;
+    }
+    index_item_label(cls, item);
+    return TRUE;
+}
+
+// Remove at a normalized index
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+remove_item_locked(MenuTypeObject *cls, Py_ssize_t index) {
+    MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(cls->items_list, index);
+    if (!remove_item_from_menu(cls, (UINT)index)) {
+        return FALSE;
+    }
+    if (cls->search_index && item->string &&
+        !search_index_remove(cls->search_index, item, item->string)) {
+        PyErr_Clear();
+        drop_search_index(cls);
+    }
+    Py_CLEAR(cls->items_tuple);
+    if (PySequence_DelItem(cls->items_list, index)<0) {
+        PyErr_SetString(PyExc_SystemError, "Unable to delete item from internal list");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Apply the operations in order.
+// All of them are validated before the menu is touched,
+// if a win32 call fails, the applied operations are undone.
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+apply_menu_ops(MenuTypeObject *cls, MenuOp *ops, Py_ssize_t count) {
+    // the removed items, to undo the removal
+    PyObject *removed = NULL;
+    Py_ssize_t applied = 0;
+
+    // validate and normalize the indexes with the list size only
+    Py_ssize_t list_size = PyList_GET_SIZE(cls->items_list);
+    for (Py_ssize_t i=0;i<count;i++) {
+        MenuOp *op = &(ops[i]);
+        if (op->type==MENU_OP_INSERT) {
+            if (!check_item_insertable(cls, op->item)) {
+                return FALSE;
+            }
+            if (op->index<0) {
+                op->index += list_size;
+            }
+            if (op->index<0) {
+                op->index = 0;
+            }
+            if (op->index>list_size) {
+                op->index = list_size;
+            }
+            list_size++;
+        }
+        else {
+            if (op->index<0) {
+                op->index += list_size;
+            }
+            if (op->index<0 || op->index>=list_size) {
+                PyErr_SetString(PyExc_IndexError, "Index out of range");
+                return FALSE;
+            }
+            list_size--;
+        }
+    }
+
+    removed = PyList_New(count);
+    if (!removed) {
+        return FALSE;
+    }
+
+    for (;applied<count;applied++) {
+        MenuOp *op = &(ops[applied]);
+        if (op->type==MENU_OP_INSERT) {
+            if (!insert_item_locked(cls, op->index, op->item)) {
+                goto undo;
+            }
+        }
+        else {
+            PyObject *item = PyList_GET_ITEM(cls->items_list, op->index);
+            Py_INCREF(item);
+            PyList_SET_ITEM(removed, applied, item);
+            if (!remove_item_locked(cls, op->index)) {
+                goto undo;
+            }
+        }
+    }
+
+    Py_DECREF(removed);
+    return TRUE;
+
+undo:
+    {
+        PyObject *exc_type, *exc_value, *exc_tb;
+        PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+        while (applied--) {
+            MenuOp *op = &(ops[applied]);
+            BOOL result;
+            if (op->type==MENU_OP_INSERT) {
+                result = remove_item_locked(cls, op->index);
+            }
+            else {
+                result = insert_item_locked(
+                    cls, op->index, (MenuItemObject *)PyList_GET_ITEM(removed, applied)
+                );
+            }
+            if (!result) {
+                PyErr_Print();
+            }
+        }
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+    }
+    Py_DECREF(removed);
+    return FALSE;
+}
+
+// Convert an iterable of MenuItem to a list
+static PyObject *
+menu_items_from_iterable(PyObject *items) {
+    PyObject *list = PySequence_List(items);
+    if (!list) {
+        return NULL;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(list);i++) {
+        if (!PyObject_TypeCheck(PyList_GET_ITEM(list, i), pwt_globals.MenuItemType)) {
+            PyErr_SetString(PyExc_TypeError, "Items must be MenuItem");
+            Py_DECREF(list);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+static PyObject *
+menu_insert_item(MenuTypeObject *cls, PyObject *args) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    MenuOp op = {MENU_OP_INSERT, 0, NULL};
+    if (!PyArg_ParseTuple(args, "nO!", &(op.index), pwt_globals.MenuItemType, &(op.item))) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = apply_menu_ops(cls, &op, 1);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_remove_item(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    if (!PyLong_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument mus be an int");
+        return NULL;
+    }
+    MenuOp op = {MENU_OP_REMOVE, 0, NULL};
+    op.index = PyLong_AsSsize_t(arg);
+    if (op.index==-1 && PyErr_Occurred()) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = apply_menu_ops(cls, &op, 1);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 menu_append_item(MenuTypeObject *cls, PyObject *arg) {
     CHECK_MENU_SUBTYPE(cls, NULL);
 
-    PyObject *args = Py_BuildValue("(iO)", PyList_GET_SIZE(cls->items_list), arg);
-    if (!args) {
+    if (!PyObject_TypeCheck(arg, pwt_globals.MenuItemType)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a MenuItem");
         return NULL;
     }
-    PyObject *result = menu_insert_item(cls, args);
-    Py_DECREF(args);
-    return result;
+    // clamped to the end
+    MenuOp op = {MENU_OP_INSERT, PY_SSIZE_T_MAX, (MenuItemObject *)arg};
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = apply_menu_ops(cls, &op, 1);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_extend(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyObject *items = menu_items_from_iterable(arg);
+    if (!items) {
+        return NULL;
+    }
+    Py_ssize_t count = PyList_GET_SIZE(items);
+    MenuOp *ops = PyMem_New(MenuOp, count?count:1);
+    if (!ops) {
+        Py_DECREF(items);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i=0;i<count;i++) {
+        ops[i].type = MENU_OP_INSERT;
+        ops[i].index = PY_SSIZE_T_MAX;
+        ops[i].item = (MenuItemObject *)PyList_GET_ITEM(items, i);
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = apply_menu_ops(cls, ops, count);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    PyMem_Free(ops);
+    Py_DECREF(items);
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// Replace all the items of `cls` with a list of MenuItem
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+replace_items_locked(MenuTypeObject *cls, PyObject *items) {
+    Py_ssize_t count = PyList_GET_SIZE(items);
+
+    // remove from the end, no renumbering is needed
+    Py_ssize_t old_count = PyList_GET_SIZE(cls->items_list);
+    MenuOp *ops = PyMem_New(MenuOp, old_count+count+1);
+    if (!ops) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+    for (Py_ssize_t i=0;i<old_count;i++) {
+        ops[i].type = MENU_OP_REMOVE;
+        ops[i].index = old_count-1-i;
+        ops[i].item = NULL;
+    }
+    for (Py_ssize_t i=0;i<count;i++) {
+        ops[old_count+i].type = MENU_OP_INSERT;
+        ops[old_count+i].index = i;
+        ops[old_count+i].item = (MenuItemObject *)PyList_GET_ITEM(items, i);
+    }
+    BOOL result = apply_menu_ops(cls, ops, old_count+count);
+    PyMem_Free(ops);
+    return result;
+}
+
+static PyObject *
+menu_replace_items(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyObject *items = menu_items_from_iterable(arg);
+    if (!items) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = replace_items_locked(cls, items);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_DECREF(items);
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// Edits beyond this are not searched by the diff,
+// the differing range is replaced instead
+#define MENU_DIFF_MAX_EDITS 512
+
+// Compute the edit script turning `old_items` into `new_items` with
+// Myers' algorithm, items are compared by identity.
+// The ops are ordered from the end, so each index refers to the old list.
+// Returns the op count, or -1 on error.
+static Py_ssize_t
+diff_menu_items(
+    PyObject **old_items, Py_ssize_t old_count,
+    PyObject **new_items, Py_ssize_t new_count,
+    MenuOp *ops
+) {
+    // the common prefix and suffix are kept
+    Py_ssize_t prefix = 0;
+    while (prefix<old_count && prefix<new_count &&
+           old_items[prefix]==new_items[prefix]) {
+        prefix++;
+    }
+    while (old_count>prefix && new_count>prefix &&
+           old_items[old_count-1]==new_items[new_count-1]) {
+        old_count--;
+        new_count--;
+    }
+    PyObject **a = old_items+prefix, **b = new_items+prefix;
+    Py_ssize_t n = old_count-prefix, m = new_count-prefix;
+
+    // the furthest x of every diagonal k in round d is
+    // stored at trace[d*d+k+d], the rounds are kept for backtracking
+    Py_ssize_t *trace = NULL;
+    Py_ssize_t trace_capacity = 0;
+    Py_ssize_t max_edits = n+m;
+    if (max_edits>MENU_DIFF_MAX_EDITS) {
+        max_edits = MENU_DIFF_MAX_EDITS;
+    }
+    Py_ssize_t edits = -1;
+
+    for (Py_ssize_t d=0;d<=max_edits && edits<0;d++) {
+        if (!pwt_array_reserve(
+            (void **)&trace, &trace_capacity, (d+1)*(d+1), sizeof(Py_ssize_t)
+        )) {
+            PyMem_RawFree(trace);
+            PyErr_NoMemory();
+            return -1;
+        }
+        Py_ssize_t *v = trace+d*d+d;
+        Py_ssize_t *prev = d?trace+(d-1)*(d-1)+(d-1):NULL;
+        for (Py_ssize_t k=-d;k<=d;k+=2) {
+            Py_ssize_t x;
+            if (!d) {
+                x = 0;
+            }
+            else if (k==-d || (k!=d && prev[k-1]<prev[k+1])) {
+                x = prev[k+1];
+            }
+            else {
+                x = prev[k-1]+1;
+            }
+            Py_ssize_t y = x-k;
+            while (x<n && y<m && a[x]==b[y]) {
+                x++;
+                y++;
+            }
+            v[k] = x;
+            if (x>=n && y>=m) {
+                edits = d;
+                break;
+            }
+        }
+    }
+
+    Py_ssize_t count = 0;
+    if (edits<0) {
+        // too different, remove and insert the whole range
+        for (Py_ssize_t i=m-1;i>=0;i--) {
+            ops[count].type = MENU_OP_INSERT;
+            ops[count].index = prefix+n;
+            ops[count++].item = (MenuItemObject *)b[i];
+        }
+        for (Py_ssize_t i=n-1;i>=0;i--) {
+            ops[count].type = MENU_OP_REMOVE;
+            ops[count].index = prefix+i;
+            ops[count++].item = NULL;
+        }
+        PyMem_RawFree(trace);
+        return count;
+    }
+
+    // walk back from (n, m), the later edits are emitted first,
+    // so the earlier positions are not shifted
+    Py_ssize_t x = n, y = m;
+    for (Py_ssize_t d=edits;d>0;d--) {
+        Py_ssize_t *prev = trace+(d-1)*(d-1)+(d-1);
+        Py_ssize_t k = x-y;
+        BOOL insert = (k==-d || (k!=d && prev[k-1]<prev[k+1]));
+        Py_ssize_t prev_k = insert?k+1:k-1;
+        Py_ssize_t prev_x = prev[prev_k];
+        Py_ssize_t prev_y = prev_x-prev_k;
+        if (insert) {
+            ops[count].type = MENU_OP_INSERT;
+            ops[count].index = prefix+prev_x;
+            ops[count++].item = (MenuItemObject *)b[prev_y];
+        }
+        else {
+            ops[count].type = MENU_OP_REMOVE;
+            ops[count].index = prefix+prev_x;
+            ops[count++].item = NULL;
+        }
+        x = prev_x;
+        y = prev_y;
+    }
+    PyMem_RawFree(trace);
+    return count;
+}
+
+// Turn the items of `cls` into a list of MenuItem with minimal edits
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+sync_items_locked(MenuTypeObject *cls, PyObject *items) {
+    Py_ssize_t old_count = PyList_GET_SIZE(cls->items_list);
+    Py_ssize_t new_count = PyList_GET_SIZE(items);
+
+    MenuOp *ops = PyMem_New(MenuOp, old_count+new_count+1);
+    if (!ops) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+
+    // the ops borrow the new items, which are kept by `items`
+    Py_ssize_t count = diff_menu_items(
+        PySequence_Fast_ITEMS(cls->items_list), old_count,
+        PySequence_Fast_ITEMS(items), new_count, ops
+    );
+    BOOL result = count>=0 && apply_menu_ops(cls, ops, count);
+    PyMem_Free(ops);
+    return result;
+}
+
+static PyObject *
+menu_sync_to(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyObject *items = menu_items_from_iterable(arg);
+    if (!items) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = sync_items_locked(cls, items);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_DECREF(items);
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *page_item_clicked(PyObject *self, PyObject *item);
+static PyObject *page_navigate(PyObject *self, PyObject *item);
+
+static PyMethodDef page_item_clicked_method_def = {
+    .ml_name = "_page_item_clicked",
+    .ml_meth = (PyCFunction)page_item_clicked,
+    .ml_flags = METH_O,
+    .ml_doc = NULL
+};
+
+static PyMethodDef page_navigate_method_def = {
+    .ml_name = "_page_navigate",
+    .ml_meth = (PyCFunction)page_navigate,
+    .ml_flags = METH_O,
+    .ml_doc = NULL
+};
+
+static BOOL
+is_page_navigation_id(UINT menu_item_id) {
+    idm_enter_critical_section(pwt_globals.menu_item_idm);
+    MenuItemObject *menu_item = idm_get_data_by_id(pwt_globals.menu_item_idm, menu_item_id);
+    BOOL result = (
+        menu_item && menu_item->callback &&
+        PyCFunction_Check(menu_item->callback) &&
+        PyCFunction_GET_FUNCTION(menu_item->callback)==(PyCFunction)page_navigate
+    );
+    idm_leave_critical_section(pwt_globals.menu_item_idm);
+    return result;
+}
+
+// Get the paged menu that the item of a page is placed in
+// Caller must hold `menu_insert_delete_cs` critical section
+static MenuTypeObject *
+find_paged_menu(MenuItemObject *item) {
+    for (Py_ssize_t i=0;i<item->links_count;i++) {
+        if (item->links[i].menu->page_source) {
+            return item->links[i].menu;
+        }
+    }
+    return NULL;
+}
+
+static PyObject *
+page_item_clicked(PyObject *self, PyObject *item) {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    MenuTypeObject *menu = find_paged_menu((MenuItemObject *)item);
+    PyObject *callback = NULL;
+    Py_ssize_t index = -1;
+    if (menu && menu->page_callback) {
+        for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->page_pool);i++) {
+            if (PyList_GET_ITEM(menu->page_pool, i)==item) {
+                index = menu->page_start+i;
+                break;
+            }
+        }
+        if (index>=0) {
+            callback = Py_NewRef(menu->page_callback);
+        }
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (!callback) {
+        Py_RETURN_NONE;
+    }
+
+    PyObject *index_obj = PyLong_FromSsize_t(index);
+    if (!index_obj) {
+        Py_DECREF(callback);
+        return NULL;
+    }
+    PyObject *result = PyObject_CallOneArg(callback, index_obj);
+    Py_DECREF(index_obj);
+    Py_DECREF(callback);
+    return result;
+}
+
+// `self` is the direction, -1 for the previous page and 1 for the next page
+static PyObject *
+page_navigate(PyObject *self, PyObject *item) {
+    long direction = PyLong_AsLong(self);
+    if (direction==-1 && PyErr_Occurred()) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    MenuTypeObject *menu = find_paged_menu((MenuItemObject *)item);
+    if (menu) {
+        menu->page_start += direction*menu->page_size;
+        if (menu->page_start<0) {
+            menu->page_start = 0;
+        }
+        menu->populated = FALSE;
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+new_page_item(const char *label, PyMethodDef *callback_def, PyObject *callback_self) {
+    PyObject *callback = PyCFunction_New(callback_def, callback_self);
+    if (!callback) {
+        return NULL;
+    }
+    PyObject *item = PyObject_CallMethod(
+        (PyObject *)pwt_globals.MenuItemType, "string", "sOO", label, Py_True, callback
+    );
+    Py_DECREF(callback);
+    return item;
+}
+
+// Get the items of the current page,
+// the items of the pool are relabeled with the values of the page.
+// `*page_start` is moved back if the source became shorter.
+static PyObject *
+build_page_items(
+    PyObject *source, PyObject *pool, PyObject *prev_item, PyObject *next_item,
+    Py_ssize_t page_size, Py_ssize_t *page_start
+) {
+    Py_ssize_t total = PySequence_Size(source);
+    if (total<0) {
+        return NULL;
+    }
+
+    // the source may be shorter than when the page was chosen
+    if (*page_start>=total) {
+        *page_start = total?((total-1)/page_size)*page_size:0;
+    }
+
+    Py_ssize_t count = total-*page_start;
+    if (count>page_size) {
+        count = page_size;
+    }
+
+    PyObject *items = PyList_New(0);
+    if (!items) {
+        return NULL;
+    }
+
+    if (*page_start>0 && PyList_Append(items, prev_item)<0) {
+        goto error_clean;
+    }
+
+    for (Py_ssize_t i=0;i<count;i++) {
+        PyObject *value = PySequence_GetItem(source, *page_start+i);
+        if (!value) {
+            goto error_clean;
+        }
+        PyObject *label = PyObject_Str(value);
+        Py_DECREF(value);
+        if (!label) {
+            goto error_clean;
+        }
+
+        if (PyList_GET_SIZE(pool)<=i) {
+            PyObject *new_item = new_page_item("", &page_item_clicked_method_def, NULL);
+            if (!new_item || PyList_Append(pool, new_item)<0) {
+                Py_XDECREF(new_item);
+                Py_DECREF(label);
+                goto error_clean;
+            }
+            Py_DECREF(new_item);
+        }
+        PyObject *item = PyList_GET_ITEM(pool, i);
+
+        int set_result = PyObject_SetAttrString(item, "label", label);
+        Py_DECREF(label);
+        if (set_result<0 || PyList_Append(items, item)<0) {
+            goto error_clean;
+        }
+    }
+
+    if (*page_start+count<total && PyList_Append(items, next_item)<0) {
+        goto error_clean;
+    }
+
+    return items;
+error_clean:
+    Py_DECREF(items);
+    return NULL;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+is_page_item(MenuTypeObject *menu, PyObject *item) {
+    if (item==menu->page_prev_item || item==menu->page_next_item) {
+        return TRUE;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->page_pool);i++) {
+        if (PyList_GET_ITEM(menu->page_pool, i)==item) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Remove the items of the current page and the navigation items
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+remove_page_items_locked(MenuTypeObject *menu) {
+    if (!menu->page_source) {
+        return TRUE;
+    }
+    PyObject *items = PyList_New(0);
+    if (!items) {
+        return FALSE;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
+        PyObject *item = PyList_GET_ITEM(menu->items_list, i);
+        if (!is_page_item(menu, item) && PyList_Append(items, item)<0) {
+            Py_DECREF(items);
+            return FALSE;
+        }
+    }
+    BOOL result = sync_items_locked(menu, items);
+    Py_DECREF(items);
+    return result;
+}
+
+// Replace the items of the previous page with `page_items`,
+// the other items of the menu stay where they are.
+// The page takes the place of the previous page, or goes at the end.
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+install_page_items_locked(MenuTypeObject *menu, PyObject *page_items) {
+    PyObject *items = PyList_New(0);
+    if (!items) {
+        return FALSE;
+    }
+    BOOL page_placed = FALSE;
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
+        PyObject *item = PyList_GET_ITEM(menu->items_list, i);
+        if (!is_page_item(menu, item)) {
+            if (PyList_Append(items, item)<0) {
+                goto error_clean;
+            }
+        }
+        else if (!page_placed) {
+            page_placed = TRUE;
+            if (PyList_SetSlice(items, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX, page_items)<0) {
+                goto error_clean;
+            }
+        }
+    }
+    if (!page_placed &&
+        PyList_SetSlice(items, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX, page_items)<0) {
+        goto error_clean;
+    }
+
+    BOOL result = sync_items_locked(menu, items);
+    Py_DECREF(items);
+    return result;
+error_clean:
+    Py_DECREF(items);
+    return FALSE;
+}
+
+static PyObject *
+menu_set_page_source(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"source", "page_size", "callback", NULL};
+
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyObject *source, *callback = NULL;
+    Py_ssize_t page_size = 50;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|nO", kwlist,
+        &source, &page_size, &callback
+    )) {
+        return NULL;
+    }
+
+    if (!Py_IsNone(source) && !PySequence_Check(source)) {
+        PyErr_SetString(PyExc_TypeError, "Argument 'source' must be a sequence or None");
+        return NULL;
+    }
+    if (page_size<1) {
+        PyErr_SetString(PyExc_ValueError, "Argument 'page_size' must be positive");
+        return NULL;
+    }
+    if (callback && Py_IsNone(callback)) {
+        callback = NULL;
+    }
+    if (callback && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "Argument 'callback' must be callable or None");
+        return NULL;
+    }
+
+    PyObject *pool = NULL, *prev_item = NULL, *next_item = NULL;
+    if (!Py_IsNone(source)) {
+        pool = PyList_New(0);
+        if (!pool) {
+            return NULL;
+        }
+        PyObject *direction = PyLong_FromLong(-1);
+        if (!direction) {
+            goto error_clean;
+        }
+        prev_item = new_page_item("Previous", &page_navigate_method_def, direction);
+        Py_DECREF(direction);
+        if (!prev_item) {
+            goto error_clean;
+        }
+        direction = PyLong_FromLong(1);
+        if (!direction) {
+            goto error_clean;
+        }
+        next_item = new_page_item("More\xe2\x80\xa6", &page_navigate_method_def, direction);
+        Py_DECREF(direction);
+        if (!next_item) {
+            goto error_clean;
+        }
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    // a menu that is no longer paged keeps none of the page
+    if (!pool && !remove_page_items_locked(cls)) {
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+        return NULL;
+    }
+    PyObject *old_objects[] = {
+        cls->page_source, cls->page_callback,
+        cls->page_pool, cls->page_prev_item, cls->page_next_item
+    };
+    cls->page_source = Py_IsNone(source)?NULL:Py_NewRef(source);
+    cls->page_callback = Py_XNewRef(callback);
+    cls->page_size = page_size;
+    cls->page_start = 0;
+    cls->page_pool = pool;
+    cls->page_prev_item = prev_item;
+    cls->page_next_item = next_item;
+    cls->populated = FALSE;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    for (int i=0;i<5;i++) {
+        Py_XDECREF(old_objects[i]);
+    }
+
+    Py_RETURN_NONE;
+error_clean:
+    Py_XDECREF(pool);
+    Py_XDECREF(prev_item);
+    return NULL;
+}
+
+// Fill a paged menu with its current page.
+// Called by populate_menu() holding `menu_insert_delete_cs`,
+// leaves the critical section.
+static BOOL
+populate_page(MenuTypeObject *menu) {
+    // the page may be changed or cleared while the source is read
+    PyObject *source = Py_NewRef(menu->page_source);
+    PyObject *pool = Py_NewRef(menu->page_pool);
+    PyObject *prev_item = Py_NewRef(menu->page_prev_item);
+    PyObject *next_item = Py_NewRef(menu->page_next_item);
+    Py_ssize_t page_size = menu->page_size;
+    Py_ssize_t page_start = menu->page_start;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    PyObject *items = build_page_items(
+        source, pool, prev_item, next_item, page_size, &page_start
+    );
+
+    BOOL result = TRUE;
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    if (menu->page_source!=source || menu->page_pool!=pool) {
+        // set_page_source() was called during the build,
+        // the page is built again by the next populate
+        Py_XDECREF(items);
+        PyErr_Clear();
+    }
+    else if (!items) {
+        menu->populated = FALSE;
+        result = FALSE;
+    }
+    else {
+        menu->page_start = page_start;
+        // only the changed items are written
+        result = install_page_items_locked(menu, items);
+        if (!result) {
+            menu->populated = FALSE;
+        }
+        Py_DECREF(items);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_DECREF(source);
+    Py_DECREF(pool);
+    Py_DECREF(prev_item);
+    Py_DECREF(next_item);
+    return result;
+}
+
+// Fill the menu with the items returned by its provider,
+// the items are cached until Menu.invalidate() is called.
+static BOOL
+populate_menu(MenuTypeObject *menu) {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    if ((!menu->provider && !menu->page_source) || menu->populated) {
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+        return TRUE;
+    }
+    // set in advance, so an invalidate() during the call is not lost
+    menu->populated = TRUE;
+
+    if (menu->page_source) {
+        return populate_page(menu);
+    }
+
+    PyObject *provider = Py_NewRef(menu->provider);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    PyObject *result = PyObject_CallOneArg(provider, (PyObject *)menu);
+    Py_DECREF(provider);
+    if (!result) {
+        goto error_clean;
+    }
+    PyObject *items = menu_items_from_iterable(result);
+    Py_DECREF(result);
+    if (!items) {
+        goto error_clean;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    // only the changed items are written
+    BOOL replace_result = sync_items_locked(menu, items);
+    if (!replace_result) {
+        menu->populated = FALSE;
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_DECREF(items);
+    return replace_result;
+
+error_clean:
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    menu->populated = FALSE;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    return FALSE;
+}
+
+static PyObject *
+menu_register_provider(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    if (!Py_IsNone(arg) && !PyCallable_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be callable or None");
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    PyObject *old_provider = cls->provider;
+    cls->provider = Py_IsNone(arg)?NULL:Py_NewRef(arg);
+    cls->populated = FALSE;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_XDECREF(old_provider);
+
+    // can be used as a decorator
+    return Py_NewRef(arg);
+}
+
+static PyObject *
+menu_invalidate(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    // the provider is called again the next time the menu is opened
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    cls->populated = FALSE;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_prewarm(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    // do the work of popup() before it's called,
+    // e.g. when the mouse moves over the tray icon
+    if (!prepare_popup(cls)) {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_set_presync(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    static char *kwlist[] = {"enabled", NULL};
+
+    int enabled = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", kwlist, &enabled)) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    if (enabled && !cls->presync) {
+        add_presync_menu(cls);
+    }
+    else if (!enabled && cls->presync) {
+        remove_presync_menu(cls);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    // write the changes made before
+    if (enabled) {
+        post_presync_message();
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_batch(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyTypeObject *batch_type = pwt_globals.MenuBatchType;
+    MenuBatchObject *batch = (MenuBatchObject *)(batch_type->tp_alloc(batch_type, 0));
+    if (!batch) {
+        return NULL;
+    }
+    batch->ops = PyList_New(0);
+    if (!batch->ops) {
+        Py_DECREF(batch);
+        return NULL;
+    }
+    batch->menu = cls;
+    Py_INCREF(cls);
+    return (PyObject *)batch;
+}
+
+// _MenuBatch records the operations as tuples of (MenuOpType, index, item)
+
+static BOOL
+menu_batch_record(MenuBatchObject *self, MenuOpType type, Py_ssize_t index, PyObject *item) {
+    PyObject *op = Py_BuildValue("(inO)", type, index, item?item:Py_None);
+    if (!op) {
+        return FALSE;
+    }
+    int result = PyList_Append(self->ops, op);
+    Py_DECREF(op);
+    return result==0;
+}
+
+static PyObject *
+menu_batch_insert_item(MenuBatchObject *self, PyObject *args) {
+    Py_ssize_t index;
+    PyObject *item;
+    if (!PyArg_ParseTuple(args, "nO!", &index, pwt_globals.MenuItemType, &item)) {
+        return NULL;
+    }
+    if (!menu_batch_record(self, MENU_OP_INSERT, index, item)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_batch_append_item(MenuBatchObject *self, PyObject *arg) {
+    if (!PyObject_TypeCheck(arg, pwt_globals.MenuItemType)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a MenuItem");
+        return NULL;
+    }
+    if (!menu_batch_record(self, MENU_OP_INSERT, PY_SSIZE_T_MAX, arg)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_batch_extend(MenuBatchObject *self, PyObject *arg) {
+    PyObject *items = menu_items_from_iterable(arg);
+    if (!items) {
+        return NULL;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(items);i++) {
+        if (!menu_batch_record(self, MENU_OP_INSERT, PY_SSIZE_T_MAX, PyList_GET_ITEM(items, i))) {
+            Py_DECREF(items);
+            return NULL;
+        }
+    }
+    Py_DECREF(items);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_batch_remove_item(MenuBatchObject *self, PyObject *arg) {
+    if (!PyLong_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument mus be an int");
+        return NULL;
+    }
+    Py_ssize_t index = PyLong_AsSsize_t(arg);
+    if (index==-1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (!menu_batch_record(self, MENU_OP_REMOVE, index, NULL)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+menu_batch_enter(MenuBatchObject *self, PyObject *arg) {
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+menu_batch_exit(MenuBatchObject *self, PyObject *args) {
+    PyObject *exc_type, *exc_value, *exc_tb;
+    if (!PyArg_ParseTuple(args, "OOO", &exc_type, &exc_value, &exc_tb)) {
+        return NULL;
+    }
+
+    // take the recorded operations, the batch can be reused
+    PyObject *recorded = self->ops;
+    self->ops = PyList_New(0);
+    if (!self->ops) {
+        self->ops = recorded;
+        return NULL;
+    }
+
+    if (!Py_IsNone(exc_type)) {
+        // discard the operations
+        Py_DECREF(recorded);
+        Py_RETURN_FALSE;
+    }
+
+    Py_ssize_t count = PyList_GET_SIZE(recorded);
+    MenuOp *ops = PyMem_New(MenuOp, count?count:1);
+    if (!ops) {
+        Py_DECREF(recorded);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i=0;i<count;i++) {
+        PyObject *op = PyList_GET_ITEM(recorded, i);
+        ops[i].type = (MenuOpType)PyLong_AsLong(PyTuple_GET_ITEM(op, 0));
+        ops[i].index = PyLong_AsSsize_t(PyTuple_GET_ITEM(op, 1));
+        PyObject *item = PyTuple_GET_ITEM(op, 2);
+        ops[i].item = Py_IsNone(item)?NULL:(MenuItemObject *)item;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = apply_menu_ops(self->menu, ops, count);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    PyMem_Free(ops);
+    Py_DECREF(recorded);
+    if (!result) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+static void
+menu_batch_dealloc(MenuBatchObject *self) {
+    Py_XDECREF(self->menu);
+    Py_XDECREF(self->ops);
+    PyTypeObject *tp = Py_TYPE(self);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+static PyMethodDef menu_batch_methods[] = {
+    {"insert_item", (PyCFunction)menu_batch_insert_item, METH_VARARGS, NULL},
+    {"append_item", (PyCFunction)menu_batch_append_item, METH_O, NULL},
+    {"extend", (PyCFunction)menu_batch_extend, METH_O, NULL},
+    {"remove_item", (PyCFunction)menu_batch_remove_item, METH_O, NULL},
+    {"__enter__", (PyCFunction)menu_batch_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)menu_batch_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject *
+create_menu_batch_type(PyObject *module) {
+    static PyType_Spec spec;
+
+    PyType_Slot menu_batch_slots[] = {
+        {Py_tp_methods, menu_batch_methods},
+        {Py_tp_dealloc, menu_batch_dealloc},
+        {0, NULL}
+    };
+
+    spec.name = "pywintray._MenuBatch";
+    spec.basicsize = sizeof(MenuBatchObject);
+    spec.itemsize = 0;
+    spec.flags = Py_TPFLAGS_DEFAULT |
+        Py_TPFLAGS_DISALLOW_INSTANTIATION |
+        Py_TPFLAGS_IMMUTABLETYPE;
+    spec.slots = menu_batch_slots;
+
+    return (PyTypeObject *)PyType_FromModuleAndSpec(module, &spec, NULL);
+}
+
+// Create a Menu subclass named `name` with a list of MenuItem
+static MenuTypeObject *
+new_menu_with_items(PyObject *name, PyObject *items) {
+    // an empty class, the items are added at once below
+    MenuTypeObject *menu = (MenuTypeObject *)PyObject_CallFunction(
+        (PyObject *)Py_TYPE(pwt_globals.MenuType), "O(O){}", name, pwt_globals.MenuType
+    );
+    if (!menu) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = replace_items_locked(menu, items);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    if (!result) {
+        Py_CLEAR(menu);
+    }
+    return menu;
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+build_search_index(MenuTypeObject *menu) {
+    SearchIndex *index = search_index_new();
+    if (!index) {
+        return FALSE;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(menu->items_list);i++) {
+        MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+        if (item->string && !search_index_add(index, item, item->string)) {
+            search_index_free(index);
+            return FALSE;
+        }
+    }
+    menu->search_index = index;
+    return TRUE;
+}
+
+// Append the items of `menu` and its submenus matching `query` to `result`,
+// the submenus are flattened and each menu is searched once.
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+collect_filtered_items(MenuTypeObject *menu, PyObject *query, PyObject *result, ULONG_PTR epoch) {
+    if (menu->visit_epoch==epoch) {
+        return TRUE;
+    }
+    menu->visit_epoch = epoch;
+
+    if (!menu->search_index && !build_search_index(menu)) {
+        return FALSE;
+    }
+
+    Py_ssize_t size = PyList_GET_SIZE(menu->items_list);
+    BYTE *matched = PyMem_RawMalloc(size?size:1);
+    if (!matched) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+
+    MenuItemObject **candidates;
+    Py_ssize_t count;
+    if (!search_index_candidates(menu->search_index, query, &candidates, &count)) {
+        PyMem_RawFree(matched);
+        return FALSE;
+    }
+    for (Py_ssize_t i=0;i<size;i++) {
+        matched[i] = FALSE;
+    }
+    if (count<0) {
+        // too short for the index, check every label
+        for (Py_ssize_t i=0;i<size;i++) {
+            MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+            matched[i] = item->string && search_label_matches(item->string, query);
+        }
+    }
+    else {
+        // mark by position, so the items keep the menu order
+        for (Py_ssize_t i=0;i<count;i++) {
+            MenuItemObject *item = candidates[i];
+            if (!search_label_matches(item->string, query)) {
+                continue;
+            }
+            for (Py_ssize_t j=0;j<item->links_count;j++) {
+                if (item->links[j].menu==menu) {
+                    matched[MENU_ITEM_LINK_INDEX(&(item->links[j]))] = TRUE;
+                }
+            }
+        }
+    }
+
+    BOOL result_ok = TRUE;
+    for (Py_ssize_t i=0;i<size && result_ok;i++) {
+        MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(menu->items_list, i);
+        if (item->type==MENU_ITEM_TYPE_SUBMENU) {
+            if (Py_EnterRecursiveCall(" while filtering a menu")) {
+                result_ok = FALSE;
+                break;
+            }
+            result_ok = collect_filtered_items(item->sub, query, result, epoch);
+            Py_LeaveRecursiveCall();
+        }
+        else if (matched[i]) {
+            result_ok = PyList_Append(result, (PyObject *)item)==0;
+        }
+    }
+    PyMem_RawFree(matched);
+    return result_ok;
+}
+
+static PyObject *
+menu_filtered(MenuTypeObject *cls, PyObject *arg) {
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    if (!PyUnicode_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "Query must be str");
+        return NULL;
+    }
+
+    PyObject *items = PyList_New(0);
+    if (!items) {
+        return NULL;
+    }
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    ULONG_PTR epoch = ++(pwt_globals.menu_visit_epoch);
+    BOOL result = collect_filtered_items(cls, arg, items, epoch);
+    MenuTypeObject *view = (MenuTypeObject *)Py_XNewRef(cls->filtered_view);
+    if (result && view) {
+        // only the changes since the last query are written
+        result = sync_items_locked(view, items);
+    }
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    if (result && !view) {
+        PyObject *name = PyUnicode_FromFormat("%sFiltered", ((PyTypeObject *)cls)->tp_name);
+        if (!name) {
+            Py_DECREF(items);
+            return NULL;
+        }
+        view = new_menu_with_items(name, items);
+        Py_DECREF(name);
+        if (view) {
+            PWT_ENTER_MENU_INSERT_DELETE_CS();
+            if (!cls->filtered_view) {
+                cls->filtered_view = (MenuTypeObject *)Py_NewRef(view);
+            }
+            PWT_LEAVE_MENU_INSERT_DELETE_CS();
+        }
+    }
+
+    Py_DECREF(items);
+    if (!result) {
+        Py_XDECREF(view);
+        return NULL;
+    }
+    return (PyObject *)view;
+}
+
+static MenuTypeObject *menu_from_spec_list(PyObject *name, PyObject *spec);
+
+// Get an optional value of a spec dict, `*result` is unchanged if missing
+static BOOL
+spec_get_bool(PyObject *entry, const char *key, BOOL *result) {
+    PyObject *value = PyDict_GetItemString(entry, key);
+    if (!value) {
+        return TRUE;
+    }
+    int is_true = PyObject_IsTrue(value);
+    if (is_true<0) {
+        return FALSE;
+    }
+    *result = is_true;
+    return TRUE;
+}
+
+// Create a MenuItem from a dict like
+// {"type": "check", "label": "...", "checked": True, "callback": ...}
+static MenuItemObject *
+menu_item_from_spec_dict(PyObject *entry) {
+    static const char *known_keys[] = {
+        "type", "label", "enabled", "callback", "checked", "radio", "items", NULL
+    };
+
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(entry, &pos, &key, &value)) {
+        BOOL known = FALSE;
+        for (int i=0;known_keys[i];i++) {
+            if (PyUnicode_Check(key) && PyUnicode_EqualToUTF8(key, known_keys[i])) {
+                known = TRUE;
+                break;
+            }
+        }
+        if (!known) {
+            PyErr_Format(PyExc_ValueError, "Unknown key in menu spec: %R", key);
+            return NULL;
+        }
+    }
+
+    PyObject *items = PyDict_GetItemString(entry, "items");
+    PyObject *type_obj = PyDict_GetItemString(entry, "type");
+    MenuItemTypeEnum type = items?MENU_ITEM_TYPE_SUBMENU:MENU_ITEM_TYPE_STRING;
+    if (type_obj) {
+        if (!PyUnicode_Check(type_obj)) {
+            PyErr_SetString(PyExc_TypeError, "Type of 'type' must be str");
+            return NULL;
+        }
+        if (PyUnicode_EqualToUTF8(type_obj, "separator")) {
+            type = MENU_ITEM_TYPE_SEPARATOR;
+        }
+        else if (PyUnicode_EqualToUTF8(type_obj, "string")) {
+            type = MENU_ITEM_TYPE_STRING;
+        }
+        else if (PyUnicode_EqualToUTF8(type_obj, "check")) {
+            type = MENU_ITEM_TYPE_CHECK;
+        }
+        else if (PyUnicode_EqualToUTF8(type_obj, "submenu")) {
+            type = MENU_ITEM_TYPE_SUBMENU;
+        }
+        else {
+            PyErr_SetString(PyExc_ValueError, "Value of 'type' must in ['separator', 'string', 'check', 'submenu']");
+            return NULL;
+        }
+    }
+    if (items && type!=MENU_ITEM_TYPE_SUBMENU) {
+        PyErr_SetString(PyExc_ValueError, "Only submenu spec can have 'items'");
+        return NULL;
+    }
+
+    if (type==MENU_ITEM_TYPE_SEPARATOR) {
+        return menu_item_create(MENU_ITEM_TYPE_SEPARATOR, NULL, TRUE, NULL, FALSE, FALSE);
+    }
+
+    PyObject *label = PyDict_GetItemString(entry, "label");
+    if (!label || !PyUnicode_Check(label)) {
+        PyErr_SetString(PyExc_TypeError, "Menu spec requires a str 'label'");
+        return NULL;
+    }
+
+    BOOL enabled = TRUE, checked = FALSE, radio = FALSE;
+    if (!spec_get_bool(entry, "enabled", &enabled) ||
+        !spec_get_bool(entry, "checked", &checked) ||
+        !spec_get_bool(entry, "radio", &radio)) {
+        return NULL;
+    }
+
+    PyObject *callback = PyDict_GetItemString(entry, "callback");
+    if (callback && Py_IsNone(callback)) {
+        callback = NULL;
+    }
+    if (callback && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "Callback should be callable or None");
+        return NULL;
+    }
+
+    if (type!=MENU_ITEM_TYPE_SUBMENU) {
+        return menu_item_create(type, label, enabled, callback, checked, radio);
+    }
+
+    if (!items) {
+        PyErr_SetString(PyExc_TypeError, "Submenu spec requires 'items'");
+        return NULL;
+    }
+    MenuTypeObject *sub = menu_from_spec_list(label, items);
+    if (!sub) {
+        return NULL;
+    }
+    MenuItemObject *item = menu_item_create(MENU_ITEM_TYPE_SUBMENU, label, enabled, NULL, FALSE, FALSE);
+    if (item && !menu_item_attach_submenu(item, sub)) {
+        Py_CLEAR(item);
+    }
+    Py_DECREF(sub);
+    return item;
+}
+
+// Create a MenuItem from an entry of a menu spec:
+// None for a separator, a str for a string item,
+// (label, callback) for a string item with callback,
+// (label, [entries]) for a submenu, a dict, or a MenuItem itself
+static MenuItemObject *
+menu_item_from_spec(PyObject *entry) {
+    if (Py_IsNone(entry)) {
+        return menu_item_create(MENU_ITEM_TYPE_SEPARATOR, NULL, TRUE, NULL, FALSE, FALSE);
+    }
+    if (PyUnicode_Check(entry)) {
+        return menu_item_create(MENU_ITEM_TYPE_STRING, entry, TRUE, NULL, FALSE, FALSE);
+    }
+    if (PyObject_TypeCheck(entry, pwt_globals.MenuItemType)) {
+        return (MenuItemObject *)Py_NewRef(entry);
+    }
+    if (PyDict_Check(entry)) {
+        return menu_item_from_spec_dict(entry);
+    }
+    if (PyTuple_Check(entry) && PyTuple_GET_SIZE(entry)==2 &&
+        PyUnicode_Check(PyTuple_GET_ITEM(entry, 0))) {
+        PyObject *label = PyTuple_GET_ITEM(entry, 0);
+        PyObject *second = PyTuple_GET_ITEM(entry, 1);
+        if (Py_IsNone(second) || PyCallable_Check(second)) {
+            return menu_item_create(
+                MENU_ITEM_TYPE_STRING, label, TRUE,
+                Py_IsNone(second)?NULL:second, FALSE, FALSE
+            );
+        }
+        MenuTypeObject *sub = menu_from_spec_list(label, second);
+        if (!sub) {
+            return NULL;
+        }
+        MenuItemObject *item = menu_item_create(MENU_ITEM_TYPE_SUBMENU, label, TRUE, NULL, FALSE, FALSE);
+        if (item && !menu_item_attach_submenu(item, sub)) {
+            Py_CLEAR(item);
+        }
+        Py_DECREF(sub);
+        return item;
+    }
+    PyErr_Format(PyExc_TypeError, "Invalid menu spec entry: %R", entry);
+    return NULL;
+}
+
+// Create a Menu subclass named `name` with the items of a spec list
+static MenuTypeObject *
+menu_from_spec_list(PyObject *name, PyObject *spec) {
+    if (PyUnicode_Check(spec)) {
+        PyErr_SetString(PyExc_TypeError, "Menu spec must be a sequence of entries, not str");
+        return NULL;
+    }
+    if (Py_EnterRecursiveCall(" while building a menu from spec")) {
+        return NULL;
+    }
+
+    MenuTypeObject *menu = NULL;
+    PyObject *items = NULL;
+
+    PyObject *entries = PySequence_Fast(spec, "Menu spec must be a sequence");
+    if (!entries) {
+        goto clean_up;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(entries);
+    items = PyList_New(count);
+    if (!items) {
+        goto clean_up;
+    }
+    for (Py_ssize_t i=0;i<count;i++) {
+        MenuItemObject *item = menu_item_from_spec(PySequence_Fast_GET_ITEM(entries, i));
+        if (!item) {
+            goto clean_up;
+        }
+        PyList_SET_ITEM(items, i, (PyObject *)item);
+    }
+
+    menu = new_menu_with_items(name, items);
+
+clean_up:
+    Py_XDECREF(items);
+    Py_XDECREF(entries);
+    Py_LeaveRecursiveCall();
+    return menu;
+}
+
+static PyObject *
+menu_from_spec(PyObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"spec", "name", NULL};
+
+    PyObject *spec, *name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|U", kwlist, &spec, &name)) {
+        return NULL;
+    }
+
+    if (!name) {
+        name = PyUnicode_FromString("SpecMenu");
+        if (!name) {
+            return NULL;
+        }
+    }
+    else {
+        Py_INCREF(name);
+    }
+
+    MenuTypeObject *menu = menu_from_spec_list(name, spec);
+    Py_DECREF(name);
+    return (PyObject *)menu;
+}
+
+// Menu snapshot format of Menu.dump() and Menu.load(), little-endian:
+//
+// snapshot: "PWTM" u16:version u16:reserved menu
+// menu:     string:name u32:item_count item*
+// item:     u8:type u8:flags [string:label] [string:key] [menu|u32:menu_index]
+// string:   u32:byte_length UTF-8
+//
+// The label is omitted for separators, the key is present if
+// MENU_SNAPSHOT_HAS_KEY is set, and the menu follows submenu items.
+// The menus are numbered in the order they are written, the root is 0.
+// A submenu that is already written is not written again,
+// its item has MENU_SNAPSHOT_SHARED set and is followed by the menu index,
+// so a shared submenu is still shared after loading.
+#define MENU_SNAPSHOT_VERSION 1
+
+#define MENU_SNAPSHOT_ENABLED 0x1
+#define MENU_SNAPSHOT_CHECKED 0x2
+#define MENU_SNAPSHOT_RADIO 0x4
+#define MENU_SNAPSHOT_HAS_KEY 0x8
+#define MENU_SNAPSHOT_SHARED 0x10
+
+typedef struct {
+    BYTE *data;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+} SnapshotWriter;
+
+static BOOL
+snapshot_write(SnapshotWriter *writer, const void *data, Py_ssize_t len) {
+    if (!pwt_array_reserve(
+        (void **)&(writer->data), &(writer->capacity), writer->size+len, 1
+    )) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+    const BYTE *src = data;
+    for (Py_ssize_t i=0;i<len;i++) {
+        writer->data[writer->size+i] = src[i];
+    }
+    writer->size += len;
+    return TRUE;
+}
+
+static BOOL
+snapshot_write_u32(SnapshotWriter *writer, UINT32 value) {
+    BYTE bytes[4] = {
+        (BYTE)value, (BYTE)(value>>8), (BYTE)(value>>16), (BYTE)(value>>24)
+    };
+    return snapshot_write(writer, bytes, 4);
+}
+
+static BOOL
+snapshot_write_string(SnapshotWriter *writer, PyObject *string) {
+    Py_ssize_t len;
+    const char *utf8 = PyUnicode_AsUTF8AndSize(string, &len);
+    if (!utf8) {
+        return FALSE;
+    }
+    if ((size_t)len>0xFFFFFFFFu) {
+        PyErr_SetString(PyExc_OverflowError, "String is too long for menu snapshot");
+        return FALSE;
+    }
+    return snapshot_write_u32(writer, (UINT32)len) && snapshot_write(writer, utf8, len);
+}
+
+// Copy the item lists of `menu` and its submenus into `lists`
+// (Menu -> list of items), so they can be written without the lock
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+snapshot_collect_items(MenuTypeObject *menu, PyObject *lists) {
+    int contains = PyDict_Contains(lists, (PyObject *)menu);
+    if (contains) {
+        return contains>0;
+    }
+    PyObject *items = PyList_GetSlice(menu->items_list, 0, PY_SSIZE_T_MAX);
+    if (!items) {
+        return FALSE;
+    }
+    int set_result = PyDict_SetItem(lists, (PyObject *)menu, items);
+    Py_DECREF(items);
+    if (set_result<0) {
+        return FALSE;
+    }
+    for (Py_ssize_t i=0;i<PyList_GET_SIZE(items);i++) {
+        MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(items, i);
+        if (item->type==MENU_ITEM_TYPE_SUBMENU && !snapshot_collect_items(item->sub, lists)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Find the key of the callback of `item`.
+// `keys` maps MenuItem to the key of its callback, can be NULL.
+// A key taken from __qualname__ must name one callback,
+// `seen` maps the keys to (callback, is_explicit) to check that.
+// Returns a new reference, NULL if failed
+static PyObject *
+snapshot_callback_key(MenuItemObject *item, PyObject *keys, PyObject *seen) {
+    PyObject *key = NULL;
+    if (keys) {
+        key = PyDict_GetItemWithError(keys, (PyObject *)item);
+        if (!key && PyErr_Occurred()) {
+            return NULL;
+        }
+        Py_XINCREF(key);
+    }
+    BOOL is_explicit = key!=NULL;
+    if (!key) {
+        // stable as long as the callback keeps its name
+        key = PyObject_GetAttrString(item->callback, "__qualname__");
+        if (!key) {
+            return NULL;
+        }
+    }
+    if (!PyUnicode_Check(key)) {
+        Py_DECREF(key);
+        PyErr_SetString(PyExc_TypeError, "Callback key must be str");
+        return NULL;
+    }
+
+    PyObject *entry = PyDict_GetItemWithError(seen, key);
+    if (!entry) {
+        if (PyErr_Occurred()) {
+            goto error_clean;
+        }
+        entry = Py_BuildValue("(OO)", item->callback, is_explicit?Py_True:Py_False);
+        if (!entry) {
+            goto error_clean;
+        }
+        int set_result = PyDict_SetItem(seen, key, entry);
+        Py_DECREF(entry);
+        if (set_result<0) {
+            goto error_clean;
+        }
+        return key;
+    }
+    // e.g. two lambdas, or same-named methods of different classes
+    if (
+        PyTuple_GET_ITEM(entry, 0)!=item->callback &&
+        (!is_explicit || Py_IsFalse(PyTuple_GET_ITEM(entry, 1)))
+    ) {
+        PyErr_Format(
+            PyExc_ValueError,
+            "Callback key '%U' names more than one callback, pass 'keys' to tell them apart",
+            key
+        );
+        goto error_clean;
+    }
+    return key;
+
+error_clean:
+    Py_DECREF(key);
+    return NULL;
+}
+
+// `lists` is filled by snapshot_collect_items(),
+// `written` maps the menus already written to their index
+static BOOL
+snapshot_write_menu(
+    SnapshotWriter *writer, MenuTypeObject *menu,
+    PyObject *lists, PyObject *keys, PyObject *seen, PyObject *written
+) {
+    if (Py_EnterRecursiveCall(" while dumping a menu")) {
+        return FALSE;
+    }
+    BOOL result = FALSE;
+
+    PyObject *index = PyLong_FromSsize_t(PyDict_GET_SIZE(written));
+    if (!index) {
+        goto clean_up;
+    }
+    int set_result = PyDict_SetItem(written, (PyObject *)menu, index);
+    Py_DECREF(index);
+    if (set_result<0) {
+        goto clean_up;
+    }
+
+    PyObject *name = PyObject_GetAttrString((PyObject *)menu, "__name__");
+    if (!name) {
+        goto clean_up;
+    }
+    BOOL name_result = PyUnicode_Check(name) && snapshot_write_string(writer, name);
+    Py_DECREF(name);
+    if (!name_result) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_TypeError, "Menu name must be str");
+        }
+        goto clean_up;
+    }
+
+    PyObject *items = PyDict_GetItemWithError(lists, (PyObject *)menu);
+    if (!items) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_SystemError, "menu items not collected");
+        }
+        goto clean_up;
+    }
+    Py_ssize_t count = PyList_GET_SIZE(items);
+    if (!snapshot_write_u32(writer, (UINT32)count)) {
+        goto clean_up;
+    }
+
+    for (Py_ssize_t i=0;i<count;i++) {
+        MenuItemObject *item = (MenuItemObject *)PyList_GET_ITEM(items, i);
+
+        PyObject *key = NULL;
+        if (item->callback) {
+            key = snapshot_callback_key(item, keys, seen);
+            if (!key) {
+                goto clean_up;
+            }
+        }
+
+        PyObject *sub_index = NULL;
+        if (item->type==MENU_ITEM_TYPE_SUBMENU) {
+            sub_index = PyDict_GetItemWithError(written, (PyObject *)(item->sub));
+            if (!sub_index && PyErr_Occurred()) {
+                goto clean_up;
+            }
+        }
+
+        BYTE header[2];
+        header[0] = (BYTE)(item->type);
+        header[1] = (
+            (item->enabled?MENU_SNAPSHOT_ENABLED:0) |
+            (item->checked?MENU_SNAPSHOT_CHECKED:0) |
+            (item->radio?MENU_SNAPSHOT_RADIO:0) |
+            (key?MENU_SNAPSHOT_HAS_KEY:0) |
+            (sub_index?MENU_SNAPSHOT_SHARED:0)
+        );
+        BOOL item_result = snapshot_write(writer, header, 2);
+        if (item_result && item->type!=MENU_ITEM_TYPE_SEPARATOR) {
+            item_result = snapshot_write_string(writer, item->string);
+        }
+        if (item_result && key) {
+            item_result = snapshot_write_string(writer, key);
+        }
+        Py_XDECREF(key);
+        if (item_result && sub_index) {
+            item_result = snapshot_write_u32(writer, (UINT32)PyLong_AsSsize_t(sub_index));
+        }
+        else if (item_result && item->type==MENU_ITEM_TYPE_SUBMENU) {
+            item_result = snapshot_write_menu(writer, item->sub, lists, keys, seen, written);
+        }
+        if (!item_result) {
+            goto clean_up;
+        }
+    }
+    result = TRUE;
+
+clean_up:
+    Py_LeaveRecursiveCall();
+    return result;
+}
+
+static PyObject *
+menu_dump(MenuTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"keys", NULL};
+
+    CHECK_MENU_SUBTYPE(cls, NULL);
+
+    PyObject *keys = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O!", kwlist, &PyDict_Type, &keys)) {
+        return NULL;
+    }
+
+    PyObject *blob = NULL, *seen = NULL, *written = NULL;
+    SnapshotWriter writer = {NULL, 0, 0};
+    BYTE header[8] = {'P', 'W', 'T', 'M', MENU_SNAPSHOT_VERSION, 0, 0, 0};
+
+    PyObject *lists = PyDict_New();
+    if (!lists) {
+        return NULL;
+    }
+
+    // the keys are looked up by Python code,
+    // which must not run while holding the lock
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = snapshot_collect_items(cls, lists);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    if (!result) {
+        goto clean_up;
+    }
+
+    seen = PyDict_New();
+    written = PyDict_New();
+    if (!seen || !written) {
+        goto clean_up;
+    }
+    if (
+        snapshot_write(&writer, header, 8) &&
+        snapshot_write_menu(&writer, cls, lists, keys, seen, written)
+    ) {
+        blob = PyBytes_FromStringAndSize((const char *)(writer.data), writer.size);
+    }
+
+clean_up:
+    PyMem_RawFree(writer.data);
+    Py_XDECREF(seen);
+    Py_XDECREF(written);
+    Py_DECREF(lists);
+    return blob;
+}
+
+typedef struct {
+    const BYTE *data;
+    Py_ssize_t size;
+    Py_ssize_t pos;
+} SnapshotReader;
+
+static BOOL
+snapshot_invalid() {
+    PyErr_SetString(PyExc_ValueError, "Invalid menu snapshot");
+    return FALSE;
+}
+
+static BOOL
+snapshot_read_u8(SnapshotReader *reader, BYTE *value) {
+    if (reader->size-reader->pos<1) {
+        return snapshot_invalid();
+    }
+    *value = reader->data[reader->pos++];
+    return TRUE;
+}
+
+static BOOL
+snapshot_read_u32(SnapshotReader *reader, UINT32 *value) {
+    if (reader->size-reader->pos<4) {
+        return snapshot_invalid();
+    }
+    const BYTE *p = reader->data+reader->pos;
+    *value = (UINT32)p[0] | ((UINT32)p[1]<<8) | ((UINT32)p[2]<<16) | ((UINT32)p[3]<<24);
+    reader->pos += 4;
+    return TRUE;
+}
+
+static PyObject *
+snapshot_read_string(SnapshotReader *reader) {
+    UINT32 len;
+    if (!snapshot_read_u32(reader, &len)) {
+        return NULL;
+    }
+    if ((Py_ssize_t)len>reader->size-reader->pos) {
+        snapshot_invalid();
+        return NULL;
+    }
+    PyObject *string = PyUnicode_DecodeUTF8(
+        (const char *)(reader->data+reader->pos), (Py_ssize_t)len, NULL
+    );
+    reader->pos += len;
+    return string;
+}
+
+// `loaded` is the list of the menus read so far by their index,
+// None for a menu whose items are still being read
+static MenuTypeObject *
+snapshot_read_menu(SnapshotReader *reader, PyObject *callbacks, PyObject *loaded) {
+    if (Py_EnterRecursiveCall(" while loading a menu")) {
+        return NULL;
+    }
+
+    MenuTypeObject *menu = NULL;
+    PyObject *items = NULL;
+
+    Py_ssize_t index = PyList_GET_SIZE(loaded);
+    if (PyList_Append(loaded, Py_None)<0) {
+        Py_LeaveRecursiveCall();
+        return NULL;
+    }
+
+    PyObject *name = snapshot_read_string(reader);
+    if (!name) {
+        goto clean_up;
+    }
+
+    UINT32 count;
+    if (!snapshot_read_u32(reader, &count)) {
+        goto clean_up;
+    }
+    // every item takes 2 bytes at least
+    if ((Py_ssize_t)count>(reader->size-reader->pos)/2) {
+        snapshot_invalid();
+        goto clean_up;
+    }
+
+    items = PyList_New(count);
+    if (!items) {
+        goto clean_up;
+    }
+
+    for (UINT32 i=0;i<count;i++) {
+        BYTE type, flags;
+        if (!snapshot_read_u8(reader, &type) || !snapshot_read_u8(reader, &flags)) {
+            goto clean_up;
+        }
+        if (type!=MENU_ITEM_TYPE_SEPARATOR && type!=MENU_ITEM_TYPE_STRING &&
+            type!=MENU_ITEM_TYPE_CHECK && type!=MENU_ITEM_TYPE_SUBMENU) {
+            snapshot_invalid();
+            goto clean_up;
+        }
+
+        PyObject *label = NULL, *callback = NULL;
+        if (type!=MENU_ITEM_TYPE_SEPARATOR) {
+            label = snapshot_read_string(reader);
+            if (!label) {
+                goto clean_up;
+            }
+        }
+        if (flags&MENU_SNAPSHOT_HAS_KEY) {
+            PyObject *key = snapshot_read_string(reader);
+            if (!key) {
+                Py_XDECREF(label);
+                goto clean_up;
+            }
+            if (callbacks) {
+                callback = PyObject_GetItem(callbacks, key);
+            }
+            else {
+                PyErr_SetObject(PyExc_KeyError, key);
+            }
+            Py_DECREF(key);
+            if (!callback) {
+                Py_XDECREF(label);
+                goto clean_up;
+            }
+            if (!Py_IsNone(callback) && !PyCallable_Check(callback)) {
+                PyErr_SetString(PyExc_TypeError, "Callback must be callable");
+                Py_DECREF(callback);
+                Py_XDECREF(label);
+                goto clean_up;
+            }
+        }
+
+        MenuItemObject *item = menu_item_create(
+            (MenuItemTypeEnum)type, label,
+            (flags&MENU_SNAPSHOT_ENABLED)!=0,
+            (callback && !Py_IsNone(callback))?callback:NULL,
+            (flags&MENU_SNAPSHOT_CHECKED)!=0,
+            (flags&MENU_SNAPSHOT_RADIO)!=0
+        );
+        Py_XDECREF(label);
+        Py_XDECREF(callback);
+        if (!item) {
+            goto clean_up;
+        }
+        PyList_SET_ITEM(items, i, (PyObject *)item);
+
+        if (type==MENU_ITEM_TYPE_SUBMENU) {
+            MenuTypeObject *sub;
+            if (flags&MENU_SNAPSHOT_SHARED) {
+                UINT32 sub_index;
+                if (!snapshot_read_u32(reader, &sub_index)) {
+                    goto clean_up;
+                }
+                // an earlier menu that is complete, not an ancestor
+                if ((Py_ssize_t)sub_index>=PyList_GET_SIZE(loaded) ||
+                    Py_IsNone(PyList_GET_ITEM(loaded, sub_index))) {
+                    snapshot_invalid();
+                    goto clean_up;
+                }
+                sub = (MenuTypeObject *)Py_NewRef(PyList_GET_ITEM(loaded, sub_index));
+            }
+            else {
+                sub = snapshot_read_menu(reader, callbacks, loaded);
+                if (!sub) {
+                    goto clean_up;
+                }
+            }
+            BOOL attach_result = menu_item_attach_submenu(item, sub);
+            Py_DECREF(sub);
+            if (!attach_result) {
+                goto clean_up;
+            }
+        }
+    }
+
+    menu = new_menu_with_items(name, items);
+    if (menu) {
+        PyList_SetItem(loaded, index, Py_NewRef(menu));
+    }
+
+clean_up:
+    Py_XDECREF(items);
+    Py_XDECREF(name);
+    Py_LeaveRecursiveCall();
+    return menu;
+}
+
+static PyObject *
+menu_load(PyObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"blob", "callbacks", NULL};
+
+    Py_buffer blob;
+    PyObject *callbacks = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|O", kwlist, &blob, &callbacks)) {
+        return NULL;
+    }
+    if (callbacks && Py_IsNone(callbacks)) {
+        callbacks = NULL;
+    }
+
+    MenuTypeObject *menu = NULL;
+    PyObject *loaded = NULL;
+    SnapshotReader reader = {blob.buf, blob.len, 0};
+
+    const BYTE *header = blob.buf;
+    if (blob.len<8 || header[0]!='P' || header[1]!='W' || header[2]!='T' || header[3]!='M') {
+        snapshot_invalid();
+        goto clean_up;
+    }
+    if (header[4]!=MENU_SNAPSHOT_VERSION || header[5]!=0) {
+        PyErr_SetString(PyExc_ValueError, "Unsupported menu snapshot version");
+        goto clean_up;
+    }
+    reader.pos = 8;
+
+    loaded = PyList_New(0);
+    if (!loaded) {
+        goto clean_up;
+    }
+    menu = snapshot_read_menu(&reader, callbacks, loaded);
+    if (menu && reader.pos!=reader.size) {
+        Py_CLEAR(menu);
+        snapshot_invalid();
+    }
+
+clean_up:
+    Py_XDECREF(loaded);
+    PyBuffer_Release(&blob);
+    return (PyObject *)menu;
 }
 
 static PyObject*
@@ -788,6 +3778,20 @@ static PyMethodDef menu_methods[] = {
     {"insert_item", (PyCFunction)menu_insert_item, METH_VARARGS|METH_CLASS, NULL},
     {"remove_item", (PyCFunction)menu_remove_item, METH_O|METH_CLASS, NULL},
     {"append_item", (PyCFunction)menu_append_item, METH_O|METH_CLASS, NULL},
+    {"extend", (PyCFunction)menu_extend, METH_O|METH_CLASS, NULL},
+    {"replace_items", (PyCFunction)menu_replace_items, METH_O|METH_CLASS, NULL},
+    {"sync_to", (PyCFunction)menu_sync_to, METH_O|METH_CLASS, NULL},
+    {"filtered", (PyCFunction)menu_filtered, METH_O|METH_CLASS, NULL},
+    {"batch", (PyCFunction)menu_batch, METH_NOARGS|METH_CLASS, NULL},
+    {"register_provider", (PyCFunction)menu_register_provider, METH_O|METH_CLASS, NULL},
+    {"invalidate", (PyCFunction)menu_invalidate, METH_NOARGS|METH_CLASS, NULL},
+    {"prewarm", (PyCFunction)menu_prewarm, METH_NOARGS|METH_CLASS, NULL},
+    {"set_presync", (PyCFunction)menu_set_presync, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"popup_async", (PyCFunction)menu_popup_async, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"from_spec", (PyCFunction)menu_from_spec, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"dump", (PyCFunction)menu_dump, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"load", (PyCFunction)menu_load, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
+    {"set_page_source", (PyCFunction)menu_set_page_source, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
     {"wait_for_popup", (PyCFunction)menu_wait_for_popup, METH_VARARGS|METH_KEYWORDS|METH_CLASS, NULL},
     {NULL, NULL, 0, NULL}
 };
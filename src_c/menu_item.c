@@ -25,8 +25,10 @@ check_menu_item_type_valid(MenuItemObject *menu_item) {
 
 static MenuItemObject *
 new_menu_item() {
-    PyTypeObject *cls = pwt_globals.MenuItemType;
-    return (MenuItemObject *)(cls->tp_alloc(cls, 0));
+    // dynamic menus create and drop many items, they are recycled
+    return (MenuItemObject *)pwt_free_list_alloc(
+        PWT_FREE_LIST_MENU_ITEM, pwt_globals.MenuItemType
+    );
 }
 
 static int
@@ -44,10 +46,38 @@ init_menu_item_generic(MenuItemObject *self) {
     self->checked = FALSE;
     self->radio = FALSE;
     self->sub = NULL;
+    self->group = NULL;
+    self->links = NULL;
+    self->links_count = 0;
+    self->links_capacity = 0;
+    self->wide_label = NULL;
 
     return 0;
 }
 
+MenuItemObject *
+menu_item_create(
+    MenuItemTypeEnum type, PyObject *label, BOOL enabled,
+    PyObject *callback, BOOL checked, BOOL radio
+) {
+    MenuItemObject *self = new_menu_item();
+    if(!self) {
+        return NULL;
+    }
+    if(init_menu_item_generic(self)<0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    self->type = type;
+    self->string = Py_XNewRef(label);
+    self->enabled = enabled;
+    self->callback = Py_XNewRef(callback);
+    self->checked = checked;
+    self->radio = radio;
+    return self;
+}
+
 static PyObject *
 menu_item_separator(PyObject *cls, PyObject *args) {
     MenuItemObject *self = new_menu_item();
@@ -105,25 +135,32 @@ menu_item_string(PyObject *cls, PyObject *args, PyObject* kwargs) {
 
 static PyObject *
 menu_item_check(PyObject *cls, PyObject *args, PyObject* kwargs) {
-    static char *kwlist[] = {"label", "radio", "checked", "enabled", "callback", NULL};
+    static char *kwlist[] = {"label", "radio", "checked", "enabled", "callback", "group", NULL};
 
     PyObject *string_obj = NULL;
     PyObject *callback_obj = Py_None;
+    PyObject *group_obj = Py_None;
 
     BOOL checked = FALSE;
     BOOL radio = FALSE;
     BOOL enabled = TRUE;
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "U|pppO", kwlist,
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "U|pppOO", kwlist,
         &string_obj,
         &radio,
         &checked,
         &enabled,
-        &callback_obj
+        &callback_obj,
+        &group_obj
     )) {
         return NULL;
     }
 
+    if (!Py_IsNone(group_obj) && !PyObject_TypeCheck(group_obj, pwt_globals.RadioGroupType)) {
+        PyErr_SetString(PyExc_TypeError, "Group should be a RadioGroup or None");
+        return NULL;
+    }
+
     if (!Py_IsNone(callback_obj) && !PyCallable_Check(callback_obj)) {
         PyErr_SetString(PyExc_TypeError, "Callback should be callable or None");
         return NULL;
@@ -142,13 +179,25 @@ menu_item_check(PyObject *cls, PyObject *args, PyObject* kwargs) {
     self->string = string_obj;
     Py_INCREF(string_obj);
     self->enabled = TRUE;
-    self->checked = checked;
+    self->checked = FALSE;
     self->radio = radio;
     if (!Py_IsNone(callback_obj)) {
         self->callback = callback_obj;
         Py_INCREF(callback_obj);
     }
 
+    if (Py_IsNone(group_obj)) {
+        self->checked = checked;
+    }
+    else {
+        // a grouped item is always drawn as a radio item
+        self->radio = TRUE;
+        self->group = (RadioGroupObject *)Py_NewRef(group_obj);
+        if (checked) {
+            radio_group_select(self->group, self);
+        }
+    }
+
     return (PyObject *)self;
 }
 
@@ -214,14 +263,27 @@ menu_item_submenu_decorator(MenuItemObject* self, PyObject *arg) {
         return NULL;
     }
 
-    self->sub = (MenuTypeObject *)arg;
-    
-    Py_INCREF(arg);
-    Py_INCREF(self);
+    if (!menu_item_attach_submenu(self, (MenuTypeObject *)arg)) {
+        return NULL;
+    }
 
+    Py_INCREF(self);
     return (PyObject *)self;
 }
 
+BOOL
+menu_item_attach_submenu(MenuItemObject *item, MenuTypeObject *sub) {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL result = menu_add_parent_item(sub, item);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    if (!result) {
+        return FALSE;
+    }
+
+    item->sub = (MenuTypeObject *)Py_NewRef(sub);
+    return TRUE;
+}
+
 static PyObject *
 menu_item_register_callback(MenuItemObject* self, PyObject *arg) {
     if (
@@ -267,21 +329,176 @@ static PyMethodDef menu_item_methods[] = {
     {NULL, NULL, 0, NULL}
 };
 
+void
+post_update_message() {
+    PWT_ENTER_ACTIVE_MENUS_CS();
+    for (MenuTypeObject *menu=pwt_globals.active_menus;menu;menu=menu->active_next) {
+        // at most one message is waiting for each popup,
+        // the window proc writes all the dirty items at once
+        LONG is_posted = PWT_SET_ATOMIC(menu->atomic_update_posted);
+        if (is_posted) {
+            continue;
+        }
+        PostMessage(menu->parent_window, PYWINTRAY_MENU_UPDATE_MESSAGE, 0, 0);
+    }
+    PWT_LEAVE_ACTIVE_MENUS_CS();
+
+    post_presync_message();
+}
+
+// The flags share one word with the type, so they are written
+// under the same lock the sync loops read them with.
+#define SET_MENU_ITEM_FLAG(menu_item, flag, value) { \
+    PWT_ENTER_MENU_INSERT_DELETE_CS(); \
+    (menu_item)->flag = (value); \
+    BOOL marked = mark_menu_item_changed(menu_item); \
+    PWT_LEAVE_MENU_INSERT_DELETE_CS(); \
+    if (marked) { \
+        post_update_message(); \
+    } \
+}
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+mark_menu_item_changed(MenuItemObject *menu_item) {
+    menu_item->update_counter++;
+    return menu_item_mark_dirty(menu_item);
+}
+
 static void
-post_update_message(MenuItemObject *menu_item) {
-    UINT hwnd_u32;
-    Py_ssize_t pos = 0;
+notify_menu_item_changed(MenuItemObject *menu_item) {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    BOOL marked = mark_menu_item_changed(menu_item);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
 
-    idm_enter_critical_section(pwt_globals.active_menus_idm);
-    while (idm_next(pwt_globals.active_menus_idm, &pos, &hwnd_u32, NULL)) {
-        if (hwnd_u32==((UINT)-1) && PyErr_Occurred()) {
-            PyErr_Print();
+    // if nothing is newly marked,
+    // the dirty items are not drained yet and a message is pending
+    if (marked) {
+        post_update_message();
+    }
+}
+
+#define LABEL_INTERN_KEY(hash) ((UINT)((hash)^((hash)>>32)))
+
+// Find an interned label with the same text.
+// Returns NULL if not found or failed (check PyErr_Occurred())
+static WideLabel *
+label_intern_lookup(const WideLabel *label) {
+    WideLabel *found = idm_get_data_by_id(pwt_globals.label_intern_idm, LABEL_INTERN_KEY(label->hash));
+    for (;found;found=found->intern_next) {
+        if (found->hash!=label->hash || found->length!=label->length) {
             continue;
         }
-        HWND hwnd = (HWND)(intptr_t)hwnd_u32;
-        PostMessage(hwnd, PYWINTRAY_MENU_UPDATE_MESSAGE, 0, (LPARAM)menu_item);
+        Py_ssize_t i = 0;
+        while (i<label->length && found->text[i]==label->text[i]) {
+            i++;
+        }
+        if (i==label->length) {
+            return found;
+        }
     }
-    idm_leave_critical_section(pwt_globals.active_menus_idm);
+    return NULL;
+}
+
+static BOOL
+label_intern_insert(WideLabel *label) {
+    UINT key = LABEL_INTERN_KEY(label->hash);
+    WideLabel *head = idm_get_data_by_id(pwt_globals.label_intern_idm, key);
+    if (!head && PyErr_Occurred()) {
+        return FALSE;
+    }
+    label->intern_next = head;
+    if (!idm_put_id(pwt_globals.label_intern_idm, key, label)) {
+        label->intern_next = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+label_intern_remove(WideLabel *label) {
+    UINT key = LABEL_INTERN_KEY(label->hash);
+    WideLabel *head = idm_get_data_by_id(pwt_globals.label_intern_idm, key);
+    if (head==label) {
+        BOOL result;
+        if (label->intern_next) {
+            result = idm_put_id(pwt_globals.label_intern_idm, key, label->intern_next);
+        }
+        else {
+            result = idm_delete_id(pwt_globals.label_intern_idm, key);
+        }
+        if (!result) {
+            PyErr_Print();
+        }
+    }
+    else {
+        WideLabel *prev = head;
+        while (prev && prev->intern_next!=label) {
+            prev = prev->intern_next;
+        }
+        if (prev) {
+            prev->intern_next = label->intern_next;
+        }
+    }
+    label->intern_next = NULL;
+}
+
+// Convert the string, or share the interned label with the same text
+static WideLabel *
+acquire_wide_label(PyObject *string) {
+    // including the null terminator
+    Py_ssize_t size = PyUnicode_AsWideChar(string, NULL, 0);
+    if (size<0) {
+        return NULL;
+    }
+    WideLabel *label = PyMem_RawMalloc(sizeof(WideLabel)+size*sizeof(WCHAR));
+    if (!label) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (PyUnicode_AsWideChar(string, label->text, size)<0) {
+        PyMem_RawFree(label);
+        return NULL;
+    }
+    label->intern_next = NULL;
+    label->refcount = 1;
+    label->length = size-1;
+    label->hash = xxh64(label->text, label->length*(Py_ssize_t)sizeof(WCHAR), 0);
+
+    WideLabel *found = label_intern_lookup(label);
+    if (found || PyErr_Occurred()) {
+        PyMem_RawFree(label);
+        if (found) {
+            found->refcount++;
+        }
+        return found;
+    }
+
+    if (!label_intern_insert(label)) {
+        PyMem_RawFree(label);
+        return NULL;
+    }
+    return label;
+}
+
+static void
+release_wide_label(WideLabel *label) {
+    if (--(label->refcount)) {
+        return;
+    }
+    label_intern_remove(label);
+    PyMem_RawFree(label);
+}
+
+const WCHAR *
+menu_item_get_wide_label(MenuItemObject *item) {
+    if (!item->wide_label) {
+        item->wide_label = acquire_wide_label(item->string);
+        if (!item->wide_label) {
+            return NULL;
+        }
+    }
+    return item->wide_label->text;
 }
 
 static PyObject *
@@ -318,11 +535,18 @@ menu_item_set_label(MenuItemObject *self, PyObject *value, void *closure) {
         PyErr_SetString(PyExc_TypeError, "Type of 'label' must be str");
         return -1;
     }
-    Py_DECREF(self->string);
-    self->string = value;
-    Py_INCREF(self->string);
-    self->update_counter++;
-    post_update_message(self);
+    PyObject *old_string = self->string;
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    self->string = Py_NewRef(value);
+    // converted again when written
+    if (self->wide_label) {
+        release_wide_label(self->wide_label);
+        self->wide_label = NULL;
+    }
+    menu_update_search_index(self, old_string);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    Py_DECREF(old_string);
+    notify_menu_item_changed(self);
     return 0;
 }
 
@@ -348,9 +572,17 @@ menu_item_set_checked(MenuItemObject *self, PyObject *value, void *closure) {
     if(result<0) {
         return -1;
     }
-    self->checked = result;
-    self->update_counter++;
-    post_update_message(self);
+    if (self->group) {
+        // the other items of the group are unchecked
+        if (result) {
+            radio_group_select(self->group, self);
+        }
+        else if (self->checked) {
+            radio_group_select(self->group, NULL);
+        }
+        return 0;
+    }
+    SET_MENU_ITEM_FLAG(self, checked, result);
     return 0;
 }
 
@@ -376,12 +608,37 @@ menu_item_set_radio(MenuItemObject *self, PyObject *value, void *closure) {
     if(result<0) {
         return -1;
     }
-    self->radio = result;
-    self->update_counter++;
-    post_update_message(self);
+    SET_MENU_ITEM_FLAG(self, radio, result);
     return 0;
 }
 
+static PyObject *
+menu_item_get_group(MenuItemObject *self, void *closure) {
+    if(self->type!=MENU_ITEM_TYPE_CHECK) {
+        PyErr_SetString(PyExc_TypeError, "This property is for check only");
+        return NULL;
+    }
+    if (!self->group) {
+        Py_RETURN_NONE;
+    }
+    return Py_NewRef(self->group);
+}
+
+static PyObject *
+menu_item_get_callback(MenuItemObject *self, void *closure) {
+    if (
+        (self->type!=MENU_ITEM_TYPE_STRING) &&
+        (self->type!=MENU_ITEM_TYPE_CHECK)
+    ) {
+        PyErr_SetString(PyExc_TypeError, "This menu item doesn't support callback");
+        return NULL;
+    }
+    if (!self->callback) {
+        Py_RETURN_NONE;
+    }
+    return Py_NewRef(self->callback);
+}
+
 static PyObject *
 menu_item_get_enabled(MenuItemObject *self, void *closure) {
     if(self->type==MENU_ITEM_TYPE_SEPARATOR) {
@@ -404,9 +661,7 @@ menu_item_set_enabled(MenuItemObject *self, PyObject *value, void *closure) {
     if(result<0) {
         return -1;
     }
-    self->enabled = result;
-    self->update_counter++;
-    post_update_message(self);
+    SET_MENU_ITEM_FLAG(self, enabled, result);
     return 0;
 }
 
@@ -438,6 +693,8 @@ static PyGetSetDef menu_item_getset[] = {
     {"label", (getter)menu_item_get_label, (setter)menu_item_set_label, NULL, NULL},
     {"checked", (getter)menu_item_get_checked, (setter)menu_item_set_checked, NULL, NULL},
     {"radio", (getter)menu_item_get_radio, (setter)menu_item_set_radio, NULL, NULL},
+    {"group", (getter)menu_item_get_group, (setter)NULL, NULL, NULL},
+    {"callback", (getter)menu_item_get_callback, (setter)NULL, NULL, NULL},
     {"enabled", (getter)menu_item_get_enabled, (setter)menu_item_set_enabled, NULL, NULL},
     {"type", (getter)menu_item_get_type, (setter)NULL, NULL, NULL},
     {NULL, NULL, NULL, NULL, NULL}
@@ -451,8 +708,28 @@ menu_item_dealloc(MenuItemObject *self) {
     }
     Py_XDECREF(self->string);
     Py_XDECREF(self->callback);
-    Py_XDECREF(self->sub);
-    Py_TYPE(self)->tp_free((PyObject *)self);
+    if (self->sub) {
+        PWT_ENTER_MENU_INSERT_DELETE_CS();
+        menu_remove_parent_item(self->sub, self);
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+        Py_DECREF(self->sub);
+    }
+    if (self->wide_label) {
+        PWT_ENTER_MENU_INSERT_DELETE_CS();
+        release_wide_label(self->wide_label);
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    }
+    if (self->group) {
+        PWT_ENTER_MENU_INSERT_DELETE_CS();
+        if (self->group->selected==self) {
+            self->group->selected = NULL;
+        }
+        PWT_LEAVE_MENU_INSERT_DELETE_CS();
+        Py_DECREF(self->group);
+    }
+    // an item in a menu is referenced by the menu, no link is left
+    PyMem_RawFree(self->links);
+    pwt_free_list_free(PWT_FREE_LIST_MENU_ITEM, (PyObject *)self);
 }
 
 static PyObject*
@@ -477,6 +754,12 @@ menu_item_repr(MenuItemObject *self) {
 
 PyTypeObject *
 create_menu_item_type(PyObject *module) {
+    // the type and the flags must fit in the word after the id,
+    // 96 bytes on 64-bit release builds
+    Py_BUILD_ASSERT(
+        sizeof(MenuItemObject)==sizeof(PyObject)+2*sizeof(UINT)+9*sizeof(void *)
+    );
+
     static PyType_Spec menu_item_metaclass_spec;
 
     PyType_Slot menu_item_metaclass_slots[] = {
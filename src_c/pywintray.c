@@ -54,6 +54,82 @@ pywintray_load_icon(PyObject* self, PyObject* args, PyObject* kwargs) {
     return (PyObject *)new_icon_handle(icon_handle, TRUE);
 }
 
+static PyObject*
+pywintray_resample(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char *kwlist[] = {"buffer", "width", "height", "sizes", "filter", NULL};
+
+    Py_buffer buffer;
+    int width, height;
+    PyObject *sizes_obj;
+    PyObject *filter_obj = NULL;
+    ResampleFilter filter;
+    int *sizes = NULL;
+    int sizes_count = 0;
+    PyObject *outputs[PWT_ICON_SIZE_CACHE_LENGTH] = {NULL};
+    BYTE *dst[PWT_ICON_SIZE_CACHE_LENGTH];
+    PyObject *result = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*iiO|U", kwlist,
+        &buffer, &width, &height, &sizes_obj, &filter_obj
+    )) {
+        return NULL;
+    }
+
+    if (width<=0 || height<=0 || width>PWT_IMAGE_MAX_SIZE || height>PWT_IMAGE_MAX_SIZE) {
+        PyErr_Format(PyExc_ValueError, "'width' and 'height' must in range [1, %d]", PWT_IMAGE_MAX_SIZE);
+        goto clean_up;
+    }
+    if (buffer.len!=(Py_ssize_t)width*height*4) {
+        PyErr_SetString(PyExc_ValueError, "Size of 'buffer' must be width*height*4 (BGRA)");
+        goto clean_up;
+    }
+    if (!parse_resample_filter(filter_obj, &filter)) {
+        goto clean_up;
+    }
+    sizes = parse_resample_sizes(sizes_obj, &sizes_count);
+    if (!sizes) {
+        goto clean_up;
+    }
+
+    // write to the bytes objects directly
+    for (int i=0;i<sizes_count;i++) {
+        outputs[i] = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)sizes[i]*sizes[i]*4);
+        if (!outputs[i]) {
+            goto clean_up;
+        }
+        dst[i] = (BYTE *)PyBytes_AS_STRING(outputs[i]);
+    }
+
+    BOOL resample_ok;
+    Py_BEGIN_ALLOW_THREADS
+    resample_ok = resample_bgra(
+        buffer.buf, width, height, (Py_ssize_t)width*4,
+        filter, sizes_count, sizes, dst
+    );
+    Py_END_ALLOW_THREADS
+    if (!resample_ok) {
+        PyErr_NoMemory();
+        goto clean_up;
+    }
+
+    result = PyList_New(sizes_count);
+    if (!result) {
+        goto clean_up;
+    }
+    for (int i=0;i<sizes_count;i++) {
+        PyList_SET_ITEM(result, i, outputs[i]);
+        outputs[i] = NULL;
+    }
+
+clean_up:
+    for (int i=0;i<sizes_count;i++) {
+        Py_XDECREF(outputs[i]);
+    }
+    PyMem_Free(sizes);
+    PyBuffer_Release(&buffer);
+    return result;
+}
+
 static PyObject*
 pywintray_stop_tray_loop(PyObject* self, PyObject* args) {
     PWT_ENTER_TRAY_WINDOW_CS();
@@ -101,6 +177,8 @@ pywintray_start_tray_loop(PyObject* self, PyObject* args) {
         }
     }
 
+    pwt_globals.tray_icon_size = GetSystemMetrics(SM_CXSMICON);
+
     // add icons
     idm_enter_critical_section(pwt_globals.tray_icon_idm);
     {
@@ -129,8 +207,14 @@ clean_up_level_1:
         return NULL;
     }
 
+    // a message posted to the previous tray window may be lost
+    PWT_RESET_ATOMIC(pwt_globals.atomic_presync_posted);
+
     PWT_LEAVE_TRAY_WINDOW_CS();
 
+    // write the changes made before the loop started
+    post_presync_message();
+
     MSG msg;
     BOOL result;
     DWORD error_code = 0;
@@ -190,6 +274,77 @@ clean_up_level_1:
     Py_RETURN_NONE;
 }
 
+static PyObject*
+pywintray_set_icon_handle_budget(PyObject *self, PyObject *args, PyObject* kwargs) {
+    static char *kwlist[] = {"budget", NULL};
+
+    Py_ssize_t budget;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n", kwlist, &budget)) {
+        return NULL;
+    }
+    if (budget<0) {
+        PyErr_SetString(PyExc_ValueError, "budget must be >= 0");
+        return NULL;
+    }
+
+    PWT_ENTER_ICON_HANDLE_CS();
+    pwt_globals.icon_registry.budget = budget;
+    icon_handle_enforce_budget(NULL);
+    PWT_LEAVE_ICON_HANDLE_CS();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+pywintray_get_icon_handle_stats(PyObject *self, PyObject *args) {
+    IconHandleRegistry registry;
+    Py_ssize_t unevictable = 0;
+
+    PWT_ENTER_ICON_HANDLE_CS();
+    registry = pwt_globals.icon_registry;
+    // the owned icons that have no pixels to be re-created from
+    for (IconHandleObject *icon=registry.lru_head;icon;icon=icon->lru_next) {
+        if (icon->need_free && icon->icon_handle && !icon->pixels) {
+            unevictable++;
+        }
+    }
+    PWT_LEAVE_ICON_HANDLE_CS();
+
+    return Py_BuildValue(
+        "{s:n,s:n,s:n,s:n,s:n,s:n,s:n}",
+        "live", registry.live,
+        "budget", registry.budget,
+        "evicted", registry.evicted,
+        "unevictable", unevictable,
+        "evictions", registry.total_evictions,
+        "rematerializations", registry.total_rematerializations,
+        "intern_hits", registry.total_intern_hits
+    );
+}
+
+static PyObject *
+free_list_stats(PWTFreeListKind kind) {
+    PWTFreeListStats stats;
+    pwt_free_list_stats(kind, &stats);
+    return Py_BuildValue(
+        "{s:n,s:n,s:n,s:n}",
+        "hits", stats.hits,
+        "misses", stats.misses,
+        "retained", stats.retained,
+        "retained_bytes", stats.retained_bytes
+    );
+}
+
+static PyObject*
+pywintray_get_free_list_stats(PyObject *self, PyObject *args) {
+    return Py_BuildValue(
+        "{s:N,s:N}",
+        "menu_item", free_list_stats(PWT_FREE_LIST_MENU_ITEM),
+        "tray_icon", free_list_stats(PWT_FREE_LIST_TRAY_ICON)
+    );
+}
+
 static PyObject*
 pywintray_wait_for_tray_loop_ready(PyObject *self, PyObject *args, PyObject* kwargs) {
     static char *kwlist[] = {"timeout", NULL};
@@ -299,15 +454,55 @@ finally:
     return 0;
 }
 
+static void
+handle_dpi_change() {
+    // the icon size depends on the dpi,
+    // re-send all the icons to pick the new size
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PWT_ENTER_TRAY_WINDOW_CS();
+    int size = GetSystemMetrics(SM_CXSMICON);
+    if (size==pwt_globals.tray_icon_size) {
+        PWT_LEAVE_TRAY_WINDOW_CS();
+        PyGILState_Release(gstate);
+        return;
+    }
+    pwt_globals.tray_icon_size = size;
+    idm_enter_critical_section(pwt_globals.tray_icon_idm);
+    {
+        TrayIconObject *value;
+        Py_ssize_t pos = 0;
+        while (idm_next(pwt_globals.tray_icon_idm, &pos, NULL, &value)) {
+            if(!value) {
+                break;
+            }
+            if (!update_tray_icon(value, NIM_MODIFY, NIF_ICON, NULL)) {
+                PyErr_Print();
+            }
+        }
+    }
+    idm_leave_critical_section(pwt_globals.tray_icon_idm);
+    PWT_LEAVE_TRAY_WINDOW_CS();
+    PyGILState_Release(gstate);
+}
+
 static LRESULT CALLBACK
 tray_window_proc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
+        // WM_DPICHANGED is only sent to visible windows,
+        // the hidden tray window sees the dpi change by the broadcasts
+        case WM_SETTINGCHANGE:
+        case WM_DISPLAYCHANGE:
+            handle_dpi_change();
+            break;
         case PYWINTRAY_TRAY_END_LOOP:
             // stop the message loop
             PostQuitMessage(0);
             return 0;
         case PYWINTRAY_TRAY_MESSAGE:
             return handle_tray_message((UINT)lParam, (UINT)wParam);
+        case PYWINTRAY_MENU_PRESYNC_MESSAGE:
+            handle_presync_message();
+            return 0;
     }
 
     return DefWindowProc(hWnd, uMsg, wParam, lParam);
@@ -317,6 +512,10 @@ static PyMethodDef pywintray_methods[] = {
     {"start_tray_loop", (PyCFunction)pywintray_start_tray_loop, METH_NOARGS, NULL},
     {"stop_tray_loop", (PyCFunction)pywintray_stop_tray_loop, METH_NOARGS, NULL},
     {"load_icon", (PyCFunction)pywintray_load_icon, METH_VARARGS|METH_KEYWORDS, NULL},
+    {"resample", (PyCFunction)pywintray_resample, METH_VARARGS|METH_KEYWORDS, NULL},
+    {"set_icon_handle_budget", (PyCFunction)pywintray_set_icon_handle_budget, METH_VARARGS|METH_KEYWORDS, NULL},
+    {"get_icon_handle_stats", (PyCFunction)pywintray_get_icon_handle_stats, METH_NOARGS, NULL},
+    {"get_free_list_stats", (PyCFunction)pywintray_get_free_list_stats, METH_NOARGS, NULL},
     {"wait_for_tray_loop_ready", (PyCFunction)pywintray_wait_for_tray_loop_ready, METH_VARARGS|METH_KEYWORDS, NULL},
     {NULL, NULL, 0, NULL}
 };
@@ -333,9 +532,17 @@ pywintray_free(void *self) {
         pwt_globals.menu_item_idm = NULL;
     }
 
-    if (pwt_globals.active_menus_idm) {
-        idm_delete(pwt_globals.active_menus_idm);
-        pwt_globals.active_menus_idm = NULL;
+    if (pwt_globals.popup_host_fls_index!=FLS_OUT_OF_INDEXES) {
+        FlsFree(pwt_globals.popup_host_fls_index);
+        pwt_globals.popup_host_fls_index = FLS_OUT_OF_INDEXES;
+    }
+    if (pwt_globals.icon_intern_idm) {
+        idm_delete(pwt_globals.icon_intern_idm);
+        pwt_globals.icon_intern_idm = NULL;
+    }
+    if (pwt_globals.label_intern_idm) {
+        idm_delete(pwt_globals.label_intern_idm);
+        pwt_globals.label_intern_idm = NULL;
     }
 
     if (pwt_globals.tray_loop_ready_event) {
@@ -343,8 +550,18 @@ pywintray_free(void *self) {
         pwt_globals.tray_loop_ready_event = NULL;
     }
 
+    if (pwt_globals.popup_thread_ready_event) {
+        CloseHandle(pwt_globals.popup_thread_ready_event);
+        pwt_globals.popup_thread_ready_event = NULL;
+    }
+
+    pwt_free_lists_clear();
+
     DeleteCriticalSection(&(pwt_globals.tray_window_cs));
     DeleteCriticalSection(&(pwt_globals.menu_insert_delete_cs));
+    DeleteCriticalSection(&(pwt_globals.active_menus_cs));
+    DeleteCriticalSection(&(pwt_globals.icon_handle_cs));
+    DeleteCriticalSection(&(pwt_globals.popup_thread_cs));
 }
 
 static PyModuleDef pywintray_module = {
@@ -363,8 +580,14 @@ PyInit_pywintray(void)
 
     pwt_globals.tray_icon_idm = NULL;
     pwt_globals.menu_item_idm = NULL;
+    pwt_globals.popup_host_fls_index = FLS_OUT_OF_INDEXES;
+
+    if (!pwt_free_lists_init()) {
+        goto error_clean_up;
+    }
 
     pwt_globals.tray_window = NULL;
+    pwt_globals.tray_icon_size = 0;
     pwt_globals.atomic_tray_loop_started = 0;
 
     module_obj = PyModule_Create(&pywintray_module);
@@ -382,8 +605,19 @@ PyInit_pywintray(void)
         goto error_clean_up;
     }
 
-    pwt_globals.active_menus_idm = idm_new(FALSE);
-    if(!pwt_globals.active_menus_idm) {
+    pwt_globals.popup_host_fls_index = FlsAlloc(free_popup_host_pool);
+    if (pwt_globals.popup_host_fls_index==FLS_OUT_OF_INDEXES) {
+        PyErr_SetFromWindowsErr(0);
+        goto error_clean_up;
+    }
+
+    pwt_globals.icon_intern_idm = idm_new(FALSE);
+    if(!pwt_globals.icon_intern_idm) {
+        goto error_clean_up;
+    }
+
+    pwt_globals.label_intern_idm = idm_new(FALSE);
+    if(!pwt_globals.label_intern_idm) {
         goto error_clean_up;
     }
 
@@ -392,9 +626,36 @@ PyInit_pywintray(void)
         goto error_clean_up;
     }
 
+    pwt_globals.popup_thread_started = FALSE;
+    pwt_globals.popup_thread_id = 0;
+    pwt_globals.popup_thread_ready_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!pwt_globals.popup_thread_ready_event) {
+        goto error_clean_up;
+    }
+
     InitializeCriticalSection(&(pwt_globals.tray_window_cs));
 
     InitializeCriticalSection(&(pwt_globals.menu_insert_delete_cs));
+    pwt_globals.menu_visit_epoch = 0;
+    pwt_globals.menu_sync_generation = 0;
+
+    InitializeCriticalSection(&(pwt_globals.active_menus_cs));
+    pwt_globals.active_menus = NULL;
+    pwt_globals.presync_menus = NULL;
+    pwt_globals.atomic_presync_posted = FALSE;
+
+    InitializeCriticalSection(&(pwt_globals.icon_handle_cs));
+
+    InitializeCriticalSection(&(pwt_globals.popup_thread_cs));
+
+    pwt_globals.icon_registry.live = 0;
+    pwt_globals.icon_registry.budget = 0;
+    pwt_globals.icon_registry.evicted = 0;
+    pwt_globals.icon_registry.total_evictions = 0;
+    pwt_globals.icon_registry.total_rematerializations = 0;
+    pwt_globals.icon_registry.total_intern_hits = 0;
+    pwt_globals.icon_registry.lru_head = NULL;
+    pwt_globals.icon_registry.lru_tail = NULL;
 
     pwt_globals.MenuType = create_menu_type(module_obj);
     if (PyModule_AddType(module_obj, (PyTypeObject *)(pwt_globals.MenuType)) < 0) {
@@ -408,6 +669,18 @@ PyInit_pywintray(void)
     }
     Py_XDECREF(pwt_globals.MenuItemType);
 
+    pwt_globals.MenuBatchType = create_menu_batch_type(module_obj);
+    if (PyModule_AddType(module_obj, pwt_globals.MenuBatchType) < 0) {
+        goto error_clean_up;
+    }
+    Py_XDECREF(pwt_globals.MenuBatchType);
+
+    pwt_globals.RadioGroupType = create_radio_group_type(module_obj);
+    if (PyModule_AddType(module_obj, pwt_globals.RadioGroupType) < 0) {
+        goto error_clean_up;
+    }
+    Py_XDECREF(pwt_globals.RadioGroupType);
+
     pwt_globals.TrayIconType = create_tray_icon_type(module_obj);
     if (PyModule_AddType(module_obj, pwt_globals.TrayIconType) < 0) {
         goto error_clean_up;
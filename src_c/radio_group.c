@@ -0,0 +1,117 @@
+/*
+This file implements the pywintray.RadioGroup class
+*/
+
+#include "pywintray.h"
+
+// Caller must hold `menu_insert_delete_cs` critical section
+static BOOL
+set_checked_locked(MenuItemObject *item, BOOL checked) {
+    item->checked = checked;
+    item->update_counter++;
+    return menu_item_mark_dirty(item);
+}
+
+void
+radio_group_select(RadioGroupObject *group, MenuItemObject *item) {
+    BOOL marked = FALSE;
+
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    MenuItemObject *old = group->selected;
+    if (old && old!=item) {
+        marked |= set_checked_locked(old, FALSE);
+    }
+    if (item && (old!=item || !item->checked)) {
+        marked |= set_checked_locked(item, TRUE);
+    }
+    group->selected = item;
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+
+    // one message for both items
+    if (marked) {
+        post_update_message();
+    }
+}
+
+static PyObject *
+radio_group_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "", kwlist)) {
+        return NULL;
+    }
+
+    RadioGroupObject *self = (RadioGroupObject *)(cls->tp_alloc(cls, 0));
+    if (!self) {
+        return NULL;
+    }
+    self->selected = NULL;
+    return (PyObject *)self;
+}
+
+static PyObject *
+radio_group_get_selected(RadioGroupObject *self, void *closure) {
+    PWT_ENTER_MENU_INSERT_DELETE_CS();
+    PyObject *selected = (PyObject *)(self->selected);
+    if (!selected) {
+        selected = Py_None;
+    }
+    Py_INCREF(selected);
+    PWT_LEAVE_MENU_INSERT_DELETE_CS();
+    return selected;
+}
+
+static int
+radio_group_set_selected(RadioGroupObject *self, PyObject *value, void *closure) {
+    if (!value) {
+        PyErr_SetString(PyExc_AttributeError, "Can't delete attribute 'selected'");
+        return -1;
+    }
+    if (Py_IsNone(value)) {
+        radio_group_select(self, NULL);
+        return 0;
+    }
+    if (!PyObject_TypeCheck(value, pwt_globals.MenuItemType)) {
+        PyErr_SetString(PyExc_TypeError, "Value must be a MenuItem or None");
+        return -1;
+    }
+    if (((MenuItemObject *)value)->group!=self) {
+        PyErr_SetString(PyExc_ValueError, "The item is not in this group");
+        return -1;
+    }
+    radio_group_select(self, (MenuItemObject *)value);
+    return 0;
+}
+
+static PyGetSetDef radio_group_getset[] = {
+    {"selected", (getter)radio_group_get_selected, (setter)radio_group_set_selected, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static void
+radio_group_dealloc(RadioGroupObject *self) {
+    // the items keep the group alive, none is selected here
+    PyTypeObject *tp = Py_TYPE(self);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+PyTypeObject *
+create_radio_group_type(PyObject *module) {
+    static PyType_Spec spec;
+
+    PyType_Slot radio_group_slots[] = {
+        {Py_tp_getset, radio_group_getset},
+        {Py_tp_new, radio_group_new},
+        {Py_tp_dealloc, radio_group_dealloc},
+        {0, NULL}
+    };
+
+    spec.name = "pywintray.RadioGroup";
+    spec.basicsize = sizeof(RadioGroupObject);
+    spec.itemsize = 0;
+    spec.flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE;
+    spec.slots = radio_group_slots;
+
+    return (PyTypeObject *)PyType_FromModuleAndSpec(module, &spec, NULL);
+}
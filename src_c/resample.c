@@ -0,0 +1,390 @@
+/*
+This file implements the image resampler used to generate icon sizes
+*/
+
+#include "pywintray.h"
+
+// One pixel is 4 float channels (B, G, R, A),
+// which fits exactly in one 128-bit vector.
+// SSE2 is the baseline of x86/x64 and NEON is the baseline of ARM64,
+// so no runtime cpu detection is needed.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+
+#include <emmintrin.h>
+typedef __m128 Pixel4f;
+#define PIXEL4F_ZERO() (_mm_setzero_ps())
+#define PIXEL4F_LOAD(p) (_mm_loadu_ps(p))
+#define PIXEL4F_STORE(p, v) (_mm_storeu_ps((p), (v)))
+#define PIXEL4F_MADD(acc, v, w) (_mm_add_ps((acc), _mm_mul_ps((v), _mm_set1_ps(w))))
+
+#elif defined(_M_ARM64) || defined(__aarch64__)
+
+#include <arm_neon.h>
+typedef float32x4_t Pixel4f;
+#define PIXEL4F_ZERO() (vdupq_n_f32(0.0f))
+#define PIXEL4F_LOAD(p) (vld1q_f32(p))
+#define PIXEL4F_STORE(p, v) (vst1q_f32((p), (v)))
+#define PIXEL4F_MADD(acc, v, w) (vmlaq_n_f32((acc), (v), (w)))
+
+#else
+
+typedef struct {
+    float c[4];
+} Pixel4f;
+
+static inline Pixel4f
+pixel4f_zero() {
+    Pixel4f result = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    return result;
+}
+
+static inline Pixel4f
+pixel4f_load(const float *p) {
+    Pixel4f result = {{p[0], p[1], p[2], p[3]}};
+    return result;
+}
+
+static inline void
+pixel4f_store(float *p, Pixel4f v) {
+    p[0] = v.c[0];
+    p[1] = v.c[1];
+    p[2] = v.c[2];
+    p[3] = v.c[3];
+}
+
+static inline Pixel4f
+pixel4f_madd(Pixel4f acc, Pixel4f v, float w) {
+    acc.c[0] += v.c[0]*w;
+    acc.c[1] += v.c[1]*w;
+    acc.c[2] += v.c[2]*w;
+    acc.c[3] += v.c[3]*w;
+    return acc;
+}
+
+#define PIXEL4F_ZERO() (pixel4f_zero())
+#define PIXEL4F_LOAD(p) (pixel4f_load(p))
+#define PIXEL4F_STORE(p, v) (pixel4f_store((p), (v)))
+#define PIXEL4F_MADD(acc, v, w) (pixel4f_madd((acc), (v), (w)))
+
+#endif
+
+#define PI 3.14159265358979323846
+
+// The module is linked without the C runtime,
+// so the sine is implemented here.
+static double
+resample_sin(double x) {
+    // reduce to [-pi, pi]
+    while (x>PI) {
+        x -= 2*PI;
+    }
+    while (x<-PI) {
+        x += 2*PI;
+    }
+    // reduce to [-pi/2, pi/2]
+    if (x>PI/2) {
+        x = PI-x;
+    }
+    else if (x<-PI/2) {
+        x = -PI-x;
+    }
+    double x2 = x*x;
+    // taylor series, error < 1e-7 in [-pi/2, pi/2]
+    return x*(1.0-x2/6.0*(1.0-x2/20.0*(1.0-x2/42.0*(1.0-x2/72.0*(1.0-x2/110.0)))));
+}
+
+static double
+resample_sinc(double x) {
+    if (x==0.0) {
+        return 1.0;
+    }
+    x *= PI;
+    return resample_sin(x)/x;
+}
+
+static double
+resample_kernel(ResampleFilter filter, double x) {
+    switch (filter) {
+        case RESAMPLE_FILTER_BOX:
+            return (x>=-0.5 && x<0.5)?1.0:0.0;
+        case RESAMPLE_FILTER_LANCZOS3:
+            if (x<=-3.0 || x>=3.0) {
+                return 0.0;
+            }
+            return resample_sinc(x)*resample_sinc(x/3.0);
+    }
+    return 0.0;
+}
+
+static double
+resample_kernel_radius(ResampleFilter filter) {
+    switch (filter) {
+        case RESAMPLE_FILTER_BOX:
+            return 0.5;
+        case RESAMPLE_FILTER_LANCZOS3:
+            return 3.0;
+    }
+    return 0.0;
+}
+
+// Contributors of one destination pixel along one axis
+typedef struct {
+    int first;
+    int count;
+    // offset into the weight table
+    int weights;
+} ResampleSpan;
+
+typedef struct {
+    ResampleSpan *spans;
+    float *weights;
+} ResampleTable;
+
+static void
+resample_table_free(ResampleTable *table) {
+    PyMem_RawFree(table->spans);
+    PyMem_RawFree(table->weights);
+    table->spans = NULL;
+    table->weights = NULL;
+}
+
+static BOOL
+resample_table_init(ResampleTable *table, ResampleFilter filter, int src_len, int dst_len) {
+    double scale = (double)src_len/(double)dst_len;
+    // widen the kernel when downscaling
+    double filter_scale = scale>1.0?scale:1.0;
+    double radius = resample_kernel_radius(filter)*filter_scale;
+    int max_count = (int)(radius*2.0)+3;
+
+    table->spans = PyMem_RawMalloc(sizeof(ResampleSpan)*dst_len);
+    table->weights = PyMem_RawMalloc(sizeof(float)*dst_len*max_count);
+    if (!table->spans || !table->weights) {
+        resample_table_free(table);
+        return FALSE;
+    }
+
+    for (int i=0;i<dst_len;i++) {
+        double center = (i+0.5)*scale;
+        int first = (int)(center-radius);
+        int last = (int)(center+radius)+1;
+        if (first<0) {
+            first = 0;
+        }
+        if (last>src_len) {
+            last = src_len;
+        }
+
+        ResampleSpan *span = &(table->spans[i]);
+        float *weights = table->weights + i*max_count;
+        double total = 0.0;
+        int count = 0;
+
+        span->first = first;
+        span->weights = i*max_count;
+        for (int j=first;j<last && count<max_count;j++) {
+            double w = resample_kernel(filter, (j+0.5-center)/filter_scale);
+            weights[count++] = (float)w;
+            total += w;
+        }
+        if (total==0.0) {
+            // always keep the nearest pixel
+            int nearest = (int)center;
+            if (nearest>=src_len) {
+                nearest = src_len-1;
+            }
+            span->first = nearest;
+            weights[0] = 1.0f;
+            count = 1;
+            total = 1.0;
+        }
+        for (int j=0;j<count;j++) {
+            weights[j] = (float)(weights[j]/total);
+        }
+        span->count = count;
+    }
+    return TRUE;
+}
+
+static inline BYTE
+resample_to_byte(float v) {
+    if (v<=0.0f) {
+        return 0;
+    }
+    if (v>=255.0f) {
+        return 255;
+    }
+    return (BYTE)(v+0.5f);
+}
+
+// Resample the premultiplied float image to one size
+static BOOL
+resample_one(
+    const float *src, int src_w, int src_h,
+    ResampleFilter filter, int dst_w, int dst_h,
+    BYTE *dst
+) {
+    BOOL result = FALSE;
+    ResampleTable h_table = {NULL, NULL};
+    ResampleTable v_table = {NULL, NULL};
+    float *tmp = NULL;
+
+    if (!resample_table_init(&h_table, filter, src_w, dst_w)) {
+        goto clean_up;
+    }
+    if (!resample_table_init(&v_table, filter, src_h, dst_h)) {
+        goto clean_up;
+    }
+    tmp = PyMem_RawMalloc(sizeof(float)*4*dst_w*src_h);
+    if (!tmp) {
+        goto clean_up;
+    }
+
+    // horizontal pass
+    for (int y=0;y<src_h;y++) {
+        const float *src_row = src + (Py_ssize_t)y*src_w*4;
+        float *tmp_row = tmp + (Py_ssize_t)y*dst_w*4;
+        for (int x=0;x<dst_w;x++) {
+            const ResampleSpan *span = &(h_table.spans[x]);
+            const float *weights = h_table.weights + span->weights;
+            const float *p = src_row + span->first*4;
+            Pixel4f acc = PIXEL4F_ZERO();
+            for (int k=0;k<span->count;k++) {
+                acc = PIXEL4F_MADD(acc, PIXEL4F_LOAD(p+k*4), weights[k]);
+            }
+            PIXEL4F_STORE(tmp_row+x*4, acc);
+        }
+    }
+
+    // vertical pass, then un-premultiply
+    for (int y=0;y<dst_h;y++) {
+        const ResampleSpan *span = &(v_table.spans[y]);
+        const float *weights = v_table.weights + span->weights;
+        BYTE *dst_row = dst + (Py_ssize_t)y*dst_w*4;
+        for (int x=0;x<dst_w;x++) {
+            const float *p = tmp + ((Py_ssize_t)span->first*dst_w + x)*4;
+            Pixel4f acc = PIXEL4F_ZERO();
+            for (int k=0;k<span->count;k++) {
+                acc = PIXEL4F_MADD(acc, PIXEL4F_LOAD(p+(Py_ssize_t)k*dst_w*4), weights[k]);
+            }
+            float px[4];
+            PIXEL4F_STORE(px, acc);
+
+            BYTE alpha = resample_to_byte(px[3]);
+            BYTE *out = dst_row + x*4;
+            if (alpha) {
+                float unpremultiply = 255.0f/px[3];
+                out[0] = resample_to_byte(px[0]*unpremultiply);
+                out[1] = resample_to_byte(px[1]*unpremultiply);
+                out[2] = resample_to_byte(px[2]*unpremultiply);
+            }
+            else {
+                out[0] = out[1] = out[2] = 0;
+            }
+            out[3] = alpha;
+        }
+    }
+
+    result = TRUE;
+
+clean_up:
+    PyMem_RawFree(tmp);
+    resample_table_free(&h_table);
+    resample_table_free(&v_table);
+    return result;
+}
+
+BOOL
+resample_bgra(
+    const BYTE *src, int src_w, int src_h, Py_ssize_t src_stride,
+    ResampleFilter filter,
+    int count, const int *sizes, BYTE **dst
+) {
+    // convert to premultiplied float once,
+    // the result is shared by all the sizes
+    float *premultiplied = PyMem_RawMalloc(sizeof(float)*4*src_w*src_h);
+    if (!premultiplied) {
+        return FALSE;
+    }
+    for (int y=0;y<src_h;y++) {
+        const BYTE *src_row = src + y*src_stride;
+        float *row = premultiplied + (Py_ssize_t)y*src_w*4;
+        for (int x=0;x<src_w;x++) {
+            float alpha = (float)src_row[x*4+3];
+            float factor = alpha/255.0f;
+            row[x*4+0] = src_row[x*4+0]*factor;
+            row[x*4+1] = src_row[x*4+1]*factor;
+            row[x*4+2] = src_row[x*4+2]*factor;
+            row[x*4+3] = alpha;
+        }
+    }
+
+    BOOL result = TRUE;
+    for (int i=0;i<count;i++) {
+        if (!resample_one(premultiplied, src_w, src_h, filter, sizes[i], sizes[i], dst[i])) {
+            result = FALSE;
+            break;
+        }
+    }
+
+    PyMem_RawFree(premultiplied);
+    return result;
+}
+
+BOOL
+parse_resample_filter(PyObject *filter_obj, ResampleFilter *filter) {
+    if (!filter_obj || PyUnicode_EqualToUTF8(filter_obj, "lanczos")) {
+        *filter = RESAMPLE_FILTER_LANCZOS3;
+    }
+    else if (PyUnicode_EqualToUTF8(filter_obj, "box")) {
+        *filter = RESAMPLE_FILTER_BOX;
+    }
+    else {
+        PyErr_SetString(PyExc_ValueError, "Value of 'filter' must in ['lanczos', 'box']");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int *
+parse_resample_sizes(PyObject *sizes_obj, int *count) {
+    PyObject *sizes_seq = PySequence_Fast(sizes_obj, "'sizes' must be a sequence of int");
+    if (!sizes_seq) {
+        return NULL;
+    }
+    Py_ssize_t length = PySequence_Fast_GET_SIZE(sizes_seq);
+    if (length>PWT_ICON_SIZE_CACHE_LENGTH) {
+        PyErr_Format(PyExc_ValueError, "Too many sizes, at most %d", PWT_ICON_SIZE_CACHE_LENGTH);
+        Py_DECREF(sizes_seq);
+        return NULL;
+    }
+    int *sizes = PyMem_Malloc(sizeof(int)*(length?length:1));
+    if (!sizes) {
+        PyErr_NoMemory();
+        Py_DECREF(sizes_seq);
+        return NULL;
+    }
+    for (Py_ssize_t i=0;i<length;i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(sizes_seq, i);
+        if (!PyLong_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "'sizes' must be a sequence of int");
+            goto error_clean;
+        }
+        long size = PyLong_AsLong(item);
+        if (size==-1 && PyErr_Occurred()) {
+            goto error_clean;
+        }
+        if (size<=0 || size>PWT_ICON_MAX_SIZE) {
+            PyErr_Format(PyExc_ValueError, "Icon size must in range [1, %d]", PWT_ICON_MAX_SIZE);
+            goto error_clean;
+        }
+        sizes[i] = (int)size;
+    }
+    Py_DECREF(sizes_seq);
+    *count = (int)length;
+    return sizes;
+
+error_clean:
+    PyMem_Free(sizes);
+    Py_DECREF(sizes_seq);
+    return NULL;
+}
@@ -0,0 +1,227 @@
+/*
+This file implements the label index of Menu.filtered()
+*/
+
+#include "pywintray.h"
+
+struct SearchIndex {
+    // the data of each trigram key is a SearchPosting
+    IDManager *postings;
+};
+
+typedef struct {
+    MenuItemObject **items;
+    Py_ssize_t count;
+    Py_ssize_t capacity;
+} SearchPosting;
+
+static Py_UCS4
+fold_char(Py_UCS4 ch) {
+    if (ch<0x80) {
+        if (ch>='A' && ch<='Z') {
+            return ch+('a'-'A');
+        }
+        return ch;
+    }
+    if (ch<=0xFFFF) {
+        // a single character is converted in place of the pointer
+        return (Py_UCS4)(ULONG_PTR)CharLowerW((LPWSTR)(ULONG_PTR)ch);
+    }
+    return ch;
+}
+
+// Collisions are allowed, the candidates are checked against the query
+static UINT
+trigram_key(Py_UCS4 a, Py_UCS4 b, Py_UCS4 c) {
+    return (UINT)(a*0x9E3779B1u) ^ (UINT)(b*0x85EBCA77u) ^ (UINT)(c*0xC2B2AE3Du);
+}
+
+SearchIndex *
+search_index_new() {
+    SearchIndex *index = PyMem_RawMalloc(sizeof(SearchIndex));
+    if (!index) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    index->postings = idm_new(IDM_FLAGS_NONE);
+    if (!index->postings) {
+        PyMem_RawFree(index);
+        return NULL;
+    }
+    return index;
+}
+
+void
+search_index_free(SearchIndex *index) {
+    Py_ssize_t pos = 0;
+    SearchPosting *posting;
+    idm_enter_critical_section(index->postings);
+    while (idm_next(index->postings, &pos, NULL, (void **)&posting)) {
+        PyMem_RawFree(posting->items);
+        PyMem_RawFree(posting);
+    }
+    idm_leave_critical_section(index->postings);
+    idm_delete(index->postings);
+    PyMem_RawFree(index);
+}
+
+static BOOL
+posting_add(SearchIndex *index, UINT key, MenuItemObject *item) {
+    SearchPosting *posting = idm_get_data_by_id(index->postings, key);
+    if (!posting) {
+        if (PyErr_Occurred()) {
+            return FALSE;
+        }
+        posting = PyMem_RawMalloc(sizeof(SearchPosting));
+        if (!posting) {
+            PyErr_NoMemory();
+            return FALSE;
+        }
+        posting->items = NULL;
+        posting->count = 0;
+        posting->capacity = 0;
+        if (!idm_put_id(index->postings, key, posting)) {
+            PyMem_RawFree(posting);
+            return FALSE;
+        }
+    }
+    if (!pwt_array_reserve(
+        (void **)&(posting->items), &(posting->capacity),
+        posting->count+1, sizeof(MenuItemObject *)
+    )) {
+        PyErr_NoMemory();
+        return FALSE;
+    }
+    posting->items[posting->count++] = item;
+    return TRUE;
+}
+
+static BOOL
+posting_remove(SearchIndex *index, UINT key, MenuItemObject *item) {
+    SearchPosting *posting = idm_get_data_by_id(index->postings, key);
+    if (!posting) {
+        return !PyErr_Occurred();
+    }
+    for (Py_ssize_t i=0;i<posting->count;i++) {
+        if (posting->items[i]==item) {
+            posting->items[i] = posting->items[--(posting->count)];
+            break;
+        }
+    }
+    if (!posting->count) {
+        if (!idm_delete_id(index->postings, key)) {
+            PyErr_Print();
+            return TRUE;
+        }
+        PyMem_RawFree(posting->items);
+        PyMem_RawFree(posting);
+    }
+    return TRUE;
+}
+
+BOOL
+search_index_add(SearchIndex *index, MenuItemObject *item, PyObject *label) {
+    Py_ssize_t length = PyUnicode_GET_LENGTH(label);
+    int kind = PyUnicode_KIND(label);
+    const void *data = PyUnicode_DATA(label);
+
+    for (Py_ssize_t i=0;i+2<length;i++) {
+        UINT key = trigram_key(
+            fold_char(PyUnicode_READ(kind, data, i)),
+            fold_char(PyUnicode_READ(kind, data, i+1)),
+            fold_char(PyUnicode_READ(kind, data, i+2))
+        );
+        if (!posting_add(index, key, item)) {
+            // keep the index consistent
+            while (i--) {
+                // the caller drops the index if this fails too
+                posting_remove(index, trigram_key(
+                    fold_char(PyUnicode_READ(kind, data, i)),
+                    fold_char(PyUnicode_READ(kind, data, i+1)),
+                    fold_char(PyUnicode_READ(kind, data, i+2))
+                ), item);
+            }
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL
+search_index_remove(SearchIndex *index, MenuItemObject *item, PyObject *label) {
+    Py_ssize_t length = PyUnicode_GET_LENGTH(label);
+    int kind = PyUnicode_KIND(label);
+    const void *data = PyUnicode_DATA(label);
+
+    for (Py_ssize_t i=0;i+2<length;i++) {
+        if (!posting_remove(index, trigram_key(
+            fold_char(PyUnicode_READ(kind, data, i)),
+            fold_char(PyUnicode_READ(kind, data, i+1)),
+            fold_char(PyUnicode_READ(kind, data, i+2))
+        ), item)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL
+search_index_candidates(
+    SearchIndex *index, PyObject *query,
+    MenuItemObject ***pitems, Py_ssize_t *pcount
+) {
+    Py_ssize_t length = PyUnicode_GET_LENGTH(query);
+    int kind = PyUnicode_KIND(query);
+    const void *data = PyUnicode_DATA(query);
+
+    *pitems = NULL;
+    if (length<3) {
+        *pcount = -1;
+        return TRUE;
+    }
+
+    // the rarest trigram of the query gives the fewest candidates
+    SearchPosting *best = NULL;
+    for (Py_ssize_t i=0;i+2<length;i++) {
+        SearchPosting *posting = idm_get_data_by_id(index->postings, trigram_key(
+            fold_char(PyUnicode_READ(kind, data, i)),
+            fold_char(PyUnicode_READ(kind, data, i+1)),
+            fold_char(PyUnicode_READ(kind, data, i+2))
+        ));
+        if (!posting) {
+            if (PyErr_Occurred()) {
+                return FALSE;
+            }
+            // no label contains this trigram
+            *pcount = 0;
+            return TRUE;
+        }
+        if (!best || posting->count<best->count) {
+            best = posting;
+        }
+    }
+    *pitems = best->items;
+    *pcount = best->count;
+    return TRUE;
+}
+
+BOOL
+search_label_matches(PyObject *label, PyObject *query) {
+    Py_ssize_t label_length = PyUnicode_GET_LENGTH(label);
+    Py_ssize_t query_length = PyUnicode_GET_LENGTH(query);
+    int label_kind = PyUnicode_KIND(label), query_kind = PyUnicode_KIND(query);
+    const void *label_data = PyUnicode_DATA(label), *query_data = PyUnicode_DATA(query);
+
+    for (Py_ssize_t i=0;i+query_length<=label_length;i++) {
+        Py_ssize_t j = 0;
+        while (j<query_length &&
+               fold_char(PyUnicode_READ(label_kind, label_data, i+j)) ==
+               fold_char(PyUnicode_READ(query_kind, query_data, j))) {
+            j++;
+        }
+        if (j==query_length) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
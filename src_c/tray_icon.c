@@ -7,7 +7,7 @@ This file implements the pywintray.TrayIcon class
 typedef struct {
     PyObject* msg_str_obj;
     PyObject* title_str_obj;
-    HICON icon;
+    IconHandleObject *icon;
     DWORD flags;
 } ToastData;
 
@@ -33,9 +33,23 @@ update_tray_icon(
             return FALSE;
         }
     }
+
+    // the scaled icons are owned by IconHandle,
+    // hold the lock until the shell has made its own copy
+    PWT_ENTER_ICON_HANDLE_CS();
+
     if(flags&NIF_ICON){
         if (tray_icon->icon_handle){
-            notify_data.hIcon = tray_icon->icon_handle->icon_handle;
+            // the size of tray icon follows the current dpi
+            notify_data.hIcon = icon_handle_get_sized(
+                tray_icon->icon_handle,
+                GetSystemMetrics(SM_CXSMICON)
+            );
+            if (!notify_data.hIcon) {
+                // failed to re-create an evicted icon
+                RAISE_LAST_ERROR();
+                goto error_clean;
+            }
         }
     }
     if (flags&NIF_STATE) {
@@ -56,32 +70,49 @@ update_tray_icon(
             toast_data->msg_str_obj = tmp_str;
         } 
         else if (PyErr_Occurred()) {
-            return FALSE;
+            goto error_clean;
         }
 
         const Py_ssize_t msg_buf_size = sizeof(notify_data.szInfo)/sizeof(WCHAR);
         result = PyUnicode_AsWideChar(toast_data->msg_str_obj, notify_data.szInfo, msg_buf_size);
         Py_XDECREF(tmp_str);
         if(result < 0) {
-            return FALSE;
+            goto error_clean;
         }
 
         const Py_ssize_t title_buf_size = sizeof(notify_data.szInfoTitle)/sizeof(WCHAR);
         result = PyUnicode_AsWideChar(toast_data->title_str_obj, notify_data.szInfoTitle, title_buf_size);
         if(result < 0) {
-            return FALSE;
+            goto error_clean;
         }
 
         notify_data.dwInfoFlags = toast_data->flags;
-        notify_data.hBalloonIcon = toast_data->icon;
+        notify_data.hBalloonIcon = NULL;
+        if (toast_data->icon) {
+            // large icon
+            notify_data.hBalloonIcon = icon_handle_get_sized(
+                toast_data->icon,
+                GetSystemMetrics(SM_CXICON)
+            );
+            if (!notify_data.hBalloonIcon) {
+                // failed to re-create an evicted icon
+                RAISE_LAST_ERROR();
+                goto error_clean;
+            }
+        }
     }
 
     if(!Shell_NotifyIcon(message, &notify_data)) {
         RAISE_LAST_ERROR();
-        return FALSE;
+        goto error_clean;
     }
 
+    PWT_LEAVE_ICON_HANDLE_CS();
     return TRUE;
+
+error_clean:
+    PWT_LEAVE_ICON_HANDLE_CS();
+    return FALSE;
 }
 
 static PyObject *
@@ -92,7 +123,12 @@ tray_icon_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
     PyObject *tip = NULL;
 
     // new
-    TrayIconObject *self = (TrayIconObject *)PyType_GenericNew(cls, args, kwargs);
+    TrayIconObject *self = (TrayIconObject *)pwt_free_list_alloc(
+        PWT_FREE_LIST_TRAY_ICON, cls
+    );
+    if (!self) {
+        return NULL;
+    }
 
     // init struct
     self->id = 0;
@@ -120,6 +156,8 @@ tray_icon_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs) {
 
     Py_INCREF(icon_handle);
     self->icon_handle = (IconHandleObject *)icon_handle;
+    // icons used by a tray icon are never evicted
+    icon_handle_attach(self->icon_handle);
 
     if(tip==NULL) {
         tip = Py_BuildValue("s", "pywintray");
@@ -279,7 +317,6 @@ tray_icon_notify(TrayIconObject *self, PyObject *args, PyObject* kwargs) {
 
     BOOL no_sound = FALSE;
     PyObject *icon_obj = NULL;
-    HICON copied_icon = NULL;
 
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "UU|pO", kwlist, 
         &(toast_data.title_str_obj),
@@ -305,19 +342,8 @@ tray_icon_notify(TrayIconObject *self, PyObject *args, PyObject* kwargs) {
         }
         toast_data.flags |= NIIF_USER;
         toast_data.flags |= NIIF_LARGE_ICON;
-        // convert as large icon
-        copied_icon = CopyImage(
-            ((IconHandleObject *)icon_obj)->icon_handle, 
-            IMAGE_ICON, 
-            GetSystemMetrics(SM_CXICON),
-            GetSystemMetrics(SM_CYICON),
-            LR_COPYFROMRESOURCE
-        );
-        if (!copied_icon) {
-            RAISE_LAST_ERROR();
-            return NULL;
-        }
-        toast_data.icon = copied_icon;
+        // the large icon is picked from the size cache in update_tray_icon
+        toast_data.icon = (IconHandleObject *)icon_obj;
     }
 
     if (no_sound) {
@@ -331,10 +357,6 @@ tray_icon_notify(TrayIconObject *self, PyObject *args, PyObject* kwargs) {
     }
     PWT_LEAVE_TRAY_WINDOW_CS();
 
-    if (copied_icon) {
-        DestroyIcon(copied_icon);
-    }
-
     if (!result) {
         return NULL;
     }
@@ -433,6 +455,7 @@ tray_icon_set_icon_handle(TrayIconObject *self, PyObject *value, void *closure)
 
     IconHandleObject* old_icon = self->icon_handle;
     self->icon_handle = (IconHandleObject *)value;
+    icon_handle_attach(self->icon_handle);
 
     BOOL result = TRUE;
     PWT_ENTER_TRAY_WINDOW_CS();
@@ -442,10 +465,12 @@ tray_icon_set_icon_handle(TrayIconObject *self, PyObject *value, void *closure)
     PWT_LEAVE_TRAY_WINDOW_CS();
 
     if (!result) {
+        icon_handle_detach(self->icon_handle);
         self->icon_handle = old_icon;
         return -1;
     }
 
+    icon_handle_detach(old_icon);
     Py_DECREF(old_icon);
     Py_INCREF(value);
 
@@ -474,13 +499,16 @@ tray_icon_dealloc(TrayIconObject *self) {
         self->id = 0;
     }
     Py_XDECREF(self->tip);
-    Py_XDECREF(self->icon_handle);
+    if (self->icon_handle) {
+        icon_handle_detach(self->icon_handle);
+        Py_DECREF(self->icon_handle);
+    }
 
     for(int i=0;i<sizeof(self->callbacks)/sizeof(self->callbacks[0]);i++) {
         Py_XDECREF(self->callbacks[i]);
     }
 
-    Py_TYPE(self)->tp_free((PyObject *)self);
+    pwt_free_list_free(PWT_FREE_LIST_TRAY_ICON, (PyObject *)self);
 }
 
 PyTypeObject *
@@ -1,11 +1,71 @@
+import concurrent.futures
+import mmap
 import typing
 
+_ResampleFilter: typing.TypeAlias = typing.Literal["lanczos", "box"]
+
 @typing.final
 class IconHandle:
     def __new__(cls, value:int)->IconHandle:...
 
+    @classmethod
+    def from_buffer(
+        cls,
+        buffer: typing.Buffer,
+        width: int,
+        height: int,
+        sizes: typing.Sequence[int]|None = None,
+        filter: _ResampleFilter = "lanczos",
+        intern: bool = False,
+    )->IconHandle:...
+    @classmethod
+    def from_atlas(
+        cls,
+        buffer: typing.Buffer,
+        tile_width: int,
+        tile_height: int,
+        count: int,
+        columns: int = 0,
+        sizes: typing.Sequence[int]|None = None,
+        filter: _ResampleFilter = "lanczos",
+    )->list[IconHandle]:...
+
 def load_icon(filename:str, large:bool=True, index:int=0)->IconHandle:...
 
+def resample(
+    buffer: typing.Buffer,
+    width: int,
+    height: int,
+    sizes: typing.Sequence[int],
+    filter: _ResampleFilter = "lanczos",
+)->list[bytes]:...
+
+class _IconHandleStats(typing.TypedDict):
+    live: int
+    budget: int
+    evicted: int
+    # icons loaded from files or resources, the budget can't evict them
+    unevictable: int
+    evictions: int
+    rematerializations: int
+    intern_hits: int
+
+def set_icon_handle_budget(budget:int)->None:...
+
+def get_icon_handle_stats()->_IconHandleStats:...
+
+class _FreeListStats(typing.TypedDict):
+    hits: int
+    misses: int
+    retained: int
+    retained_bytes: int
+
+class _FreeListsStats(typing.TypedDict):
+    menu_item: _FreeListStats
+    tray_icon: _FreeListStats
+
+def get_free_list_stats()->_FreeListsStats:...
+
 _TrayIconCallback: typing.TypeAlias = typing.Callable[[TrayIcon], typing.Any]
 
 _TrayIconCallbackTypes: typing.TypeAlias = typing.Literal[
@@ -86,6 +146,15 @@ class Menu(metaclass=_MenuMetaclass):
         vertical_align: typing.Literal["top", "center", "bottom"]="top",
     )->None:...
     @classmethod
+    def popup_async(
+        cls,
+        position: tuple[int, int]|None=None,
+        allow_right_click: bool=False,
+        horizontal_align: typing.Literal["left", "center", "right"]="left",
+        vertical_align: typing.Literal["top", "center", "bottom"]="top",
+        executor: concurrent.futures.Executor|None=None,
+    )->concurrent.futures.Future[MenuItem|None]:...
+    @classmethod
     def wait_for_popup(cls, timeout:float=0.0)->bool:...
     @classmethod
     def close(cls)->None:...
@@ -97,6 +166,69 @@ class Menu(metaclass=_MenuMetaclass):
     def append_item(cls, item:MenuItem)->None:...
     @classmethod
     def remove_item(cls, index:int) -> None:...
+    @classmethod
+    def extend(cls, items:typing.Iterable[MenuItem]) -> None:...
+    @classmethod
+    def replace_items(cls, items:typing.Iterable[MenuItem]) -> None:...
+    @classmethod
+    def sync_to(cls, items:typing.Iterable[MenuItem]) -> None:...
+    @classmethod
+    def filtered(cls, query:str) -> type[Menu]:...
+    @classmethod
+    def batch(cls) -> _MenuBatch:...
+    @classmethod
+    def register_provider(cls, provider:_MenuProvider|None) -> _MenuProvider|None:...
+    @classmethod
+    def invalidate(cls) -> None:...
+    @classmethod
+    def prewarm(cls) -> None:...
+    @classmethod
+    def set_presync(cls, enabled:bool=True) -> None:...
+    @classmethod
+    def from_spec(cls, spec:typing.Sequence[_MenuSpecEntry], name:str="SpecMenu") -> type[Menu]:...
+    @classmethod
+    def dump(cls, keys:dict[MenuItem, str]|None=None) -> bytes:...
+    @classmethod
+    def load(
+        cls,
+        blob:bytes|bytearray|memoryview|mmap.mmap,
+        callbacks:typing.Mapping[str, _MenuItemCallback|None]|None=None
+    ) -> type[Menu]:...
+    @classmethod
+    def set_page_source(
+        cls,
+        source:typing.Sequence[object]|None,
+        page_size:int=50,
+        callback:typing.Callable[[int], object]|None=None
+    ) -> None:...
+
+_MenuProvider = typing.Callable[[type[Menu]], typing.Iterable[MenuItem]]
+
+class _MenuSpecDict(typing.TypedDict, total=False):
+    type: typing.Literal["separator", "string", "check", "submenu"]
+    label: str
+    enabled: bool
+    callback: typing.Callable[[MenuItem], typing.Any]|None
+    checked: bool
+    radio: bool
+    items: typing.Sequence[_MenuSpecEntry]
+
+_MenuSpecEntry = typing.Union[
+    None,
+    str,
+    MenuItem,
+    _MenuSpecDict,
+    tuple[str, typing.Callable[[MenuItem], typing.Any]|None],
+    tuple[str, typing.Sequence["_MenuSpecEntry"]],
+]
+
+class _MenuBatch:
+    def insert_item(self, index:int, item:MenuItem) -> None:...
+    def append_item(self, item:MenuItem) -> None:...
+    def extend(self, items:typing.Iterable[MenuItem]) -> None:...
+    def remove_item(self, index:int) -> None:...
+    def __enter__(self) -> typing.Self:...
+    def __exit__(self, exc_type:typing.Any, exc_value:typing.Any, traceback:typing.Any) -> typing.Literal[False]:...
 
 
 _MenuItemCallback: typing.TypeAlias = typing.Callable[[MenuItem], typing.Any]
@@ -137,7 +269,8 @@ class _MenuItemMetaclass(type):
         radio:bool=False, 
         checked:bool=False, 
         enabled:bool=True,
-        callback:_MenuItemCallback|None=None
+        callback:_MenuItemCallback|None=None,
+        group:RadioGroup|None=None
     )->MenuItem[_Check]:...
 
     def submenu(
@@ -172,6 +305,12 @@ class MenuItem(typing.Generic[_MENU_TYPE, _SUBMENU], metaclass=_MenuItemMetaclas
     @radio.setter
     def radio(self:MenuItem[_Check], value:bool) -> None:...
 
+    @property
+    def group(self:MenuItem[_Check]) -> RadioGroup|None:...
+
+    @property
+    def callback(self:MenuItem[_String]|MenuItem[_Check]) -> _MenuItemCallback|None:...
+
     @property
     def enabled(self:MenuItem[_String]|MenuItem[_Check]|MenuItem[_Submenu]) -> bool:...
     @enabled.setter
@@ -180,5 +319,14 @@ class MenuItem(typing.Generic[_MENU_TYPE, _SUBMENU], metaclass=_MenuItemMetaclas
     @property
     def type(self) -> _MENU_TYPE:...
 
+@typing.final
+class RadioGroup:
+    def __init__(self) -> None:...
+
+    @property
+    def selected(self) -> MenuItem[_Check]|None:...
+    @selected.setter
+    def selected(self, value:MenuItem[_Check]|None) -> None:...
+
 __version__:str
 VERSION: tuple[int, int, int]
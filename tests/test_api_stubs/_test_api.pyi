@@ -11,3 +11,12 @@ def get_internal_id(
         pywintray.TrayIcon |
         type[pywintray.Menu]
 ) -> int:...
+
+def get_icon_size_cache(icon: pywintray.IconHandle) -> list[int]:...
+def xxh64(buffer: typing.Buffer, seed: int = 0) -> int:...
+def get_menu_dirty_items(menu: type[pywintray.Menu]) -> list[pywintray.MenuItem]:...
+def get_menu_item_links(item: pywintray.MenuItem) -> list[tuple[type[pywintray.Menu], int]]:...
+def get_menu_update_message_count(menu: type[pywintray.Menu]) -> int:...
+def get_menu_sync_count(menu: type[pywintray.Menu]) -> int:...
+def get_menu_presync_count(menu: type[pywintray.Menu]) -> int:...
+def get_wide_label(item: pywintray.MenuItem) -> tuple[int, int]|None:...
@@ -3,6 +3,7 @@
 Test the argument types and return types
 """
 
+import concurrent.futures
 import threading
 
 import pytest
@@ -71,6 +72,72 @@ def test_IconHandle():
     with pytest.raises(TypeError):
         pywintray.IconHandle()
 
+def test_IconHandle_from_buffer():
+    buf = bytes(16*16*4)
+    assert isinstance(pywintray.IconHandle.from_buffer(buf, 16, 16), pywintray.IconHandle)
+    pywintray.IconHandle.from_buffer(bytearray(buf), 16, 16, sizes=[8, 32])
+    pywintray.IconHandle.from_buffer(memoryview(buf), 16, 16, sizes=(8,), filter="box")
+    pywintray.IconHandle.from_buffer(buffer=buf, width=16, height=16, sizes=None)
+
+    with pytest.raises(TypeError):
+        pywintray.IconHandle.from_buffer("wrong type", 16, 16)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_buffer(buf, 16, 15)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_buffer(buf, 0, 0)
+    with pytest.raises(TypeError):
+        pywintray.IconHandle.from_buffer(buf, 16, 16, sizes=["16"])
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_buffer(buf, 16, 16, sizes=[0])
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_buffer(buf, 16, 16, sizes=[16]*100)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_buffer(buf, 16, 16, filter="wrong value")
+
+def test_IconHandle_from_atlas():
+    buf = bytes(16*16*4*6)
+    result = pywintray.IconHandle.from_atlas(buf, 16, 16, 6)
+    assert isinstance(result, list)
+    assert len(result) == 6
+    assert all(isinstance(i, pywintray.IconHandle) for i in result)
+    assert len(pywintray.IconHandle.from_atlas(bytearray(buf), 16, 16, 6, columns=3)) == 6
+    # the last row is not full
+    assert len(pywintray.IconHandle.from_atlas(buf, 16, 16, 5, columns=3)) == 5
+    pywintray.IconHandle.from_atlas(
+        buffer=memoryview(buf), tile_width=16, tile_height=16,
+        count=6, columns=6, sizes=[8], filter="box"
+    )
+
+    with pytest.raises(TypeError):
+        pywintray.IconHandle.from_atlas("wrong type", 16, 16, 6)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 16, 16, 5)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 16, 16, 0)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 0, 16, 6)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 16, 16, 6, columns=7)
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 16, 16, 6, sizes=[0])
+    with pytest.raises(ValueError):
+        pywintray.IconHandle.from_atlas(buf, 16, 16, 6, filter="wrong value")
+
+def test_resample():
+    buf = bytes(16*16*4)
+    result = pywintray.resample(buf, 16, 16, [8, 24])
+    assert isinstance(result, list)
+    assert len(result) == 2
+    assert all(type(i) is bytes for i in result)
+    assert len(result[0]) == 8*8*4
+    assert len(result[1]) == 24*24*4
+
+    assert pywintray.resample(buf, 16, 16, []) == []
+
+    with pytest.raises(TypeError):
+        pywintray.resample(buf, 16, 16)
+    with pytest.raises(ValueError):
+        pywintray.resample(buf, 16, 16, [8], filter="wrong value")
 
 def test_TrayIcon_init():
     icon = pywintray.load_icon("shell32.dll")
@@ -186,6 +253,8 @@ def test_Menu():
         pywintray.Menu.as_tuple()
     with pytest.raises(TypeError):
         pywintray.Menu.popup()
+    with pytest.raises(TypeError):
+        pywintray.Menu.popup_async()
     with pytest.raises(TypeError):
         pywintray.Menu.wait_for_popup(-1)
     with pytest.raises(TypeError):
@@ -196,6 +265,74 @@ def test_Menu():
         pywintray.Menu.append_item(pywintray.MenuItem.separator())
     with pytest.raises(TypeError):
         pywintray.Menu.remove_item(0)
+    with pytest.raises(TypeError):
+        pywintray.Menu.extend([])
+    with pytest.raises(TypeError):
+        pywintray.Menu.replace_items([])
+    with pytest.raises(TypeError):
+        pywintray.Menu.sync_to([])
+    with pytest.raises(TypeError):
+        pywintray.Menu.filtered("")
+    with pytest.raises(TypeError):
+        pywintray.Menu.batch()
+    with pytest.raises(TypeError):
+        pywintray.Menu.register_provider(None)
+    with pytest.raises(TypeError):
+        pywintray.Menu.invalidate()
+    with pytest.raises(TypeError):
+        pywintray.Menu.prewarm()
+    with pytest.raises(TypeError):
+        pywintray.Menu.set_presync()
+    with pytest.raises(TypeError):
+        pywintray.Menu.set_page_source(None)
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec()
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec(1)
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec("wrong_type")
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([1])
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([], name=1)
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([{"type": "string"}])
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([{"label": "a", "type": 1}])
+    with pytest.raises(ValueError):
+        pywintray.Menu.from_spec([{"label": "a", "type": "wrong_value"}])
+    with pytest.raises(ValueError):
+        pywintray.Menu.from_spec([{"label": "a", "wrong_key": 1}])
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([{"label": "a", "callback": 1}])
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([{"label": "a", "type": "submenu"}])
+    with pytest.raises(ValueError):
+        pywintray.Menu.from_spec([{"label": "a", "type": "check", "items": []}])
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([("a", "b")])
+    with pytest.raises(TypeError):
+        pywintray.Menu.dump()
+    with pytest.raises(TypeError):
+        pywintray.Menu.load()
+    with pytest.raises(TypeError):
+        pywintray.Menu.load("wrong_type")
+    with pytest.raises(ValueError):
+        pywintray.Menu.load(b"wrong_value")
+    with pytest.raises(ValueError):
+        pywintray.Menu.load(pywintray.Menu.from_spec(["a"]).dump()[:-1])
+    with pytest.raises(KeyError):
+        pywintray.Menu.load(pywintray.Menu.from_spec([("a", print)]).dump())
+    with pytest.raises(TypeError):
+        pywintray.Menu.load(
+            pywintray.Menu.from_spec([("a", print)]).dump(),
+            callbacks={"print": 1}
+        )
+    with pytest.raises(TypeError):
+        pywintray.Menu.from_spec([]).dump(keys=1)
+    menu = pywintray.Menu.from_spec([], name="Foo")
+    assert issubclass(menu, pywintray.Menu)
+    assert menu.__name__ == "Foo"
     with pytest.raises(TypeError):
         class MyMenu(pywintray.Menu, wrong_arg=1):
             pass
@@ -234,6 +371,22 @@ class TestMenuSubclass:
         
         threading.Timer(0.2, self.menu.close).start()
         assert self.menu.popup() is None
+
+    def test_classmethod_popup_async(self):
+        with pytest.raises(TypeError):
+            self.menu.popup_async(position="wrong_type")
+        with pytest.raises(TypeError):
+            self.menu.popup_async(position=(114,"514"))
+        with pytest.raises(TypeError):
+            self.menu.popup_async(horizontal_align=0.0)
+        with pytest.raises(ValueError):
+            self.menu.popup_async(vertical_align="wrong_value")
+
+        future = self.menu.popup_async(executor=None)
+        assert isinstance(future, concurrent.futures.Future)
+        self.menu.wait_for_popup()
+        self.menu.close()
+        assert future.result(2) is None
     
     def test_classmethod_wait_for_popup(self):
         with pytest.raises(TypeError):
@@ -306,6 +459,129 @@ class TestMenuSubclass:
 
         self.menu.remove_item(-1)
 
+    def test_classmethod_extend(self):
+        with pytest.raises(TypeError):
+            self.menu.extend()
+        with pytest.raises(TypeError):
+            self.menu.extend(1)
+        with pytest.raises(TypeError):
+            self.menu.extend(["wrong_type"])
+
+        new_items = [pywintray.MenuItem.separator() for _ in range(3)]
+        assert self.menu.extend(new_items) is None
+        assert self.menu.as_tuple()[-3:] == tuple(new_items)
+        self.menu.extend(i for i in new_items)
+        self.menu.extend(())
+
+    def test_classmethod_replace_items(self):
+        with pytest.raises(TypeError):
+            self.menu.replace_items()
+        with pytest.raises(TypeError):
+            self.menu.replace_items([self.menu.item1, "wrong_type"])
+        assert len(self.menu.as_tuple()) == 2
+
+        new_items = [pywintray.MenuItem.separator() for _ in range(3)]
+        assert self.menu.replace_items(new_items) is None
+        assert self.menu.as_tuple() == tuple(new_items)
+        self.menu.replace_items([])
+        assert self.menu.as_tuple() == ()
+
+    def test_classmethod_sync_to(self):
+        with pytest.raises(TypeError):
+            self.menu.sync_to()
+        with pytest.raises(TypeError):
+            self.menu.sync_to([self.menu.item1, "wrong_type"])
+        assert len(self.menu.as_tuple()) == 2
+
+        new_items = [pywintray.MenuItem.separator() for _ in range(3)]
+        assert self.menu.sync_to(new_items) is None
+        assert self.menu.as_tuple() == tuple(new_items)
+        self.menu.sync_to(i for i in reversed(new_items))
+        assert self.menu.as_tuple() == tuple(reversed(new_items))
+        self.menu.sync_to([])
+        assert self.menu.as_tuple() == ()
+
+    def test_classmethod_filtered(self):
+        with pytest.raises(TypeError):
+            self.menu.filtered()
+        with pytest.raises(TypeError):
+            self.menu.filtered(1)
+        view = self.menu.filtered("")
+        assert issubclass(view, pywintray.Menu)
+        assert self.menu.filtered("abc") is view
+
+    def test_classmethod_batch(self):
+        with pytest.raises(TypeError):
+            self.menu.batch("wrong_arg")
+
+        new_item = pywintray.MenuItem.separator()
+        with self.menu.batch() as batch:
+            with pytest.raises(TypeError):
+                batch.insert_item("wrong_type", new_item)
+            with pytest.raises(TypeError):
+                batch.insert_item(0, "wrong_type")
+            with pytest.raises(TypeError):
+                batch.append_item("wrong_type")
+            with pytest.raises(TypeError):
+                batch.remove_item("wrong_type")
+            with pytest.raises(TypeError):
+                batch.extend(["wrong_type"])
+            assert batch.insert_item(0, new_item) is None
+            assert batch.append_item(new_item) is None
+            assert batch.extend([new_item]) is None
+            assert batch.remove_item(-1) is None
+        assert self.menu.as_tuple()[0] is new_item
+        assert self.menu.as_tuple()[-1] is new_item
+        assert len(self.menu.as_tuple()) == 4
+
+        with pytest.raises(TypeError):
+            pywintray._MenuBatch()
+
+    def test_classmethod_register_provider(self):
+        with pytest.raises(TypeError):
+            self.menu.register_provider()
+        with pytest.raises(TypeError):
+            self.menu.register_provider(1)
+
+        provider = lambda menu: []
+        assert self.menu.register_provider(provider) is provider
+        assert self.menu.register_provider(None) is None
+
+    def test_classmethod_invalidate(self):
+        with pytest.raises(TypeError):
+            self.menu.invalidate(1)
+        assert self.menu.invalidate() is None
+
+    def test_classmethod_prewarm(self):
+        with pytest.raises(TypeError):
+            self.menu.prewarm(1)
+        assert self.menu.prewarm() is None
+
+    def test_classmethod_set_presync(self):
+        with pytest.raises(TypeError):
+            self.menu.set_presync(1, 2)
+        with pytest.raises(TypeError):
+            self.menu.set_presync(wrong_kw=True)
+        assert self.menu.set_presync() is None
+        assert self.menu.set_presync(enabled=False) is None
+
+    def test_classmethod_set_page_source(self):
+        with pytest.raises(TypeError):
+            self.menu.set_page_source()
+        with pytest.raises(TypeError):
+            self.menu.set_page_source(1)
+        with pytest.raises(TypeError):
+            self.menu.set_page_source([], page_size="wrong_type")
+        with pytest.raises(ValueError):
+            self.menu.set_page_source([], page_size=0)
+        with pytest.raises(TypeError):
+            self.menu.set_page_source([], callback=1)
+
+        assert self.menu.set_page_source(range(10)) is None
+        assert self.menu.set_page_source(["a", "b"], page_size=1, callback=None) is None
+        assert self.menu.set_page_source(range(10), 5, lambda i: None) is None
+        assert self.menu.set_page_source(None) is None
+
 class TestMenuItem:
     def test_new(self):
         with pytest.raises(TypeError):
@@ -354,6 +630,10 @@ class TestMenuItem:
         pywintray.MenuItem.check("label", checked=True, radio=True)
         pywintray.MenuItem.check("label", callback=None)
         pywintray.MenuItem.check("label", callback=lambda _:0)
+        with pytest.raises(TypeError):
+            pywintray.MenuItem.check("label", group="wrong_type")
+        pywintray.MenuItem.check("label", group=None)
+        pywintray.MenuItem.check("label", group=pywintray.RadioGroup())
         assert isinstance(pywintray.MenuItem.check("label"), pywintray.MenuItem)
     
     def test_classmethod_submenu(self):
@@ -446,6 +726,10 @@ class TestMenuItemSeparator:
         with pytest.raises(TypeError):
             setattr(self.item, "enabled", True)
 
+    def test_property_callback(self):
+        with pytest.raises(TypeError):
+            getattr(self.item, "callback")
+
     def test_property_type(self):
         assert self.item.type=="separator"
 
@@ -484,6 +768,14 @@ class TestMenuItemString:
         assert isinstance(self.item.enabled, bool)
         self.item.enabled = False
     
+    def test_property_callback(self):
+        assert self.item.callback is None
+        callback = lambda _:0
+        self.item.register_callback(callback)
+        assert self.item.callback is callback
+        with pytest.raises(AttributeError):
+            self.item.callback = None
+
     def test_property_type(self):
         assert self.item.type=="string"
 
@@ -513,11 +805,26 @@ class TestMenuItemCheck:
     def test_property_radio(self):
         assert isinstance(self.item.radio, bool)
         self.item.radio = True
+
+    def test_property_group(self):
+        assert self.item.group is None
+        with pytest.raises(AttributeError):
+            self.item.group = pywintray.RadioGroup()
+        group = pywintray.RadioGroup()
+        assert pywintray.MenuItem.check("label", group=group).group is group
     
     def test_property_enabled(self):
         assert isinstance(self.item.enabled, bool)
         self.item.enabled = False
     
+    def test_property_callback(self):
+        assert self.item.callback is None
+        callback = lambda _:0
+        self.item.register_callback(callback)
+        assert self.item.callback is callback
+        with pytest.raises(AttributeError):
+            self.item.callback = None
+
     def test_property_type(self):
         assert self.item.type=="check"
 
@@ -560,5 +867,39 @@ class TestMenuItemSubmenu:
         assert isinstance(self.item.enabled, bool)
         self.item.enabled = False
     
+    def test_property_callback(self):
+        with pytest.raises(TypeError):
+            getattr(self.item, "callback")
+
     def test_property_type(self):
         assert self.item.type=="submenu"
+
+class TestRadioGroup:
+    @pytest.fixture(autouse=True)
+    def setup(self):
+        self.group = pywintray.RadioGroup()
+        self.item = pywintray.MenuItem.check("label", group=self.group)
+
+    def test_init(self):
+        with pytest.raises(TypeError):
+            pywintray.RadioGroup(1)
+        with pytest.raises(TypeError):
+            pywintray.RadioGroup(wrong_kwarg=1)
+        assert isinstance(pywintray.RadioGroup(), pywintray.RadioGroup)
+
+    def test_property_selected(self):
+        assert self.group.selected is None
+        with pytest.raises(TypeError):
+            self.group.selected = "wrong_type"
+        with pytest.raises(ValueError):
+            self.group.selected = pywintray.MenuItem.check("label")
+        with pytest.raises(ValueError):
+            self.group.selected = pywintray.MenuItem.check(
+                "label", group=pywintray.RadioGroup()
+            )
+        with pytest.raises(AttributeError):
+            del self.group.selected
+        self.group.selected = self.item
+        assert self.group.selected is self.item
+        self.group.selected = None
+        assert self.group.selected is None
@@ -1,6 +1,8 @@
 # type:ignore
 
+import concurrent.futures
 import ctypes
+import mmap
 import time
 import typing
 
@@ -280,6 +282,211 @@ def test_icon_handle_free():
     copied = ctypes.windll.user32.CopyIcon(hicon)
     assert copied==0
 
+def test_icon_size_cache():
+    small_x = ctypes.windll.user32.GetSystemMetrics(SM_CXSMICON)
+    large_x = ctypes.windll.user32.GetSystemMetrics(SM_CXICON)
+
+    icon = pywintray.load_icon("tests/resources/peppers3-64x64.ico")
+    icon_size, _ = get_icon_size(_test_api.get_internal_id(icon))
+
+    # sizes equal to the original icon are not copied
+    expected_small = [small_x] if small_x!=icon_size else []
+    expected_both = sorted({small_x, large_x}-{icon_size})
+
+    tray = pywintray.TrayIcon(icon)
+
+    # nothing is materialized before the icon is displayed
+    assert _test_api.get_icon_size_cache(icon) == []
+
+    with start_tray_loop_thread():
+        # the tray uses the small icon size
+        assert _test_api.get_icon_size_cache(icon) == expected_small
+
+        tray.notify("title", "message", no_sound=True, icon=icon)
+        assert sorted(_test_api.get_icon_size_cache(icon)) == expected_both
+
+        # the cached sizes are reused
+        tray.icon_handle = icon
+        assert sorted(_test_api.get_icon_size_cache(icon)) == expected_both
+
+def test_resample_pixels():
+    # 4x4, left half opaque red, right half transparent blue
+    pixel_red = bytes((0, 0, 255, 255))
+    pixel_transparent = bytes((255, 0, 0, 0))
+    buf = (pixel_red*2 + pixel_transparent*2)*4
+
+    half, single = pywintray.resample(buf, 4, 4, [2, 1], filter="box")
+    assert half == (pixel_red + bytes(4))*2
+    # the transparent color doesn't bleed into the result
+    assert single == bytes((0, 0, 255, 128))
+
+    # a uniform image stays uniform
+    pixel = bytes((10, 100, 200, 128))
+    buf = pixel*64*64
+    for size, result in zip((16, 20, 24, 32, 48), pywintray.resample(buf, 64, 64, [16, 20, 24, 32, 48])):
+        assert result == pixel*size*size
+
+def test_icon_from_buffer_sizes():
+    small_x = ctypes.windll.user32.GetSystemMetrics(SM_CXSMICON)
+
+    buf = bytes((0, 0, 255, 255))*128*128
+    icon = pywintray.IconHandle.from_buffer(buf, 128, 128, sizes=[16, 24, 32])
+    assert get_icon_size(_test_api.get_internal_id(icon)) == (128, 128)
+    assert sorted(_test_api.get_icon_size_cache(icon)) == [16, 24, 32]
+
+    pywintray.TrayIcon(icon)
+    with start_tray_loop_thread():
+        assert small_x in _test_api.get_icon_size_cache(icon)
+
+def test_icon_handle_budget():
+    buf = bytes((0, 0, 255, 255))*32*32
+    icons = [pywintray.IconHandle.from_buffer(buf, 32, 32) for _ in range(4)]
+    base = pywintray.get_icon_handle_stats()
+
+    try:
+        pywintray.set_icon_handle_budget(1)
+        stats = pywintray.get_icon_handle_stats()
+        assert stats["budget"] == 1
+        assert stats["evictions"] >= base["evictions"]+4
+        assert stats["evicted"] >= base["evicted"]+4
+
+        # an evicted icon is re-created on demand
+        handle = _test_api.get_internal_id(icons[0])
+        assert get_icon_size(handle) == (32, 32)
+        stats2 = pywintray.get_icon_handle_stats()
+        assert stats2["rematerializations"] == stats["rematerializations"]+1
+
+        # icons used by a tray icon are not evicted
+        tray = pywintray.TrayIcon(icons[1])
+        _test_api.get_internal_id(icons[1])
+        handle = _test_api.get_internal_id(icons[0])
+        assert get_icon_size(handle) == (32, 32)
+        stats3 = pywintray.get_icon_handle_stats()
+        assert stats3["rematerializations"] == stats2["rematerializations"]+2
+        _test_api.get_internal_id(icons[1])
+        stats4 = pywintray.get_icon_handle_stats()
+        assert stats4["rematerializations"] == stats3["rematerializations"]
+        del tray
+    finally:
+        pywintray.set_icon_handle_budget(0)
+
+    with pytest.raises(ValueError):
+        pywintray.set_icon_handle_budget(-1)
+
+def test_icon_handle_budget_resource():
+    base = pywintray.get_icon_handle_stats()
+    icon = pywintray.load_icon("tests/resources/peppers3-64x64.ico")
+    handle = _test_api.get_internal_id(icon)
+    assert pywintray.get_icon_handle_stats()["unevictable"] == base["unevictable"]+1
+    base = pywintray.get_icon_handle_stats()
+
+    try:
+        pywintray.set_icon_handle_budget(1)
+        # an icon without pixels keeps the handle of the resource
+        assert _test_api.get_internal_id(icon) == handle
+        stats = pywintray.get_icon_handle_stats()
+        assert stats["rematerializations"] == base["rematerializations"]
+        # and is reported as unevictable
+        assert stats["unevictable"] >= 1
+        assert stats["unevictable"] == base["unevictable"]
+    finally:
+        pywintray.set_icon_handle_budget(0)
+
+def test_icon_from_atlas():
+    colors = [bytes((255, 0, 0, 255)), bytes((0, 255, 0, 255)), bytes((0, 0, 255, 255))]
+    # 2x2 grid of 4x2 tiles, the last cell is unused
+    rows = [
+        (colors[0]*4+colors[1]*4)*2,
+        (colors[2]*4+bytes(16))*2,
+    ]
+    icons = pywintray.IconHandle.from_atlas(b"".join(rows), 4, 2, 3, columns=2, sizes=[2])
+
+    for icon, color in zip(icons, colors):
+        handle = _test_api.get_internal_id(icon)
+        assert get_icon_size(handle) == (4, 2)
+        assert get_icon_pixels(handle) == color*8
+        assert _test_api.get_icon_size_cache(icon) == [2]
+
+def test_free_list():
+    base = pywintray.get_free_list_stats()["menu_item"]
+
+    item = pywintray.MenuItem.check("a", checked=True, radio=True, enabled=False)
+    del item
+    stats = pywintray.get_free_list_stats()["menu_item"]
+    assert stats["retained"] >= 1
+    assert stats["retained_bytes"] > 0
+
+    # a reused object is initialized like a new one
+    item = pywintray.MenuItem.check("b")
+    stats2 = pywintray.get_free_list_stats()["menu_item"]
+    assert stats2["hits"] == stats["hits"]+1
+    # every retained item counts the same size
+    item_size = stats["retained_bytes"]//stats["retained"]
+    assert stats["retained_bytes"] == item_size*stats["retained"]
+    assert stats2["retained_bytes"] == item_size*stats2["retained"]
+    assert item.label == "b"
+    assert item.enabled
+    assert not item.checked
+    assert not item.radio
+    assert item.group is None
+    del item
+
+    tray = pywintray.TrayIcon(pywintray.load_icon("shell32.dll"), tip="x")
+    del tray
+    tray = pywintray.TrayIcon(pywintray.load_icon("shell32.dll"))
+    assert tray.tip == "pywintray"
+    assert pywintray.get_free_list_stats()["tray_icon"]["hits"] >= 1
+    del tray
+
+    stats = pywintray.get_free_list_stats()["menu_item"]
+    assert stats["hits"]+stats["misses"] > base["hits"]+base["misses"]
+
+    # the lists of other threads, and of the threads that exited,
+    # are counted in the stats
+    def churn():
+        for _ in range(10):
+            pywintray.MenuItem.string("c")
+    base = pywintray.get_free_list_stats()["menu_item"]
+    thread = threading.Thread(target=churn)
+    thread.start()
+    thread.join()
+    stats = pywintray.get_free_list_stats()["menu_item"]
+    assert stats["hits"]+stats["misses"] == base["hits"]+base["misses"]+10
+
+def test_xxh64():
+    assert _test_api.xxh64(b"") == 0xEF46DB3751D8E999
+    assert _test_api.xxh64(b"abc") == 0x44BC2CF5AD770999
+    # the 32 bytes stripe loop
+    data = bytes(range(100))
+    assert _test_api.xxh64(data) != _test_api.xxh64(data, 1)
+    assert _test_api.xxh64(data[:99]+b"\xff") != _test_api.xxh64(data)
+
+def test_icon_intern():
+    red = bytes((0, 0, 255, 255))*16*16
+    blue = bytes((255, 0, 0, 255))*16*16
+    hits = pywintray.get_icon_handle_stats()["intern_hits"]
+
+    icon1 = pywintray.IconHandle.from_buffer(red, 16, 16, intern=True)
+    icon2 = pywintray.IconHandle.from_buffer(bytearray(red), 16, 16, intern=True)
+    assert icon1 is icon2
+    assert pywintray.get_icon_handle_stats()["intern_hits"] == hits+1
+
+    # different pixels, shape or filter are different icons
+    assert pywintray.IconHandle.from_buffer(blue, 16, 16, intern=True) is not icon1
+    assert pywintray.IconHandle.from_buffer(red, 32, 8, intern=True) is not icon1
+    assert pywintray.IconHandle.from_buffer(red, 16, 16, filter="box", intern=True) is not icon1
+    # interning is opt-in
+    assert pywintray.IconHandle.from_buffer(red, 16, 16) is not icon1
+
+    # requested sizes are added to the shared icon
+    pywintray.IconHandle.from_buffer(red, 16, 16, sizes=[8], intern=True)
+    assert _test_api.get_icon_size_cache(icon1) == [8]
+
+    # the entry is removed when the icon is released
+    del icon1, icon2
+    icon3 = pywintray.IconHandle.from_buffer(red, 16, 16, intern=True)
+    assert _test_api.get_icon_size_cache(icon3) == []
+
 def test_menu_multi_bases():
     class A:
         pass
@@ -400,6 +607,343 @@ def test_menu_insert_append_remove_when_poped_up():
         assert get_menu_item_string(handle, 2) == "item3"
         assert get_menu_item_string(handle, 3) == "item5"
 
+def test_menu_item_positions():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        item2 = pywintray.MenuItem.string("item2")
+    class Other(pywintray.Menu):
+        pass
+    item3 = pywintray.MenuItem.string("item3")
+
+    # an item can be placed several times
+    MyMenu.insert_item(0, item3)
+    MyMenu.append_item(item3)
+    Other.append_item(item3)
+    MyMenu.remove_item(1)
+
+    def check_links():
+        expected = []
+        for menu in (MyMenu, Other):
+            for index, item in enumerate(menu.as_tuple()):
+                if item is item3:
+                    expected.append((menu, index))
+        assert sorted(_test_api.get_menu_item_links(item3), key=repr) == sorted(expected, key=repr)
+
+    check_links()
+    assert _test_api.get_menu_item_links(MyMenu.item2) == [(MyMenu, 1)]
+
+    with popup_in_new_thread(MyMenu):
+        # every placement is updated through its link
+        item3.label = "foo"
+        handle = _test_api.get_internal_id(MyMenu)
+        for _ in range(100):
+            if get_menu_item_string(handle, 2) == "foo":
+                break
+            time.sleep(0.01)
+        assert get_menu_item_string(handle, 0) == "foo"
+        assert get_menu_item_string(handle, 1) == "item2"
+        assert get_menu_item_string(handle, 2) == "foo"
+
+    MyMenu.remove_item(0)
+    check_links()
+    Other.remove_item(0)
+    assert _test_api.get_menu_item_links(item3) == [(MyMenu, 1)]
+
+def test_menu_popup_async():
+    callback_threads = []
+
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        item2 = pywintray.MenuItem.string(
+            "item2", callback=lambda _: callback_threads.append(threading.get_ident())
+        )
+
+    # returns before the menu is dismissed
+    future = MyMenu.popup_async()
+    assert MyMenu.wait_for_popup(2)
+    assert not future.done()
+
+    hmenu = _test_api.get_internal_id(MyMenu)
+    set_mouse_pos(center_of(get_menu_item_rect(hmenu, 1)))
+    mouse_click()
+
+    assert future.result(2) is MyMenu.item2
+    # the callback runs on the popup thread after the future is resolved
+    time.sleep(0.1)
+    assert len(callback_threads) == 1
+    assert callback_threads[0] != threading.get_ident()
+
+    # dismissed without selection
+    future = MyMenu.popup_async()
+    MyMenu.wait_for_popup(2)
+    MyMenu.close()
+    assert future.result(2) is None
+
+def test_menu_popup_rejected():
+    calls = []
+    class MyMenu(pywintray.Menu):
+        pass
+    def provider(menu):
+        calls.append(menu)
+        return [pywintray.MenuItem.string("item1")]
+    MyMenu.register_provider(provider)
+
+    with popup_in_new_thread(MyMenu):
+        assert calls == [MyMenu]
+        MyMenu.invalidate()
+        # the second popup is rejected before the provider is called
+        with pytest.raises(RuntimeError):
+            MyMenu.popup()
+        assert calls == [MyMenu]
+
+def test_menu_popup_async_executor():
+    called = []
+
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1", callback=called.append)
+
+    with concurrent.futures.ThreadPoolExecutor(1, "test-executor") as executor:
+        future = MyMenu.popup_async(executor=executor)
+        MyMenu.wait_for_popup(2)
+        hmenu = _test_api.get_internal_id(MyMenu)
+        set_mouse_pos(center_of(get_menu_item_rect(hmenu, 0)))
+        mouse_click()
+        assert future.result(2) is MyMenu.item1
+    assert called == [MyMenu.item1]
+
+def test_menu_popup_async_error():
+    class MyMenu(pywintray.Menu):
+        pass
+
+    MyMenu.register_provider(lambda menu: 1/0)
+    future = MyMenu.popup_async()
+    with pytest.raises(ZeroDivisionError):
+        future.result(2)
+
+def test_menu_popup_host_reused():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+
+    def popup_twice():
+        MyMenu.popup()
+        MyMenu.popup()
+
+    popup_thread = threading.Thread(target=popup_twice, daemon=True)
+    popup_thread.start()
+
+    host_windows = []
+    for _ in range(2):
+        MyMenu.wait_for_popup()
+        host_windows.append(get_thread_windows(popup_thread))
+        MyMenu.close()
+        # wait for the popup to end
+        time.sleep(0.2)
+
+    wait_for_threads_end([popup_thread])
+
+    # the idle host window is kept by the thread
+    assert len(host_windows[0]) == 1
+    assert host_windows[0] == host_windows[1]
+
+def test_menu_update_message_coalesced():
+    items = [pywintray.MenuItem.check(f"item{i}") for i in range(200)]
+    class MyMenu(pywintray.Menu):
+        pass
+    for item in items:
+        MyMenu.append_item(item)
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        count_before = _test_api.get_menu_update_message_count(MyMenu)
+
+        for item in items:
+            item.checked = True
+            item.label = "changed"
+
+        for _ in range(100):
+            if not _test_api.get_menu_dirty_items(MyMenu):
+                break
+            time.sleep(0.01)
+        assert _test_api.get_menu_dirty_items(MyMenu) == []
+        assert get_menu_item_string(handle, 0) == "changed"
+        assert get_menu_item_string(handle, 199) == "changed"
+
+        # far less than one message per change
+        assert _test_api.get_menu_update_message_count(MyMenu)-count_before < 100
+
+def test_menu_batch():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        item2 = pywintray.MenuItem.string("item2")
+    items = [pywintray.MenuItem.string(f"new{i}") for i in range(3)]
+
+    with popup_in_new_thread(MyMenu):
+        with MyMenu.batch() as batch:
+            batch.remove_item(0)
+            batch.extend(items)
+            batch.insert_item(0, MyMenu.item1)
+            batch.remove_item(1)
+            # nothing is applied before exit
+            assert MyMenu.as_tuple() == (MyMenu.item1, MyMenu.item2)
+
+        assert MyMenu.as_tuple() == (MyMenu.item1, *items)
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_count(handle) == 4
+        assert [get_menu_item_string(handle, i) for i in range(4)] == \
+            ["item1", "new0", "new1", "new2"]
+        for index, item in enumerate(items):
+            assert _test_api.get_menu_item_links(item) == [(MyMenu, index+1)]
+
+    # an exception discards the batch
+    with pytest.raises(RuntimeError):
+        with MyMenu.batch() as batch:
+            batch.remove_item(0)
+            raise RuntimeError()
+    assert len(MyMenu.as_tuple()) == 4
+
+    # the batch is validated before applied
+    with pytest.raises(IndexError):
+        with MyMenu.batch() as batch:
+            batch.remove_item(0)
+            batch.remove_item(3)
+    assert MyMenu.as_tuple() == (MyMenu.item1, *items)
+
+    @pywintray.MenuItem.submenu("sub")
+    class Sub(pywintray.Menu):
+        pass
+    Sub.sub.append_item(MyMenu.item2)
+    MyMenu.append_item(Sub)
+    with pytest.raises(ValueError):
+        # circular submenu
+        Sub.sub.extend([pywintray.MenuItem.separator(), pywintray.MenuItem.submenu("s")(MyMenu)])
+    assert Sub.sub.as_tuple() == (MyMenu.item2,)
+
+def test_menu_replace_items():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        item2 = pywintray.MenuItem.string("item2")
+    items = [pywintray.MenuItem.string(f"new{i}") for i in range(3)]
+
+    MyMenu.replace_items([items[0], MyMenu.item2, items[1]])
+    assert MyMenu.as_tuple() == (items[0], MyMenu.item2, items[1])
+    assert _test_api.get_menu_item_links(MyMenu.item1) == []
+    assert _test_api.get_menu_item_links(MyMenu.item2) == [(MyMenu, 1)]
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert [get_menu_item_string(handle, i) for i in range(3)] == \
+            ["new0", "item2", "new1"]
+
+def test_menu_sync_to():
+    items = [pywintray.MenuItem.string(f"item{i}") for i in range(8)]
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.extend(items[:6])
+
+    # insert, remove and move at once
+    new_items = [items[0], items[6], items[2], items[3], items[1], items[5], items[7]]
+    MyMenu.sync_to(new_items)
+    assert MyMenu.as_tuple() == tuple(new_items)
+    assert _test_api.get_menu_item_links(items[4]) == []
+    for i, item in enumerate(new_items):
+        assert _test_api.get_menu_item_links(item) == [(MyMenu, i)]
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert [get_menu_item_string(handle, i) for i in range(7)] == \
+            [item.label for item in new_items]
+
+    # too different to diff, replaced as a whole
+    many = [pywintray.MenuItem.string(str(i)) for i in range(600)]
+    MyMenu.sync_to(many)
+    assert MyMenu.as_tuple() == tuple(many)
+    MyMenu.sync_to(reversed(many))
+    assert MyMenu.as_tuple() == tuple(reversed(many))
+    assert _test_api.get_menu_item_links(many[0]) == [(MyMenu, 599)]
+
+def test_menu_filtered():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("Open File")
+        sep = pywintray.MenuItem.separator()
+        item2 = pywintray.MenuItem.string("Close")
+        @pywintray.MenuItem.submenu("Recent files")
+        class Recent(pywintray.Menu):
+            item3 = pywintray.MenuItem.string("notes.txt")
+            item4 = pywintray.MenuItem.string("FILE.md")
+        item5 = pywintray.MenuItem.check("Show hidden files")
+    recent = MyMenu.Recent.sub
+
+    # the submenus are flattened, the menu order is kept
+    view = MyMenu.filtered("file")
+    assert view.as_tuple() == (MyMenu.item1, recent.item4, MyMenu.item5)
+    assert MyMenu.filtered("FI").as_tuple() == (MyMenu.item1, recent.item4, MyMenu.item5)
+    assert MyMenu.filtered("nothing").as_tuple() == ()
+    assert MyMenu.filtered("").as_tuple() == \
+        (MyMenu.item1, MyMenu.item2, recent.item3, recent.item4, MyMenu.item5)
+
+    # the view is reused
+    assert MyMenu.filtered("close") is view
+    assert view.as_tuple() == (MyMenu.item2,)
+
+    # the index follows the changes of the items
+    MyMenu.item2.label = "Exit"
+    assert MyMenu.filtered("close").as_tuple() == ()
+    assert MyMenu.filtered("exit").as_tuple() == (MyMenu.item2,)
+    new_item = pywintray.MenuItem.string("Save file")
+    MyMenu.insert_item(0, new_item)
+    recent.remove_item(1)
+    assert MyMenu.filtered("file").as_tuple() == (new_item, MyMenu.item1, MyMenu.item5)
+
+    with popup_in_new_thread(view):
+        handle = _test_api.get_internal_id(view)
+        assert [get_menu_item_string(handle, i) for i in range(3)] == \
+            ["Save file", "Open File", "Show hidden files"]
+
+def test_menu_rolling_items():
+    class MyMenu(pywintray.Menu):
+        pass
+    items = [pywintray.MenuItem.string(f"line{i}") for i in range(16)]
+    shared = pywintray.MenuItem.string("shared")
+
+    # append at the end and remove from the front
+    MyMenu.extend(items[:10])
+    MyMenu.insert_item(3, shared)
+    MyMenu.insert_item(8, shared)
+    for i in range(10, 16):
+        MyMenu.append_item(items[i])
+        MyMenu.remove_item(0)
+    MyMenu.insert_item(1, shared)
+    MyMenu.remove_item(-2)
+
+    expected = list(MyMenu.as_tuple())
+    assert len(expected) == 12
+    for i, item in enumerate(expected):
+        assert (MyMenu, i) in _test_api.get_menu_item_links(item)
+    assert sorted(_test_api.get_menu_item_links(shared)) == [(MyMenu, 1), (MyMenu, 3)]
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert [get_menu_item_string(handle, i) for i in range(12)] == \
+            [item.label for item in expected]
+
+        # an item placed by its links is written to the right entry
+        expected[5].label = "changed"
+        for _ in range(100):
+            if get_menu_item_string(handle, 5) == "changed":
+                break
+            time.sleep(0.01)
+        assert get_menu_item_string(handle, 5) == "changed"
+
+def test_menu_as_tuple_snapshot():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+    snapshot = MyMenu.as_tuple()
+    assert MyMenu.as_tuple() is snapshot
+    item2 = pywintray.MenuItem.string("item2")
+    MyMenu.append_item(item2)
+    assert snapshot == (MyMenu.item1,)
+    assert MyMenu.as_tuple() == (MyMenu.item1, item2)
+
 def test_menu_insert_remove_negative_index():
     class MyMenu(pywintray.Menu):
         item1 = pywintray.MenuItem.string("item1")
@@ -483,6 +1027,197 @@ def test_submenu_callbacks():
     assert SLOT1 is None
     assert SLOT2 == 2
 
+def test_menu_provider():
+    calls = []
+    new_items = [pywintray.MenuItem.string("item1"), pywintray.MenuItem.string("item2")]
+
+    class MyMenu(pywintray.Menu):
+        item0 = pywintray.MenuItem.string("item0")
+
+    @MyMenu.register_provider
+    def provider(menu):
+        calls.append(menu)
+        return new_items
+
+    # not called until the menu is opened
+    assert calls == []
+    assert len(MyMenu.as_tuple()) == 1
+
+    with popup_in_new_thread(MyMenu):
+        assert calls == [MyMenu]
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_count(handle) == 2
+        assert get_menu_item_string(handle, 0) == "item1"
+
+    # the items are cached
+    with popup_in_new_thread(MyMenu):
+        pass
+    assert calls == [MyMenu]
+
+    MyMenu.invalidate()
+    new_items.reverse()
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_string(handle, 0) == "item2"
+    assert calls == [MyMenu, MyMenu]
+    assert MyMenu.as_tuple() == tuple(new_items)
+
+def test_menu_provider_error():
+    class MyMenu(pywintray.Menu):
+        pass
+
+    MyMenu.register_provider(lambda menu: 1/0)
+    with pytest.raises(ZeroDivisionError):
+        MyMenu.popup()
+
+    MyMenu.register_provider(lambda menu: ["wrong_type"])
+    with pytest.raises(TypeError):
+        MyMenu.popup()
+
+def test_submenu_provider():
+    calls = []
+
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        @pywintray.MenuItem.submenu("sub1")
+        class Sub(pywintray.Menu):
+            pass
+    sub = MyMenu.Sub.sub
+
+    @sub.register_provider
+    def provider(menu):
+        calls.append(menu)
+        return [pywintray.MenuItem.string("lazy")]
+
+    with popup_in_new_thread(MyMenu):
+        # populated when the submenu is opened
+        assert calls == []
+
+        hmenu = _test_api.get_internal_id(MyMenu)
+        rect = get_menu_item_rect(hmenu, 1)
+        set_mouse_pos(center_of(rect))
+        time.sleep(MENU_SHOW_DELAY)
+
+        # wait for submenu popup
+        hmenu_sub = _test_api.get_internal_id(sub)
+        get_menu_item_rect(hmenu_sub, 0)
+
+        assert calls == [sub]
+        assert get_menu_item_count(hmenu_sub) == 1
+        assert get_menu_item_string(hmenu_sub, 0) == "lazy"
+
+def test_menu_paged():
+    clicked = []
+
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.set_page_source(range(100000), page_size=20, callback=clicked.append)
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_count(handle) == 21
+        assert get_menu_item_string(handle, 0) == "0"
+        assert get_menu_item_string(handle, 19) == "19"
+        assert get_menu_item_string(handle, 20) == "More\u2026"
+        first_page = MyMenu.as_tuple()
+
+        # the menu is shown again with the next page
+        rect = get_menu_item_rect(handle, 20)
+        set_mouse_pos(center_of(rect))
+        mouse_click()
+        get_menu_item_rect(handle, 21)
+
+        assert get_menu_item_string(handle, 0) == "Previous"
+        assert get_menu_item_string(handle, 1) == "20"
+        assert get_menu_item_string(handle, 21) == "More\u2026"
+        # the items are reused
+        assert MyMenu.as_tuple()[1:21] == first_page[:20]
+
+        rect = get_menu_item_rect(handle, 2)
+        set_mouse_pos(center_of(rect))
+        mouse_click()
+
+    assert clicked == [21]
+
+def test_menu_paged_clear():
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.set_page_source(range(30), page_size=10)
+    MyMenu.prewarm()
+    assert len(MyMenu.as_tuple()) == 11
+
+    # the page and the navigation items are removed with the source
+    MyMenu.set_page_source(None)
+    assert MyMenu.as_tuple() == ()
+    assert get_menu_item_count(_test_api.get_internal_id(MyMenu)) == 0
+
+def test_menu_paged_static_items():
+    class MyMenu(pywintray.Menu):
+        header = pywintray.MenuItem.string("header")
+    MyMenu.set_page_source(range(30), page_size=10)
+    MyMenu.prewarm()
+    items = MyMenu.as_tuple()
+    assert len(items) == 12
+    assert items[0] is MyMenu.header
+    assert items[1].label == "0" and items[11].label == "More\u2026"
+
+    # the next page takes the place of the previous one
+    footer = pywintray.MenuItem.string("footer")
+    MyMenu.append_item(footer)
+    MyMenu.invalidate()
+    MyMenu.prewarm()
+    items = MyMenu.as_tuple()
+    assert items[0] is MyMenu.header and items[-1] is footer
+    assert len(items) == 13
+    handle = _test_api.get_internal_id(MyMenu)
+    assert get_menu_item_string(handle, 0) == "header"
+    assert get_menu_item_string(handle, 12) == "footer"
+
+    MyMenu.set_page_source(None)
+    assert MyMenu.as_tuple() == (MyMenu.header, footer)
+
+def test_menu_paged_cleared_during_build():
+    class MyMenu(pywintray.Menu):
+        header = pywintray.MenuItem.string("header")
+
+    class ClearingSource:
+        def __len__(self):
+            return 5
+        def __getitem__(self, index):
+            MyMenu.set_page_source(None)
+            return index
+
+    # the page of a cleared source is not installed
+    MyMenu.set_page_source(ClearingSource())
+    MyMenu.prewarm()
+    assert MyMenu.as_tuple() == (MyMenu.header,)
+
+def test_menu_paged_last_page():
+    class MyMenu(pywintray.Menu):
+        pass
+    source = list(range(25))
+    MyMenu.set_page_source(source, page_size=10)
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        for _ in range(2):
+            rect = get_menu_item_rect(handle, get_menu_item_count(handle)-1)
+            set_mouse_pos(center_of(rect))
+            mouse_click()
+            time.sleep(MENU_SHOW_DELAY)
+        get_menu_item_rect(handle, 0)
+        assert get_menu_item_count(handle) == 6
+        assert get_menu_item_string(handle, 1) == "20"
+        assert get_menu_item_string(handle, 5) == "24"
+
+    # the page is clamped when the source is shorter
+    del source[15:]
+    MyMenu.invalidate()
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_count(handle) == 6
+        assert get_menu_item_string(handle, 1) == "10"
+
 def test_submenu_update():
     class MyMenu(pywintray.Menu):
         @pywintray.MenuItem.submenu("sub1")
@@ -497,6 +1232,305 @@ def test_submenu_update():
         handle = _test_api.get_internal_id(MyMenu.Sub.sub.SubSub.sub)
         assert get_menu_item_string(handle, 0)=="qwerty"
 
+def test_menu_item_wide_label():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("same")
+        item2 = pywintray.MenuItem.check("same")
+        item3 = pywintray.MenuItem.string("other")
+    sep = pywintray.MenuItem.separator()
+    MyMenu.append_item(sep)
+
+    # identical labels share one buffer
+    address1, refcount1 = _test_api.get_wide_label(MyMenu.item1)
+    address2, refcount2 = _test_api.get_wide_label(MyMenu.item2)
+    assert address1 == address2
+    assert refcount1 == refcount2 == 2
+    assert _test_api.get_wide_label(MyMenu.item3)[0] != address1
+    assert _test_api.get_wide_label(sep) is None
+
+    # released on change and converted again when written
+    MyMenu.item2.label = "other"
+    assert _test_api.get_wide_label(MyMenu.item2) is None
+    assert _test_api.get_wide_label(MyMenu.item1) == (address1, 1)
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_string(handle, 1) == "other"
+        assert _test_api.get_wide_label(MyMenu.item2) == \
+            _test_api.get_wide_label(MyMenu.item3)
+
+    # unchanged labels are not converted again
+    MyMenu.item1.enabled = False
+    with popup_in_new_thread(MyMenu):
+        assert _test_api.get_wide_label(MyMenu.item1) == (address1, 1)
+
+def test_radio_group():
+    group = pywintray.RadioGroup()
+    items = [
+        pywintray.MenuItem.check(f"profile{i}", checked=(i==3), group=group)
+        for i in range(50)
+    ]
+    assert group.selected is items[3]
+    assert all(item.radio for item in items)
+    assert [i for i, item in enumerate(items) if item.checked] == [3]
+
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.extend(items)
+
+    # only the old and the new selection are touched
+    group.selected = items[10]
+    assert not items[3].checked and items[10].checked
+    assert _test_api.get_menu_dirty_items(MyMenu) == [items[3], items[10]]
+
+    items[20].checked = True
+    assert group.selected is items[20]
+    assert not items[10].checked
+    items[5].checked = False
+    assert group.selected is items[20]
+    items[20].checked = False
+    assert group.selected is None
+    assert not any(item.checked for item in items)
+
+    items[42].checked = True
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert [i for i in range(50) if get_menu_item_checked(handle, i)] == [42]
+
+        group.selected = items[7]
+        for _ in range(100):
+            if get_menu_item_checked(handle, 7):
+                break
+            time.sleep(0.01)
+        assert [i for i in range(50) if get_menu_item_checked(handle, i)] == [7]
+
+    # the selection is cleared when the item is released
+    item = pywintray.MenuItem.check("temp", group=group, checked=True)
+    assert group.selected is item
+    del item
+    assert group.selected is None
+
+def test_menu_dirty_items():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+        item2 = pywintray.MenuItem.check("item2")
+        @pywintray.MenuItem.submenu("sub")
+        class Sub(pywintray.Menu):
+            item3 = pywintray.MenuItem.string("item3")
+    sub = MyMenu.Sub.sub
+
+    assert _test_api.get_menu_dirty_items(MyMenu) == []
+
+    # an item is recorded once until synced
+    MyMenu.item2.checked = True
+    MyMenu.item2.checked = False
+    assert _test_api.get_menu_dirty_items(MyMenu) == [MyMenu.item2]
+
+    # the parent menu is marked as well
+    sub.item3.label = "foo"
+    assert _test_api.get_menu_dirty_items(sub) == [sub.item3]
+    assert _test_api.get_menu_dirty_items(MyMenu) == [MyMenu.item2, MyMenu.Sub]
+
+    with popup_in_new_thread(MyMenu):
+        assert _test_api.get_menu_dirty_items(MyMenu) == []
+        assert _test_api.get_menu_dirty_items(sub) == []
+        handle = _test_api.get_internal_id(sub)
+        assert get_menu_item_string(handle, 0) == "foo"
+
+    # removed items are dropped from the dirty list
+    MyMenu.item1.label = "bar"
+    MyMenu.remove_item(0)
+    assert _test_api.get_menu_dirty_items(MyMenu) == []
+
+def test_menu_shared_submenu_sync():
+    class Tools(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+    parents = []
+    for i in range(3):
+        class Parent(pywintray.Menu):
+            pass
+        Parent.append_item(pywintray.MenuItem.submenu("tools")(Tools))
+        parents.append(Parent)
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.extend(pywintray.MenuItem.submenu(f"parent{i}")(p) for i, p in enumerate(parents))
+
+    # every parent is dirty, the shared submenu is synced once
+    Tools.item1.label = "foo"
+    for p in parents:
+        assert _test_api.get_menu_dirty_items(p) == [p.as_tuple()[0]]
+    count = _test_api.get_menu_sync_count(Tools)
+    with popup_in_new_thread(MyMenu):
+        assert _test_api.get_menu_sync_count(Tools) == count+1
+        handle = _test_api.get_internal_id(Tools)
+        assert get_menu_item_string(handle, 0) == "foo"
+
+def test_menu_prewarm():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+
+    MyMenu.item1.label = "foo"
+    assert _test_api.get_menu_dirty_items(MyMenu) == [MyMenu.item1]
+    MyMenu.prewarm()
+    assert _test_api.get_menu_dirty_items(MyMenu) == []
+    handle = _test_api.get_internal_id(MyMenu)
+    assert get_menu_item_string(handle, 0) == "foo"
+
+    # the provider is called by prewarm, not by popup
+    calls = []
+    class Provided(pywintray.Menu):
+        pass
+    def provider(menu):
+        calls.append(menu)
+        return [pywintray.MenuItem.string("provided")]
+    Provided.register_provider(provider)
+    Provided.prewarm()
+    assert calls == [Provided]
+    with popup_in_new_thread(Provided):
+        pass
+    assert calls == [Provided]
+
+def test_menu_presync():
+    class MyMenu(pywintray.Menu):
+        item1 = pywintray.MenuItem.string("item1")
+    handle = _test_api.get_internal_id(MyMenu)
+
+    MyMenu.set_presync()
+    with start_tray_loop_thread():
+        # written by the tray thread without a popup
+        MyMenu.item1.label = "foo"
+        time.sleep(0.1)
+        assert get_menu_item_string(handle, 0) == "foo"
+        assert _test_api.get_menu_dirty_items(MyMenu) == []
+        count = _test_api.get_menu_presync_count(MyMenu)
+        assert count >= 1
+
+        MyMenu.set_presync(False)
+        MyMenu.item1.label = "bar"
+        time.sleep(0.1)
+        assert get_menu_item_string(handle, 0) == "foo"
+        assert _test_api.get_menu_presync_count(MyMenu) == count
+
+    MyMenu.prewarm()
+    assert get_menu_item_string(handle, 0) == "bar"
+
+def test_menu_from_spec():
+    def cb(_):
+        pass
+    existing = pywintray.MenuItem.string("existing")
+
+    MyMenu = pywintray.Menu.from_spec([
+        "item1",
+        None,
+        ("item2", cb),
+        {"type": "check", "label": "item3", "checked": True, "radio": True},
+        {"label": "item4", "enabled": False},
+        existing,
+        ("sub1", [
+            "item5",
+            {"label": "sub2", "items": ["item6"]},
+        ]),
+    ], name="MyMenu")
+
+    items = MyMenu.as_tuple()
+    assert MyMenu.__name__ == "MyMenu"
+    assert len(items) == 7
+    assert items[0].type == "string" and items[0].label == "item1"
+    assert items[1].type == "separator"
+    assert items[2].label == "item2"
+    assert items[3].type == "check" and items[3].checked and items[3].radio
+    assert not items[4].enabled
+    assert items[5] is existing
+
+    sub1 = items[6].sub
+    assert items[6].type == "submenu"
+    assert sub1.__name__ == "sub1"
+    assert sub1.as_tuple()[1].sub.as_tuple()[0].label == "item6"
+
+    with popup_in_new_thread(MyMenu):
+        handle = _test_api.get_internal_id(MyMenu)
+        assert get_menu_item_count(handle) == 7
+        assert get_menu_item_string(handle, 6) == "sub1"
+        sub_handle = _test_api.get_internal_id(sub1)
+        assert get_menu_item_string(sub_handle, 0) == "item5"
+
+def test_menu_dump_load(tmp_path):
+    def cb(_):
+        pass
+    def other_cb(_):
+        pass
+
+    MyMenu = pywintray.Menu.from_spec([
+        ("item1", cb),
+        None,
+        {"type": "check", "label": "item2", "checked": True, "radio": True},
+        {"label": "item3", "enabled": False},
+        ("sub1", [("item4", other_cb), "item5"]),
+    ], name="MyMenu")
+    blob = MyMenu.dump(keys={MyMenu.as_tuple()[4].sub.as_tuple()[0]: "other"})
+    assert isinstance(blob, bytes)
+
+    path = tmp_path / "menu.bin"
+    path.write_bytes(blob)
+    with open(path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+        Loaded = pywintray.Menu.load(mm, callbacks={cb.__qualname__: cb, "other": other_cb})
+
+    items = Loaded.as_tuple()
+    assert Loaded.__name__ == "MyMenu"
+    assert len(items) == 5
+    assert items[0].label == "item1" and items[0].callback is cb
+    assert items[1].type == "separator"
+    assert items[2].type == "check" and items[2].checked and items[2].radio
+    assert not items[3].enabled and items[3].callback is None
+    sub1 = items[4].sub
+    assert sub1.__name__ == "sub1"
+    assert sub1.as_tuple()[0].callback is other_cb
+    assert sub1.as_tuple()[1].label == "item5"
+    assert Loaded.dump(keys={sub1.as_tuple()[0]: "other"}) == blob
+
+    # the names of two lambdas are the same
+    Lambdas = pywintray.Menu.from_spec([("item1", lambda _: None), ("item2", lambda _: None)])
+    with pytest.raises(ValueError):
+        Lambdas.dump()
+    item1, item2 = Lambdas.as_tuple()
+    Lambdas.dump(keys={item1: "first", item2: "second"})
+    # a callback shared by several items has one key
+    Shared = pywintray.Menu.from_spec([("item1", cb), ("item2", cb)])
+    Shared.dump()
+
+def test_menu_dump_load_shared():
+    Tools = pywintray.Menu.from_spec(["tool1", "tool2"], name="Tools")
+    class Parent(pywintray.Menu):
+        pass
+    Parent.append_item(pywintray.MenuItem.submenu("tools")(Tools))
+    class MyMenu(pywintray.Menu):
+        pass
+    MyMenu.append_item(pywintray.MenuItem.submenu("tools")(Tools))
+    MyMenu.append_item(pywintray.MenuItem.submenu("parent")(Parent))
+
+    # a shared submenu is written once and stays shared
+    blob = MyMenu.dump()
+    assert blob.count(b"tool1") == 1
+    Loaded = pywintray.Menu.load(blob)
+    tools, parent = Loaded.as_tuple()
+    assert parent.sub.as_tuple()[0].sub is tools.sub
+    assert [item.label for item in tools.sub.as_tuple()] == ["tool1", "tool2"]
+    assert Loaded.dump() == blob
+
+    # a reference must name an earlier menu that is not an ancestor
+    class Sub(pywintray.Menu):
+        pass
+    class Root(pywintray.Menu):
+        pass
+    Root.append_item(pywintray.MenuItem.submenu("sub")(Sub))
+    blob = bytearray(Root.dump())
+    # the flags of the "sub" item, and the "Sub" menu replaced by index 0
+    sub_menu_size = 4+len(b"Sub")+4
+    blob[-(sub_menu_size+4+len(b"sub")+1)] |= 0x10
+    blob[-sub_menu_size:] = (0).to_bytes(4, "little")
+    with pytest.raises(ValueError):
+        pywintray.Menu.load(bytes(blob))
+
 def test_submenu_partial_init():
     deco = pywintray.MenuItem.submenu("sub")
     partial_item = deco.__self__
@@ -525,6 +1559,34 @@ def test_submenu_circular_reference():
     with pytest.raises(ValueError):
         Menu1.insert_item(0, sub2)
 
+def test_submenu_circular_reference_deep():
+    menus = [type(f"Menu{i}", (pywintray.Menu,), {}) for i in range(50)]
+    items = [pywintray.MenuItem.submenu(f"sub{i}")(menu) for i, menu in enumerate(menus)]
+    # Menu0 > Menu1 > ... > Menu49
+    for i in range(49):
+        menus[i].append_item(items[i+1])
+
+    with pytest.raises(ValueError):
+        menus[49].append_item(items[0])
+    with pytest.raises(ValueError):
+        menus[30].append_item(items[10])
+    with pytest.raises(ValueError):
+        menus[0].append_item(items[0])
+
+    # a submenu shared by many parents
+    shared_item = pywintray.MenuItem.submenu("shared")(
+        type("Shared", (pywintray.Menu,), {})
+    )
+    for menu in menus:
+        menu.append_item(shared_item)
+    with pytest.raises(ValueError):
+        shared_item.sub.append_item(items[25])
+
+    # the ancestors are updated on remove
+    menus[24].remove_item(0)
+    menus[30].append_item(items[10])
+    shared_item.sub.append_item(items[25])
+
 def test_popup_position_and_align():
     class MyMenu(pywintray.Menu):
         item1 = pywintray.MenuItem.string("item1")
@@ -239,6 +239,14 @@ def get_menu_item_string(hmenu:int, index: int) -> str:
 
     return buf.value
 
+def get_menu_item_checked(hmenu:int, index: int) -> bool:
+    MF_BYPOSITION = 0x00000400
+    MF_CHECKED = 0x00000008
+    result = ctypes.windll.user32.GetMenuState(hmenu, index, MF_BYPOSITION)
+    if result == 0xFFFFFFFF:
+        raise OSError("Unable to get menu item state")
+    return bool(result & MF_CHECKED)
+
 def get_menu_item_count(hmenu:int) ->int:
     result = ctypes.windll.user32.GetMenuItemCount(hmenu)
     if result<0:
@@ -284,6 +292,50 @@ def get_icon_size(hicon:int):
     
     return (bm.bmWidth, bm.bmHeight)
 
+class BITMAPINFOHEADER(ctypes.Structure):
+    _fields_ = [
+        ("biSize", ctypes.wintypes.DWORD),
+        ("biWidth", ctypes.wintypes.LONG),
+        ("biHeight", ctypes.wintypes.LONG),
+        ("biPlanes", ctypes.wintypes.WORD),
+        ("biBitCount", ctypes.wintypes.WORD),
+        ("biCompression", ctypes.wintypes.DWORD),
+        ("biSizeImage", ctypes.wintypes.DWORD),
+        ("biXPelsPerMeter", ctypes.wintypes.LONG),
+        ("biYPelsPerMeter", ctypes.wintypes.LONG),
+        ("biClrUsed", ctypes.wintypes.DWORD),
+        ("biClrImportant", ctypes.wintypes.DWORD),
+    ]
+
+def get_icon_pixels(hicon:int) -> bytes:
+    """Get the color bitmap of an icon as BGRA (top-down)"""
+    width, height = get_icon_size(hicon)
+    icon_info = ICONINFO()
+    if not ctypes.windll.user32.GetIconInfo(hicon, ctypes.byref(icon_info)):
+        raise OSError("Unable to get icon info")
+
+    header = BITMAPINFOHEADER()
+    header.biSize = ctypes.sizeof(BITMAPINFOHEADER)
+    header.biWidth = width
+    header.biHeight = -height
+    header.biPlanes = 1
+    header.biBitCount = 32
+    buf = ctypes.create_string_buffer(width*height*4)
+
+    hdc = ctypes.windll.user32.GetDC(None)
+    result = ctypes.windll.gdi32.GetDIBits(
+        ctypes.wintypes.HDC(hdc),
+        ctypes.wintypes.HANDLE(icon_info.hbmColor),
+        0, height, buf, ctypes.byref(header), 0
+    )
+    ctypes.windll.user32.ReleaseDC(None, ctypes.wintypes.HDC(hdc))
+    ctypes.windll.gdi32.DeleteObject(ctypes.wintypes.HANDLE(icon_info.hbmMask))
+    ctypes.windll.gdi32.DeleteObject(ctypes.wintypes.HANDLE(icon_info.hbmColor))
+    if not result:
+        raise OSError("Unable to get bitmap bits")
+
+    return buf.raw
+
 def wait_for_threads_end(th_list:list[threading.Thread], timeout=2.0):
     for th in th_list:
         th.join(timeout)